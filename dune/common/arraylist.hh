@@ -184,6 +184,16 @@ namespace Dune
      * @brief Delete all entries from the list.
      */
     inline void clear();
+
+    /**
+     * @brief Replace the entries of the list by a range.
+     *
+     * The entries are copied chunk by chunk.
+     * @param first Iterator positioned at the first new entry.
+     * @param last Iterator positioned after the last new entry.
+     */
+    template<class InputIterator>
+    inline void assign(InputIterator first, InputIterator last);
     /**
      * @brief Constructs an Array list with one chunk.
      */
@@ -481,6 +491,22 @@ namespace Dune
     chunks_.clear();
   }
 
+  template<class T, int N, class A>
+  template<class InputIterator>
+  void ArrayList<T,N,A>::assign(InputIterator first, InputIterator last)
+  {
+    clear();
+    while(first != last) {
+      chunks_.push_back(std::make_shared<std::array<MemberType,chunkSize_> >());
+      capacity_ += chunkSize_;
+      std::array<MemberType,chunkSize_>& chunk = *chunks_.back();
+      size_type i=0;
+      for(; i<chunkSize_ && first != last; ++i, ++first)
+        chunk[i] = *first;
+      size_ += i;
+    }
+  }
+
   template<class T, int N, class A>
   size_t ArrayList<T,N,A>::size() const
   {
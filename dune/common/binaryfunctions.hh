@@ -9,6 +9,8 @@
  */
 #include <functional>
 #include <algorithm>
+#include <tuple>
+#include <utility>
 
 namespace Dune
 {
@@ -31,6 +33,33 @@ namespace Dune
       return std::max(t1,t2);
     }
   };
+
+  /**
+   * @brief Applies one binary function per component of two tuples.
+   *
+   * The k-th component of the result is the k-th binary function applied
+   * to the k-th components of the arguments. This allows for several
+   * different reductions in one collective operation.
+   */
+  template<typename... BinaryFunction>
+  struct TupleBinaryFunction
+  {
+    template<typename... Type>
+    std::tuple<Type...> operator()(const std::tuple<Type...>& t1, const std::tuple<Type...>& t2) const
+    {
+      static_assert(sizeof...(Type)==sizeof...(BinaryFunction),
+                    "Need one binary function per component");
+      return apply(t1, t2, std::index_sequence_for<Type...>());
+    }
+
+  private:
+    template<typename... Type, std::size_t... k>
+    static std::tuple<Type...> apply(const std::tuple<Type...>& t1, const std::tuple<Type...>& t2,
+                                     std::index_sequence<k...>)
+    {
+      return std::tuple<Type...>(BinaryFunction()(std::get<k>(t1), std::get<k>(t2))...);
+    }
+  };
 }
 
 #endif
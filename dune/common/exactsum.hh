@@ -0,0 +1,187 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifndef DUNE_COMMON_EXACTSUM_HH
+#define DUNE_COMMON_EXACTSUM_HH
+
+/** \file
+ * \brief An accumulator for sums of floating point numbers whose result
+ *    does not depend on the order of the summands.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace Dune
+{
+  /**
+   * @brief Accumulates a sum of doubles exactly.
+   *
+   * The sum is stored as a fixed point number covering the whole range of
+   * double, split into 32 bit digits held in 64 bit integers (a so called
+   * superaccumulator). Adding a double only touches three digits and
+   * never rounds, so the accumulated value and hence value() do not
+   * depend on the order of the summation. This makes sums reproducible
+   * across different numbers of processes, see
+   * CollectiveCommunication::setReproducibleSums().
+   *
+   * Infinite and NaN summands are summed separately and take precedence
+   * over the finite ones, as for ordinary floating point sums.
+   *
+   * The accumulator is trivially copyable and can be communicated
+   * bytewise.
+   */
+  class ExactSum
+  {
+    enum {
+      //! The number of bits of one digit
+      digitBits = 32,
+      //! The number of digits, covers the range of double plus carries
+      digits = 69,
+      //! The position of the bit with weight 1
+      offset = 1126
+    };
+
+    //! Normalize after this many additions to prevent overflow of the digits
+    static constexpr std::int64_t maxAdditions = std::int64_t(1) << 29;
+
+    static constexpr std::int64_t base = std::int64_t(1) << digitBits;
+
+  public:
+    //! Construct a zero sum
+    ExactSum()
+      : digits_(), special_(0.0), additions_(0)
+    {}
+
+    //! Construct a sum consisting of one summand
+    explicit ExactSum(double x)
+      : ExactSum()
+    {
+      *this += x;
+    }
+
+    //! Add a summand
+    ExactSum& operator+= (double x)
+    {
+      if(!std::isfinite(x)) {
+        special_ += x;
+        return *this;
+      }
+      if(x == 0.0)
+        return *this;
+
+      // x = m*2^(e-53) with an integral mantissa m of at most 53 bits
+      int e;
+      const double fraction = std::frexp(std::abs(x), &e);
+      const std::int64_t m = std::int64_t(std::ldexp(fraction, 53));
+      const int position = e - 53 + offset;
+      const int k = position / digitBits;
+      const int shift = position % digitBits;
+
+      // split the mantissa to keep the shifted parts within 64 bits
+      const std::int64_t low = (m & (base-1)) << shift;
+      const std::int64_t high = (m >> digitBits) << shift;
+      const std::int64_t sign = x < 0 ? -1 : 1;
+      digits_[k] += sign * (low & (base-1));
+      digits_[k+1] += sign * ((low >> digitBits) + (high & (base-1)));
+      digits_[k+2] += sign * (high >> digitBits);
+
+      if(++additions_ == maxAdditions)
+        normalize();
+      return *this;
+    }
+
+    //! Add another sum
+    ExactSum& operator+= (const ExactSum& other)
+    {
+      for(int i=0; i<digits; ++i)
+        digits_[i] += other.digits_[i];
+      special_ += other.special_;
+      normalize();
+      return *this;
+    }
+
+    friend ExactSum operator+ (ExactSum a, const ExactSum& b)
+    {
+      return a += b;
+    }
+
+    /**
+     * @brief The sum rounded to double.
+     *
+     * The exact value of the sum is rounded once to the nearest double
+     * (ties to even), so the result only depends on the exact value of
+     * the sum.
+     */
+    double value() const
+    {
+      if(special_ != 0.0 || std::isnan(special_))
+        return special_;
+
+      ExactSum s(*this);
+      s.normalize();
+      const bool negative = s.digits_[digits-1] < 0;
+      if(negative) {
+        for(int i=0; i<digits; ++i)
+          s.digits_[i] = -s.digits_[i];
+        s.normalize();
+      }
+
+      // all digits are nonnegative now, find the most significant bit
+      int top = digits-1;
+      while(top >= 0 && s.digits_[top] == 0)
+        --top;
+      if(top < 0)
+        return 0.0;
+      int msb = top*digitBits;
+      for(std::int64_t d = s.digits_[top]; d > 1; d >>= 1)
+        ++msb;
+
+      // Cut out the 64 most significant bits and collect the bits below in
+      // a sticky bit. The conversion to double rounds these once, the
+      // sticky bit lies far below the rounding position and only decides
+      // whether the cut off part is zero. Sums below the smallest normal
+      // double have at most 52 bits and are converted exactly.
+      const int low = std::max(msb-63, 0);
+      std::uint64_t bits = 0;
+      bool sticky = false;
+      for(int i=top; i>=0; --i) {
+        const std::uint64_t d = s.digits_[i];
+        const int shift = i*digitBits - low;
+        if(shift >= 0)
+          bits |= d << shift;
+        else if(shift > -64) {
+          bits |= d >> -shift;
+          sticky = sticky || (d & ((std::uint64_t(1) << -shift) - 1)) != 0;
+        }
+        else
+          sticky = sticky || d != 0;
+      }
+      if(sticky)
+        bits |= 1;
+
+      const double result = std::ldexp(double(bits), low - offset);
+      return negative ? -result : result;
+    }
+
+  private:
+    //! Propagate the carries such that all but the last digit are in [0, base)
+    void normalize()
+    {
+      for(int i=0; i<digits-1; ++i) {
+        std::int64_t carry = digits_[i] / base;
+        if(digits_[i] % base < 0)
+          --carry;
+        digits_[i] -= carry * base;
+        digits_[i+1] += carry;
+      }
+      additions_ = 0;
+    }
+
+    std::int64_t digits_[digits];
+    double special_;
+    std::int64_t additions_;
+  };
+}
+
+#endif
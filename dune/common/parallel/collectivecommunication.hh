@@ -12,10 +12,16 @@
 #include <iostream>
 #include <complex>
 #include <algorithm>
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <tuple>
+#include <utility>
 
 #include <dune/common/binaryfunctions.hh>
 #include <dune/common/exceptions.hh>
 #include <dune/common/unused.hh>
+#include <dune/common/parallel/future.hh>
 
 /*! \defgroup ParallelCommunication Parallel Communication
    \ingroup Common
@@ -42,6 +48,74 @@ namespace Dune
   /* define some type that definitely differs from MPI_Comm */
   struct No_Comm {};
 
+  template<class K, int SIZE> class FieldVector;
+
+  namespace Impl
+  {
+    //! Extract the values from a tuple of pairs of values and binary functions
+    template<typename... Type, typename... BinaryFunction, std::size_t... k>
+    std::tuple<Type...> reductionValues(const std::tuple<std::pair<Type,BinaryFunction>...>& values,
+                                        std::index_sequence<k...>)
+    {
+      return std::tuple<Type...>(std::get<k>(values).first...);
+    }
+
+    /*! \brief Describes types that consist of a contiguous array of scalars.
+
+       Reductions of these types are applied element-wise. For scalars size
+       is 1.
+     */
+    template<typename T>
+    struct ElementwiseReductionTraits
+    {
+      typedef T scalar_type;
+      enum { size = 1 };
+    };
+
+    template<typename K, int n>
+    struct ElementwiseReductionTraits<FieldVector<K,n> >
+    {
+      typedef typename ElementwiseReductionTraits<K>::scalar_type scalar_type;
+      enum { size = n*ElementwiseReductionTraits<K>::size };
+    };
+
+    template<typename K, std::size_t n>
+    struct ElementwiseReductionTraits<std::array<K,n> >
+    {
+      typedef typename ElementwiseReductionTraits<K>::scalar_type scalar_type;
+      enum { size = n*ElementwiseReductionTraits<K>::size };
+    };
+
+    //! The binary function for the scalar type of an element-wise reduction
+    template<typename BinaryFunction, typename Scalar>
+    struct ScalarBinaryFunction
+    {};
+
+    template<typename T, typename Scalar>
+    struct ScalarBinaryFunction<std::plus<T>, Scalar>
+    {
+      typedef std::plus<Scalar> type;
+    };
+
+    template<typename T, typename Scalar>
+    struct ScalarBinaryFunction<std::multiplies<T>, Scalar>
+    {
+      typedef std::multiplies<Scalar> type;
+    };
+
+    template<typename T, typename Scalar>
+    struct ScalarBinaryFunction<Min<T>, Scalar>
+    {
+      typedef Min<Scalar> type;
+    };
+
+    template<typename T, typename Scalar>
+    struct ScalarBinaryFunction<Max<T>, Scalar>
+    {
+      typedef Max<Scalar> type;
+    };
+  }
+
 
   /*! @brief Collective communication interface and sequential default implementation
 
@@ -81,6 +155,7 @@ namespace Dune
   public:
     //! Construct default object
     CollectiveCommunication()
+      : reproducibleSums_(false), hierarchical_(false)
     {}
 
     /** \brief Constructor with a given communicator
@@ -88,6 +163,7 @@ namespace Dune
      * As this is implementation for the sequential setting, the communicator is a dummy and simply discarded.
      */
     CollectiveCommunication (const Communicator&)
+      : reproducibleSums_(false), hierarchical_(false)
     {}
 
     //! Return rank, is between 0 and size()-1
@@ -102,6 +178,49 @@ namespace Dune
       return 1;
     }
 
+    /**
+     * @brief Set whether sums of floating point numbers are reproducible.
+     *
+     * If enabled, sum() of float and double accumulates the summands of all
+     * processes exactly with an ExactSum and rounds the exact result once to
+     * the nearest double (sums of float are then rounded to float), so it
+     * does not depend on the number of processes or the order in which MPI
+     * reduces the contributions. This is considerably more expensive than a
+     * plain sum, as each summand is communicated as an accumulator of
+     * several hundred bytes. Disabled by default.
+     */
+    void setReproducibleSums (bool reproducible)
+    {
+      reproducibleSums_ = reproducible;
+    }
+
+    //! Whether sums of floating point numbers are reproducible, see setReproducibleSums()
+    bool reproducibleSums () const
+    {
+      return reproducibleSums_;
+    }
+
+    /**
+     * @brief Set whether allreduce() and broadcast() work in two levels.
+     *
+     * If enabled, the processes of each node first combine their data
+     * through shared memory. Then one process per node communicates with
+     * the other nodes, and the result is shared within the node again.
+     * This may be faster than the flat operation for medium sized data on
+     * machines with many processes per node. Types that are not trivially
+     * copyable always use the flat operation. Disabled by default.
+     */
+    void setHierarchical (bool hierarchical)
+    {
+      hierarchical_ = hierarchical;
+    }
+
+    //! Whether allreduce() and broadcast() work in two levels, see setHierarchical()
+    bool hierarchical () const
+    {
+      return hierarchical_;
+    }
+
     /** @brief  Compute the sum of the argument over all processes and
             return the result in every process. Assumes that T has an operator+
      */
@@ -367,6 +486,8 @@ namespace Dune
      * @param inout The array to compute on.
      * @param len The number of components in the array
      * @returns MPI_SUCCESS (==0) if successful, an MPI error code otherwise
+     * @note Sums, products, minima and maxima of FieldVector and std::array
+     * are computed element-wise.
      */
     template<typename BinaryFunction, typename Type>
     int allreduce(Type* inout, int len) const
@@ -388,6 +509,8 @@ namespace Dune
      * @param out The array to store the results in.
      * @param len The number of components in the array
      * @returns MPI_SUCCESS (==0) if successful, an MPI error code otherwise
+     * @note Sums, products, minima and maxima of FieldVector and std::array
+     * are computed element-wise.
      */
     template<typename BinaryFunction, typename Type>
     void allreduce(const Type* in, Type* out, int len) const
@@ -396,6 +519,151 @@ namespace Dune
       return;
     }
 
+    /**
+     * @brief Compute several different reductions over all processes at once
+     * and return the results in every process.
+     *
+     * Each entry of the tuple pairs a value with the binary function to
+     * reduce it with. All values are reduced in a single collective
+     * operation:
+     * \code
+     * auto r = comm.allreduce(std::make_tuple(std::make_pair(defect, std::plus<double>()),
+     *                                         std::make_pair(error, Max<double>()),
+     *                                         std::make_pair(iterations, Min<int>())));
+     * \endcode
+     * The values are communicated bytewise, see TupleBinaryFunction.
+     *
+     * @param values The tuple of pairs of values and binary functions.
+     * @returns The tuple of the reduced values.
+     */
+    template<typename... Type, typename... BinaryFunction>
+    std::tuple<Type...> allreduce(const std::tuple<std::pair<Type,BinaryFunction>...>& values) const
+    {
+      return Impl::reductionValues(values, std::index_sequence_for<Type...>());
+    }
+
+    /**
+     * @brief Start computing something over all processes and return
+     * a future for the result.
+     *
+     * The template parameter BinaryFunction is the type of
+     * the binary function to use for the computation. Computation
+     * may overlap with the communication until the result is retrieved
+     * from the future with get().
+     *
+     * @param in The value to compute on.
+     * @returns A future with ready(), wait() and get() methods,
+     *          see PseudoFuture and MPIFuture.
+     */
+    template<typename BinaryFunction, typename Type>
+    PseudoFuture<Type> iallreduce(const Type& in) const
+    {
+      return PseudoFuture<Type>(in);
+    }
+
+    /**
+     * @brief Start computing something over all processes
+     * for each component of an array.
+     *
+     * The arrays must not be accessed until the returned future
+     * completed.
+     *
+     * @param in The array to compute on.
+     * @param out The array to store the results in.
+     * @param len The number of components in the array
+     * @returns A future without result.
+     */
+    template<typename BinaryFunction, typename Type>
+    PseudoFuture<void> iallreduce(const Type* in, Type* out, int len) const
+    {
+      std::copy(in, in+len, out);
+      return PseudoFuture<void>();
+    }
+
+    /**
+     * @brief Start computing several different reductions over all processes,
+     * see allreduce(const std::tuple<std::pair<Type,BinaryFunction>...>&) const
+     *
+     * @returns A future for the tuple of the reduced values.
+     */
+    template<typename... Type, typename... BinaryFunction>
+    PseudoFuture<std::tuple<Type...> >
+    iallreduce(const std::tuple<std::pair<Type,BinaryFunction>...>& values) const
+    {
+      return PseudoFuture<std::tuple<Type...> >(allreduce(values));
+    }
+
+    /** @brief Start computing the sum of the argument over all processes,
+        see iallreduce(const Type&) const
+     */
+    template<typename T>
+    PseudoFuture<T> isum (const T& in) const
+    {
+      return PseudoFuture<T>(in);
+    }
+
+    /** @brief Start computing the product of the argument over all processes,
+        see iallreduce(const Type&) const
+     */
+    template<typename T>
+    PseudoFuture<T> iprod (const T& in) const
+    {
+      return PseudoFuture<T>(in);
+    }
+
+    /** @brief Start computing the minimum of the argument over all processes,
+        see iallreduce(const Type&) const
+     */
+    template<typename T>
+    PseudoFuture<T> imin (const T& in) const
+    {
+      return PseudoFuture<T>(in);
+    }
+
+    /** @brief Start computing the maximum of the argument over all processes,
+        see iallreduce(const Type&) const
+     */
+    template<typename T>
+    PseudoFuture<T> imax (const T& in) const
+    {
+      return PseudoFuture<T>(in);
+    }
+
+    /** @brief Start a barrier, the returned future is ready once all processes
+        arrived at it.
+     */
+    PseudoFuture<void> ibarrier () const
+    {
+      return PseudoFuture<void>();
+    }
+
+    /** @brief Start distributing an array from the process with rank root to all
+        other processes. The array must not be accessed until the returned future
+        completed.
+     */
+    template<typename T>
+    PseudoFuture<void> ibroadcast (T* inout, int len, int root) const
+    {
+      DUNE_UNUSED_PARAMETER(inout);
+      DUNE_UNUSED_PARAMETER(len);
+      DUNE_UNUSED_PARAMETER(root);
+      return PseudoFuture<void>();
+    }
+
+    /** @brief Start gathering data from all tasks and distributing it to all,
+        see allgather(). The buffers must not be accessed until the returned
+        future completed.
+     */
+    template<typename T>
+    PseudoFuture<void> iallgather(const T* sbuf, int count, T* rbuf) const
+    {
+      allgather(sbuf, count, rbuf);
+      return PseudoFuture<void>();
+    }
+
+  private:
+    bool reproducibleSums_;
+    bool hierarchical_;
   };
 }
 
@@ -0,0 +1,400 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifndef DUNE_COMMON_PARALLEL_COMMUNICATIONPROFILER_HH
+#define DUNE_COMMON_PARALLEL_COMMUNICATIONPROFILER_HH
+
+/*!
+   \file
+   \brief Opt-in recording of the time and the messages of the communication.
+
+   \ingroup ParallelCommunication
+ */
+
+#if HAVE_MPI
+
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+
+#include <dune/common/exceptions.hh>
+#include <dune/common/visibility.hh>
+
+namespace Dune
+{
+
+  /*! @brief The messages exchanged with one neighbour.
+
+     \ingroup ParallelCommunication
+   */
+  struct CommunicationVolume
+  {
+    //! The number of messages sent
+    std::size_t messagesSent = 0;
+    //! The number of bytes sent
+    std::size_t bytesSent = 0;
+    //! The number of messages received
+    std::size_t messagesReceived = 0;
+    //! The number of bytes received
+    std::size_t bytesReceived = 0;
+  };
+
+  /*! @brief The statistics of one communication operation on one process.
+
+     \ingroup ParallelCommunication
+   */
+  struct CommunicationRecord : public CommunicationVolume
+  {
+    //! The number of calls
+    std::size_t calls = 0;
+    //! The wall time spent in the calls in seconds
+    double time = 0.0;
+    //! The part of the time spent waiting for the completion of messages
+    double waitTime = 0.0;
+    //! The messages per neighbour
+    std::map<int,CommunicationVolume> neighbours;
+  };
+
+  /*! @brief Records the time and the messages of the communication.
+
+     The communicators of dune-common (BufferedCommunicator,
+     DatatypeCommunicator, VariableSizeCommunicator), IndicesSyncer,
+     RemoteIndices::rebuild and the blocking collectives of
+     CollectiveCommunication<MPI_Comm> record every call once profiling
+     is enabled:
+     \code
+     CommunicationProfiler::enable();
+     CommunicationProfiler::setName(&communicator, "velocity");
+     // ... communicate
+     CommunicationProfiler::write("profile.json", MPI_COMM_WORLD);
+     \endcode
+
+     The records are kept per operation, like
+     "BufferedCommunicator::forward", or per operation and instance if the
+     instance was named with setName(). Times include nested operations.
+     While profiling is disabled, each call only checks a flag.
+
+     The profiler is not thread safe, only the thread calling MPI may
+     communicate while it is enabled.
+     \ingroup ParallelCommunication
+   */
+  class CommunicationProfiler
+  {
+  public:
+    class Scope;
+
+    //! Enable or disable the recording
+    static void enable (bool enabled = true)
+    {
+      enabledStorage() = enabled;
+    }
+
+    //! Whether the recording is enabled
+    static bool enabled ()
+    {
+      return enabledStorage();
+    }
+
+    /*! @brief Record the operations of an instance separately.
+
+       The name should be the same on all processes, as the records are
+       aggregated by name. An empty name removes the instance name.
+     */
+    static void setName (const void* instance, const std::string& name)
+    {
+      if(name.empty())
+        nameStorage().erase(instance);
+      else
+        nameStorage()[instance] = name;
+    }
+
+    //! Remove all records
+    static void clear ()
+    {
+      recordStorage().clear();
+    }
+
+    //! The records of this process, by operation and instance name
+    static const std::map<std::string,CommunicationRecord>& records ()
+    {
+      return recordStorage();
+    }
+
+    /*! @brief Write the records of all processes as JSON.
+
+       For every record the minimum, the average and the maximum over all
+       processes of the communicator are written, with processes that did
+       not record it counting as zero, followed by the messages per
+       process and neighbour. This is a collective operation, only the
+       process with rank zero writes to the stream.
+     */
+    static void write (std::ostream& os, MPI_Comm comm);
+
+    /*! @brief Write the records of all processes as JSON to a file.
+
+       This is a collective operation, only the process with rank zero
+       writes the file.
+     */
+    static void write (const std::string& filename, MPI_Comm comm);
+
+  private:
+    //! Get the record of an operation of an instance
+    static CommunicationRecord& record (const char* operation, const void* instance)
+    {
+      std::map<const void*,std::string>& names = nameStorage();
+      std::map<const void*,std::string>::const_iterator name = names.find(instance);
+      if(name == names.end())
+        return recordStorage()[operation];
+      return recordStorage()[std::string(operation)+"["+name->second+"]"];
+    }
+
+    static std::string quote (const std::string& s);
+
+    DUNE_EXPORT static bool& enabledStorage ()
+    {
+      static bool enabled = false;
+      return enabled;
+    }
+
+    DUNE_EXPORT static std::map<std::string,CommunicationRecord>& recordStorage ()
+    {
+      static std::map<std::string,CommunicationRecord> records;
+      return records;
+    }
+
+    DUNE_EXPORT static std::map<const void*,std::string>& nameStorage ()
+    {
+      static std::map<const void*,std::string> names;
+      return names;
+    }
+  };
+
+  /*! @brief Records one call of a communication operation.
+
+     Measures the time from construction to destruction and collects the
+     messages and the waiting time reported to it. All methods return
+     immediately if the profiling was disabled on construction.
+     \ingroup ParallelCommunication
+   */
+  class CommunicationProfiler::Scope
+  {
+  public:
+    /*! @brief Start recording a call.
+
+       @param operation The name of the operation, has to stay valid.
+       @param instance The instance performing the operation, for
+       separate records of named instances.
+     */
+    explicit Scope (const char* operation, const void* instance = nullptr)
+      : record_(nullptr)
+    {
+      if(CommunicationProfiler::enabled()) {
+        record_ = &CommunicationProfiler::record(operation, instance);
+        ++record_->calls;
+        start_ = MPI_Wtime();
+      }
+    }
+
+    ~Scope ()
+    {
+      if(record_)
+        record_->time += MPI_Wtime() - start_;
+    }
+
+    //! Whether the call is recorded
+    bool active () const
+    {
+      return record_;
+    }
+
+    /*! @brief Record a message sent.
+
+       @param neighbour The rank of the receiver, or a negative number for
+       the contribution to a collective operation.
+       @param bytes The size of the message.
+     */
+    void send (int neighbour, std::size_t bytes)
+    {
+      if(record_) {
+        add(*record_, bytes, true);
+        if(neighbour >= 0)
+          add(record_->neighbours[neighbour], bytes, true);
+      }
+    }
+
+    /*! @brief Record a message received.
+
+       @param neighbour The rank of the sender, or a negative number for
+       the result of a collective operation.
+       @param bytes The size of the message.
+     */
+    void receive (int neighbour, std::size_t bytes)
+    {
+      if(record_) {
+        add(*record_, bytes, false);
+        if(neighbour >= 0)
+          add(record_->neighbours[neighbour], bytes, false);
+      }
+    }
+
+    /*! @brief Start measuring the time spent waiting for messages.
+
+       @return The start time to pass to endWait.
+     */
+    double beginWait () const
+    {
+      return record_ ? MPI_Wtime() : 0.0;
+    }
+
+    //! Stop measuring the time spent waiting for messages
+    void endWait (double start)
+    {
+      if(record_)
+        record_->waitTime += MPI_Wtime() - start;
+    }
+
+  private:
+    static void add (CommunicationVolume& volume, std::size_t bytes, bool send)
+    {
+      if(send) {
+        ++volume.messagesSent;
+        volume.bytesSent += bytes;
+      }else{
+        ++volume.messagesReceived;
+        volume.bytesReceived += bytes;
+      }
+    }
+
+    CommunicationRecord* record_;
+    double start_;
+  };
+
+#ifndef DOXYGEN
+
+  inline std::string CommunicationProfiler::quote (const std::string& s)
+  {
+    std::string quoted("\"");
+    for(char c : s) {
+      if(c == '"' || c == '\\')
+        quoted += '\\';
+      quoted += c;
+    }
+    return quoted + "\"";
+  }
+
+  inline void CommunicationProfiler::write (std::ostream& os, MPI_Comm comm)
+  {
+    int rank, procs;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &procs);
+
+    // One line per record and one per neighbour, separated by tabs
+    std::ostringstream local;
+    local.precision(17);
+    for(const auto& record : records()) {
+      const CommunicationRecord& r = record.second;
+      local<<"R\t"<<record.first<<"\t"<<r.calls<<"\t"<<r.time<<"\t"<<r.waitTime<<"\t"
+           <<r.messagesSent<<"\t"<<r.bytesSent<<"\t"<<r.messagesReceived<<"\t"<<r.bytesReceived<<"\n";
+      for(const auto& neighbour : r.neighbours)
+        local<<"N\t"<<neighbour.first<<"\t"<<neighbour.second.messagesSent<<"\t"
+             <<neighbour.second.bytesSent<<"\t"<<neighbour.second.messagesReceived<<"\t"
+             <<neighbour.second.bytesReceived<<"\n";
+    }
+    const std::string data = local.str();
+
+    int length = data.size();
+    std::vector<int> lengths(procs), displacements(procs+1, 0);
+    MPI_Gather(&length, 1, MPI_INT, lengths.data(), 1, MPI_INT, 0, comm);
+    for(int p=0; p<procs; ++p)
+      displacements[p+1] = displacements[p] + lengths[p];
+    std::vector<char> all(rank == 0 ? displacements[procs] : 0);
+    MPI_Gatherv(const_cast<char*>(data.data()), length, MPI_CHAR, all.data(), lengths.data(),
+                displacements.data(), MPI_CHAR, 0, comm);
+    if(rank != 0)
+      return;
+
+    // The values of each record per process and the neighbour lines
+    const int fields = 7;
+    std::map<std::string,std::vector<std::vector<double> > > values;
+    std::map<std::string,std::string> neighbourLines;
+    for(int p=0; p<procs; ++p) {
+      std::istringstream lines(std::string(all.data()+displacements[p], lengths[p]));
+      std::string line, name;
+      while(std::getline(lines, line)) {
+        std::istringstream columns(line);
+        std::string kind;
+        std::getline(columns, kind, '\t');
+        if(kind == "R") {
+          std::getline(columns, name, '\t');
+          std::vector<std::vector<double> >& v = values[name];
+          v.resize(fields, std::vector<double>(procs, 0.0));
+          for(int f=0; f<fields; ++f)
+            columns >> v[f][p];
+        }else{
+          std::size_t neighbour, volume[4];
+          columns >> neighbour >> volume[0] >> volume[1] >> volume[2] >> volume[3];
+          std::ostringstream entry;
+          entry<<"        {\"rank\": "<<p<<", \"neighbour\": "<<neighbour
+               <<", \"messagesSent\": "<<volume[0]<<", \"bytesSent\": "<<volume[1]
+               <<", \"messagesReceived\": "<<volume[2]<<", \"bytesReceived\": "<<volume[3]<<"}";
+          std::string& entries = neighbourLines[name];
+          entries += (entries.empty() ? "" : ",\n") + entry.str();
+        }
+      }
+    }
+
+    const char* names[fields] = { "calls", "time", "waitTime", "messagesSent", "bytesSent",
+                                  "messagesReceived", "bytesReceived" };
+    os<<"{\n  \"processes\": "<<procs<<",\n  \"records\": [";
+    bool first = true;
+    for(const auto& record : values) {
+      os<<(first ? "\n" : ",\n")<<"    {\n      \"name\": "<<quote(record.first)<<",\n";
+      first = false;
+      const std::vector<double>& calls = record.second[0];
+      os<<"      \"processes\": "<<std::count_if(calls.begin(), calls.end(), [](double c) { return c > 0; })<<",\n";
+      for(int f=0; f<fields; ++f) {
+        const std::vector<double>& v = record.second[f];
+        double sum = 0.0;
+        for(double x : v)
+          sum += x;
+        os<<"      "<<quote(names[f])<<": {\"min\": "<<*std::min_element(v.begin(), v.end())
+          <<", \"avg\": "<<sum/procs<<", \"max\": "<<*std::max_element(v.begin(), v.end())<<"},\n";
+      }
+      os<<"      \"neighbours\": [";
+      const std::string& entries = neighbourLines[record.first];
+      if(!entries.empty())
+        os<<"\n"<<entries<<"\n      ";
+      os<<"]\n    }";
+    }
+    os<<"\n  ]\n}\n";
+  }
+
+  inline void CommunicationProfiler::write (const std::string& filename, MPI_Comm comm)
+  {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    std::ofstream file;
+    int opened = 1;
+    if(rank == 0) {
+      file.open(filename);
+      opened = bool(file);
+    }
+    MPI_Bcast(&opened, 1, MPI_INT, 0, comm);
+    if(!opened)
+      DUNE_THROW(IOError, "Could not open " << filename);
+    write(file, comm);
+  }
+
+#endif // DOXYGEN
+
+} // namespace Dune
+
+#endif // HAVE_MPI
+
+#endif
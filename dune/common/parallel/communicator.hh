@@ -5,17 +5,29 @@
 
 #if HAVE_MPI
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstddef>
+#include <exception>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <mutex>
+#include <thread>
+#include <tuple>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include <mpi.h>
 
 #include <dune/common/exceptions.hh>
+#include <dune/common/hybridutilities.hh>
+#include <dune/common/parallel/communicationprofiler.hh>
 #include <dune/common/parallel/interface.hh>
+#include <dune/common/parallel/mpidatatyperegistry.hh>
+#include <dune/common/parallel/mpihelper.hh>
 #include <dune/common/parallel/remoteindices.hh>
 #include <dune/common/stdstreams.hh>
 #include <dune/common/unused.hh>
@@ -207,6 +219,120 @@ namespace Dune
 
   };
 
+  /**
+   * @brief Traits class telling whether a GatherScatter just copies the values.
+   *
+   * If this is true, BufferedCommunicator may send the values directly from
+   * and receive them directly into the memory of the data instead of packing
+   * them into a buffer. Specialize it for your own copying GatherScatter
+   * classes.
+   */
+  template<class GatherScatter, class Data>
+  struct IsCopyGatherScatter : public std::false_type
+  {};
+
+  template<class T>
+  struct IsCopyGatherScatter<CopyGatherScatter<T>,T> : public std::true_type
+  {};
+
+  /**
+   * @brief Several indexed data structures that are communicated together.
+   *
+   * Communicating a MultiData with a MultiGatherScatter sends the values of
+   * all data structures at an index in one message per process instead of
+   * one message per process and data structure:
+   * \code
+   * auto fields = makeMultiData(velocity, pressure, temperature);
+   * communicator.build<decltype(fields)>(interface);
+   * communicator.forward<MultiGatherScatter<CopyGatherScatter<V>, AddGatherScatter<P>,
+   *                                         CopyGatherScatter<T> > >(fields);
+   * \endcode
+   * All data structures need to have exactly one value per index
+   * (see SizeOne). Use MultiDataHandle with a VariableSizeCommunicator
+   * for a variable number of values per index.
+   *
+   * @tparam Data The types of the data structures.
+   */
+  template<class... Data>
+  class MultiData
+  {
+  public:
+    /**
+     * @brief The values of all data structures at an index.
+     */
+    typedef std::tuple<typename CommPolicy<typename std::remove_const<Data>::type>::IndexedType...> value_type;
+
+    /**
+     * @brief Constructor.
+     * @param data The data structures. They are stored by reference.
+     */
+    MultiData(Data&... data)
+      : data_(data...)
+    {}
+
+    /**
+     * @brief Get the k-th data structure.
+     */
+    template<std::size_t k>
+    typename std::tuple_element<k, std::tuple<Data...> >::type& get() const
+    {
+      return std::get<k>(data_);
+    }
+
+  private:
+    std::tuple<Data&...> data_;
+  };
+
+  /**
+   * @brief Create a MultiData referencing several data structures.
+   */
+  template<class... Data>
+  MultiData<Data...> makeMultiData(Data&... data)
+  {
+    return MultiData<Data...>(data...);
+  }
+
+  template<class... Data>
+  struct CommPolicy<MultiData<Data...> >
+  {
+    typedef MultiData<Data...> Type;
+
+    typedef typename Type::value_type IndexedType;
+
+    typedef SizeOne IndexedTypeFlag;
+
+    /**
+     * @brief The values at an index are not stored together, therefore
+     * this returns a null pointer and MultiData cannot be used with
+     * DatatypeCommunicator.
+     */
+    static const void* getAddress(const Type& v, int index);
+
+    static int getSize(const Type& v, int index);
+  };
+
+  /**
+   * @brief GatherScatter for MultiData applying one GatherScatter per data structure.
+   *
+   * @tparam GatherScatter The GatherScatter classes. The k-th one is used for
+   * the k-th data structure of the MultiData.
+   */
+  template<class... GatherScatter>
+  struct MultiGatherScatter
+  {
+    template<class... Data>
+    static typename MultiData<Data...>::value_type gather(const MultiData<Data...>& data, std::size_t i);
+
+    template<class... Data>
+    static void scatter(MultiData<Data...>& data, const typename MultiData<Data...>::value_type& v,
+                        std::size_t i);
+
+  private:
+    template<class... Data, std::size_t... k>
+    static typename MultiData<Data...>::value_type gather(const MultiData<Data...>& data, std::size_t i,
+                                                          std::index_sequence<k...>);
+  };
+
   /**
    * @brief An utility class for communicating distributed data structures via MPI datatypes.
    *
@@ -349,7 +475,7 @@ namespace Dune
     /**
      * @brief Initiates the sending and receive.
      */
-    void sendRecv(MPI_Request* req);
+    void sendRecv(MPI_Request* req, bool forward);
 
     /**
      * @brief Information used for setting up the MPI Datatypes.
@@ -602,6 +728,47 @@ namespace Dune
     template<class GatherScatter, class Data>
     void backward(Data& data);
 
+    /**
+     * @brief Set the minimum average length of the runs of consecutive indices
+     * for communicating a message without packing.
+     *
+     * If the GatherScatter only copies the values (see IsCopyGatherScatter),
+     * messages whose indices form one run of consecutive indices, or runs
+     * of consecutive indices with at least this average length, are sent
+     * from and received into the memory of the data directly. For the latter
+     * an MPI datatype addressing the runs is used. This includes runs of
+     * equally spaced indices detected by Interface::compress(). A value of
+     * zero turns this off and always packs the data into the buffers.
+     *
+     * @param length The minimum average length of the runs (default 16).
+     */
+    void setMinDirectRunLength(std::size_t length);
+
+    /**
+     * @brief Set the number of threads used for gathering and scattering.
+     *
+     * The messages are split into chunks of consecutive entries that are
+     * gathered and scattered concurrently. Therefore the gather and scatter
+     * functions of the GatherScatter classes are called from several threads
+     * at once and have to be thread-safe. They are called for different
+     * indices, but e.g. must not update shared counters without
+     * synchronization. Only the calling thread calls MPI, therefore threads
+     * are only used if MPI provides at least MPI_THREAD_FUNNELED. Scattering
+     * is only done concurrently if no local index is received more than once.
+     * Small exchanges are always done by the calling thread alone.
+     *
+     * If a gather or scatter function throws in one of the threads, the
+     * exception is rethrown in the calling thread. The messages are still
+     * exchanged before, so the communicator can be used again. The values
+     * the other processes receive from this one and the values scattered
+     * on this one are unspecified then.
+     *
+     * The default is MPIHelper::communicationThreads().
+     *
+     * @param threads The number of threads including the calling one.
+     */
+    void setThreads(std::size_t threads);
+
     /**
      * @brief Free the allocated memory (i.e. buffers and message information.
      */
@@ -704,13 +871,16 @@ namespace Dune
       };
 
       /**
-       * @brief Copies the values to send into the buffer.
+       * @brief Copies the values to send to a process into the buffer.
        * @param interface The interface used in the send.
        * @param data The data from which we copy the values.
-       * @param buffer The send buffer to copy to.
-       * @param bufferSize The size of the buffer in bytes. For checks.
+       * @param buffer The start of the message in the send buffer.
+       * @param proc The rank of the process the message is for.
+       * @param begin The first entry of the interface to copy.
+       * @param end The entry of the interface after the last one to copy.
        */
-      inline void operator()(const InterfaceMap& interface, const Data& data, Type* buffer, size_t bufferSize) const;
+      inline void operator()(const InterfaceMap& interface, const Data& data, Type* buffer, const int& proc,
+                             std::size_t begin, std::size_t end) const;
     };
 
     /**
@@ -739,13 +909,16 @@ namespace Dune
       };
 
       /**
-       * @brief Copies the values to send into the buffer.
+       * @brief Copies the values to send to a process into the buffer.
        * @param interface The interface used in the send.
        * @param data The data from which we copy the values.
-       * @param buffer The send buffer to copy to.
-       * @param bufferSize The size of the buffer in bytes. For checks.
+       * @param buffer The start of the message in the send buffer.
+       * @param proc The rank of the process the message is for.
+       * @param begin The first entry of the interface to copy.
+       * @param end The entry of the interface after the last one to copy.
        */
-      inline void operator()(const InterfaceMap& interface, const Data& data, Type* buffer, size_t bufferSize) const;
+      inline void operator()(const InterfaceMap& interface, const Data& data, Type* buffer, const int& proc,
+                             std::size_t begin, std::size_t end) const;
     };
 
     /**
@@ -784,10 +957,13 @@ namespace Dune
        * @brief Copy the message data from the receive buffer to the data.
        * @param interface The interface used in the send.
        * @param data The data to which we copy the values.
-       * @param buffer The receive buffer to copy from.
+       * @param buffer The start of the message in the receive buffer.
        * @param proc The rank of the process the message is from.
+       * @param begin The first entry of the interface to copy.
+       * @param end The entry of the interface after the last one to copy.
        */
-      inline void operator()(const InterfaceMap& interface, Data& data, Type* buffer, const int& proc) const;
+      inline void operator()(const InterfaceMap& interface, Data& data, Type* buffer, const int& proc,
+                             std::size_t begin, std::size_t end) const;
     };
     /**
      * @brief Functor for message data scattering for datatypes
@@ -818,10 +994,13 @@ namespace Dune
        * @brief Copy the message data from the receive buffer to the data.
        * @param interface The interface used in the send.
        * @param data The data to which we copy the values.
-       * @param buffer The receive buffer to copy from.
+       * @param buffer The start of the message in the receive buffer.
        * @param proc The rank of the process the message is from.
+       * @param begin The first entry of the interface to copy.
+       * @param end The entry of the interface after the last one to copy.
        */
-      inline void operator()(const InterfaceMap& interface, Data& data, Type* buffer, const int& proc) const;
+      inline void operator()(const InterfaceMap& interface, Data& data, Type* buffer, const int& proc,
+                             std::size_t begin, std::size_t end) const;
     };
 
     /**
@@ -854,6 +1033,32 @@ namespace Dune
       size_t size_;
     };
 
+    /**
+     * @brief Information about a message communicated directly from or
+     * into the memory of the data.
+     */
+    struct DirectMessage
+    {
+      /** @brief Constructor. */
+      DirectMessage()
+        : used_(false), address_(0), count_(0), type_(MPI_BYTE)
+      {}
+
+      /** @brief True if the message is communicated directly. */
+      bool used_;
+      /** @brief The address of the message. */
+      void* address_;
+      /** @brief The number of elements of type type_ in the message. */
+      int count_;
+      /**
+       * @brief The MPI datatype of the message.
+       *
+       * Either MPI_BYTE for a single run of consecutive indices or a
+       * committed datatype addressing all runs relative to MPI_BOTTOM.
+       */
+      MPI_Datatype type_;
+    };
+
     /**
      * @brief Type of the map of information about the messages to send.
      *
@@ -889,6 +1094,104 @@ namespace Dune
 
     MPI_Comm communicator_;
 
+    /**
+     * @brief The minimum average length of the runs for direct communication.
+     */
+    std::size_t minDirectRunLength_;
+
+    /**
+     * @brief True if no local index is both sent and received.
+     */
+    bool disjoint_;
+
+    /**
+     * @brief True if no local index is sent to more than one process and
+     * true if no local index is received from more than one process.
+     *
+     * The first entry is for the indices we send in a forward communication,
+     * the second one for the indices we receive.
+     */
+    bool unique_[2];
+
+    /**
+     * @brief The number of threads for gathering and scattering.
+     */
+    std::size_t threads_;
+
+    enum {
+      /**
+       * @brief The number of entries of a message gathered or scattered by one thread at once.
+       */
+      chunkSize_ = 4096,
+      /**
+       * @brief The minimal number of entries gathered or scattered by several threads.
+       */
+      minThreadedEntries_ = 4*chunkSize_
+    };
+
+    /**
+     * @brief A chunk of a message to gather or scatter.
+     */
+    struct MessageChunk
+    {
+      MessageChunk(int proc, std::size_t start, std::size_t begin, std::size_t end)
+        : proc_(proc), start_(start), begin_(begin), end_(end)
+      {}
+      /** @brief The rank of the process we communicate with. */
+      int proc_;
+      /** @brief Start of the message in the buffer counted in number of values. */
+      std::size_t start_;
+      /** @brief The first entry of the interface in the chunk. */
+      std::size_t begin_;
+      /** @brief The entry of the interface after the last one in the chunk. */
+      std::size_t end_;
+    };
+
+    /**
+     * @brief Split the message to a process into chunks.
+     * @param proc The rank of the process.
+     * @param start The start of the message in the buffer.
+     * @param size The number of entries of the interface of the message.
+     * @param split Whether the message may be split at all.
+     * @param chunks The list to append the chunks to.
+     */
+    static void addChunks(int proc, std::size_t start, std::size_t size, bool split,
+                          std::vector<MessageChunk>& chunks);
+
+    /**
+     * @brief Process all chunks, concurrently if possible.
+     *
+     * Fewer than minThreadedEntries_ entries are processed by the calling
+     * thread alone. If f throws, the remaining chunks are skipped and the
+     * first exception is rethrown once all threads finished.
+     * @param chunks The chunks.
+     * @param threads The maximum number of threads to use.
+     * @param f The functor called with each chunk.
+     */
+    template<class F>
+    static void forEachChunk(const std::vector<MessageChunk>& chunks, std::size_t threads, const F& f);
+
+    /**
+     * @brief Get the number of threads we may use for the current exchange.
+     */
+    std::size_t activeThreads() const;
+
+    /**
+     * @brief Check whether the indices we send and receive are disjoint.
+     */
+    void checkDisjoint();
+
+    /**
+     * @brief Set up a message addressing the memory of the data directly.
+     * @param data The data that is sent or received.
+     * @param info The information about the interface of the message.
+     * @param message The message to set up.
+     * @return true if the message can be communicated without packing.
+     */
+    template<class Data>
+    bool setupDirectMessage(const Data& data, const InterfaceInformation& info,
+                            DirectMessage& message) const;
+
     /**
      * @brief Send and receive Data.
      */
@@ -925,6 +1228,51 @@ namespace Dune
     return v[index].getsize();
   }
 
+  template<class... Data>
+  inline const void* CommPolicy<MultiData<Data...> >::getAddress(const Type&, int)
+  {
+    return nullptr;
+  }
+
+  template<class... Data>
+  inline int CommPolicy<MultiData<Data...> >::getSize(const Type&, int)
+  {
+    return 1;
+  }
+
+  template<class... GatherScatter>
+  template<class... Data>
+  inline typename MultiData<Data...>::value_type
+  MultiGatherScatter<GatherScatter...>::gather(const MultiData<Data...>& data, std::size_t i)
+  {
+    static_assert(sizeof...(GatherScatter)==sizeof...(Data),
+                  "Need one GatherScatter per data structure");
+    return gather(data, i, std::index_sequence_for<Data...>());
+  }
+
+  template<class... GatherScatter>
+  template<class... Data, std::size_t... k>
+  inline typename MultiData<Data...>::value_type
+  MultiGatherScatter<GatherScatter...>::gather(const MultiData<Data...>& data, std::size_t i,
+                                               std::index_sequence<k...>)
+  {
+    return typename MultiData<Data...>::value_type(GatherScatter::gather(data.template get<k>(), i)...);
+  }
+
+  template<class... GatherScatter>
+  template<class... Data>
+  inline void MultiGatherScatter<GatherScatter...>::scatter(MultiData<Data...>& data,
+                                                            const typename MultiData<Data...>::value_type& v,
+                                                            std::size_t i)
+  {
+    static_assert(sizeof...(GatherScatter)==sizeof...(Data),
+                  "Need one GatherScatter per data structure");
+    Hybrid::forEach(std::index_sequence_for<Data...>(), [&](auto k) {
+        typedef typename std::tuple_element<decltype(k)::value, std::tuple<GatherScatter...> >::type Scatterer;
+        Scatterer::scatter(data.template get<decltype(k)::value>(), std::get<decltype(k)::value>(v), i);
+      });
+  }
+
   template<class T>
   inline const typename CopyGatherScatter<T>::IndexedType& CopyGatherScatter<T>::gather(const T & vec, std::size_t i)
   {
@@ -979,15 +1327,11 @@ namespace Dune
 
       const const_iterator end=messageTypes.end();
 
+      // The registry keeps the types for the next build and frees them
+      // with MPI.
       for(iterator process = messageTypes.begin(); process != end; ++process) {
-        MPI_Datatype *type = &(process->second.first);
-        int finalized=0;
-        MPI_Finalized(&finalized);
-        if(*type!=MPI_DATATYPE_NULL && !finalized)
-          MPI_Type_free(type);
-        type = &(process->second.second);
-        if(*type!=MPI_DATATYPE_NULL && !finalized)
-          MPI_Type_free(type);
+        MPIDatatypeRegistry::release(process->second.first);
+        MPIDatatypeRegistry::release(process->second.second);
       }
       messageTypes.clear();
       created_=false;
@@ -1017,11 +1361,10 @@ namespace Dune
         info.displ[i]-=base;
       }
 
-      // Create data type
+      // Get the data type, which is reused if the layout did not change
       MPI_Datatype* type = &( send ? messageTypes[process->first].first : messageTypes[process->first].second);
-      MPI_Type_create_hindexed(info.elements, info.length, info.displ,
-                               MPITraits<typename CommPolicy<V>::IndexedType>::getType(), type);
-      MPI_Type_commit(type);
+      *type = MPIDatatypeRegistry::hindexed(info.elements, info.length, info.displ,
+                                            MPITraits<typename CommPolicy<V>::IndexedType>::getType());
       // Deallocate memory
       info.free();
     }
@@ -1062,18 +1405,28 @@ namespace Dune
   template<typename T>
   void DatatypeCommunicator<T>::forward()
   {
-    sendRecv(requests_[1]);
+    sendRecv(requests_[1], true);
   }
 
   template<typename T>
   void DatatypeCommunicator<T>::backward()
   {
-    sendRecv(requests_[0]);
+    sendRecv(requests_[0], false);
   }
 
   template<typename T>
-  void DatatypeCommunicator<T>::sendRecv(MPI_Request* requests)
+  void DatatypeCommunicator<T>::sendRecv(MPI_Request* requests, bool forward)
   {
+    CommunicationProfiler::Scope profile(forward ? "DatatypeCommunicator::forward" :
+                                         "DatatypeCommunicator::backward", this);
+    if(profile.active())
+      for(const auto& types : messageTypes) {
+        int sendSize, recvSize;
+        MPI_Type_size(forward ? types.second.first : types.second.second, &sendSize);
+        MPI_Type_size(forward ? types.second.second : types.second.first, &recvSize);
+        profile.send(types.first, sendSize);
+        profile.receive(types.first, recvSize);
+      }
     int noMessages = messageTypes.size();
     // Start the receive calls first
     MPI_Startall(noMessages, requests);
@@ -1085,8 +1438,10 @@ namespace Dune
     for(int i=0; i<2*noMessages; i++)
       status[i].MPI_ERROR=MPI_SUCCESS;
 
+    const double waitStart = profile.beginWait();
     int send = MPI_Waitall(noMessages, requests+noMessages, status+noMessages);
     int receive = MPI_Waitall(noMessages, requests, status);
+    profile.endWait(waitStart);
 
     // Error checks
     int success=1, globalSuccess=0;
@@ -1136,7 +1491,10 @@ namespace Dune
   }
 
   inline BufferedCommunicator::BufferedCommunicator()
+    : minDirectRunLength_(16), disjoint_(false),
+      threads_(MPIHelper::communicationThreads())
   {
+    unique_[0]=unique_[1]=false;
     buffers_[0]=0;
     buffers_[1]=0;
     bufferSize_[0]=0;
@@ -1179,6 +1537,8 @@ namespace Dune
 
     buffers_[0] = new char[bufferSize_[0]];
     buffers_[1] = new char[bufferSize_[1]];
+
+    checkDisjoint();
   }
 
   template<class Data, class Interface>
@@ -1214,6 +1574,188 @@ namespace Dune
     // allocate the buffers
     buffers_[0] = new char[bufferSize_[0]];
     buffers_[1] = new char[bufferSize_[1]];
+
+    checkDisjoint();
+  }
+
+  inline void BufferedCommunicator::setMinDirectRunLength(std::size_t length)
+  {
+    minDirectRunLength_ = length;
+  }
+
+  inline void BufferedCommunicator::setThreads(std::size_t threads)
+  {
+    threads_ = threads;
+  }
+
+  inline std::size_t BufferedCommunicator::activeThreads() const
+  {
+    if(threads_<=1)
+      return 1;
+    int provided;
+    MPI_Query_thread(&provided);
+    return provided >= MPI_THREAD_FUNNELED ? threads_ : 1;
+  }
+
+  inline void BufferedCommunicator::addChunks(int proc, std::size_t start, std::size_t size,
+                                              bool split, std::vector<MessageChunk>& chunks)
+  {
+    if(!split) {
+      chunks.push_back(MessageChunk(proc, start, 0, size));
+      return;
+    }
+    for(std::size_t begin=0; begin < size; begin+=chunkSize_)
+      chunks.push_back(MessageChunk(proc, start, begin, std::min<std::size_t>(begin+chunkSize_, size)));
+  }
+
+  template<class F>
+  void BufferedCommunicator::forEachChunk(const std::vector<MessageChunk>& chunks, std::size_t threads,
+                                          const F& f)
+  {
+    std::size_t entries=0;
+    for(const MessageChunk& chunk : chunks)
+      entries += chunk.end_-chunk.begin_;
+    threads = std::min(threads, chunks.size());
+    if(threads<=1 || entries < minThreadedEntries_) {
+      for(const MessageChunk& chunk : chunks)
+        f(chunk);
+      return;
+    }
+
+    // The first exception stops all threads and is rethrown after joining
+    std::atomic<std::size_t> next(0);
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    auto work = [&]() {
+                  try{
+                    for(std::size_t c=next++; c < chunks.size(); c=next++)
+                      f(chunks[c]);
+                  }catch(...) {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if(!error)
+                      error = std::current_exception();
+                    next = chunks.size();
+                  }
+                };
+    std::vector<std::thread> workers;
+    try{
+      for(std::size_t i=1; i < threads; ++i)
+        workers.push_back(std::thread(work));
+    }catch(...) {
+      // Process the chunks with the threads started so far
+    }
+    work();
+    for(std::size_t i=0; i < workers.size(); ++i)
+      workers[i].join();
+    if(error)
+      std::rethrow_exception(error);
+  }
+
+  inline void BufferedCommunicator::checkDisjoint()
+  {
+    std::vector<std::size_t> sendIndices, recvIndices;
+    typedef InterfaceMap::const_iterator const_iterator;
+    const const_iterator end = interfaces_.end();
+
+    for(const_iterator interfacePair = interfaces_.begin();
+        interfacePair != end; ++interfacePair) {
+      for(std::size_t i=0; i < interfacePair->second.first.size(); ++i)
+        sendIndices.push_back(interfacePair->second.first[i]);
+      for(std::size_t i=0; i < interfacePair->second.second.size(); ++i)
+        recvIndices.push_back(interfacePair->second.second[i]);
+    }
+    std::sort(sendIndices.begin(), sendIndices.end());
+    std::sort(recvIndices.begin(), recvIndices.end());
+    unique_[0] = std::adjacent_find(sendIndices.begin(), sendIndices.end()) == sendIndices.end();
+    unique_[1] = std::adjacent_find(recvIndices.begin(), recvIndices.end()) == recvIndices.end();
+
+    std::vector<std::size_t>::const_iterator send = sendIndices.begin(),
+      recv = recvIndices.begin();
+    disjoint_ = true;
+    while(send != sendIndices.end() && recv != recvIndices.end())
+      if(*send < *recv)
+        ++send;
+      else if(*recv < *send)
+        ++recv;
+      else{
+        disjoint_ = false;
+        break;
+      }
+  }
+
+  template<class Data>
+  bool BufferedCommunicator::setupDirectMessage(const Data& data, const InterfaceInformation& info,
+                                                DirectMessage& message) const
+  {
+    typedef typename CommPolicy<Data>::IndexedType Type;
+    const std::vector<IndexRun>& runs = info.runs();
+
+    // Runs are only known if the interface detected them.
+    if(runs.empty() || (runs.size()>1 && info.size() < minDirectRunLength_*runs.size()))
+      return false;
+
+    std::vector<int> lengths(runs.size());
+    std::vector<MPI_Aint> displacements(runs.size());
+    bool consecutive = true;
+
+    for(std::size_t r=0; r < runs.size(); ++r) {
+      // The values of each run have to be equally spaced in memory, too.
+      const std::size_t stride = runs[r].size>1 ? runs[r].stride : 1;
+      const char* first = static_cast<const char*>(CommPolicy<Data>::getAddress(data, runs[r].start));
+      const char* last = static_cast<const char*>(CommPolicy<Data>::getAddress(data, runs[r].start+(runs[r].size-1)*stride));
+      if(last-first != static_cast<std::ptrdiff_t>((runs[r].size-1)*stride*sizeof(Type))
+         || runs[r].size*sizeof(Type) > static_cast<std::size_t>(std::numeric_limits<int>::max()))
+        return false;
+      lengths[r] = runs[r].size*sizeof(Type);
+      consecutive = consecutive && stride==1;
+      MPI_Get_address(const_cast<char*>(first), &displacements[r]);
+      if(runs.size()==1)
+        message.address_ = const_cast<char*>(first);
+    }
+
+    if(runs.size()==1 && consecutive) {
+      message.count_ = lengths[0];
+      message.type_ = MPI_BYTE;
+      message.used_ = true;
+      return true;
+    }
+
+    // The type is cached by the layout of the runs in memory, so that
+    // communicating the same data again reuses it.
+    MPIDatatypeRegistry::Key key{-1, static_cast<MPI_Aint>(sizeof(Type))};
+    key.reserve(2+3*runs.size());
+    for(std::size_t r=0; r < runs.size(); ++r) {
+      key.push_back(displacements[r]);
+      key.push_back(runs[r].size);
+      key.push_back(runs[r].size>1 ? runs[r].stride : 1);
+    }
+    message.type_ = MPIDatatypeRegistry::acquire(key, [&]
+    {
+      MPI_Datatype type;
+      if(consecutive)
+        MPI_Type_create_hindexed(runs.size(), lengths.data(), displacements.data(),
+                                 MPI_BYTE, &type);
+      else{
+        // One block of bytes per consecutive run and one vector of values per strided run
+        std::vector<MPI_Datatype> types(runs.size(), MPI_BYTE);
+        for(std::size_t r=0; r < runs.size(); ++r)
+          if(runs[r].size>1 && runs[r].stride!=1) {
+            MPI_Type_create_hvector(runs[r].size, sizeof(Type), runs[r].stride*sizeof(Type),
+                                    MPI_BYTE, &types[r]);
+            lengths[r] = 1;
+          }
+        MPI_Type_create_struct(runs.size(), lengths.data(), displacements.data(),
+                               types.data(), &type);
+        for(std::size_t r=0; r < runs.size(); ++r)
+          if(types[r] != MPI_BYTE)
+            MPI_Type_free(&types[r]);
+      }
+      return type;
+    });
+    message.address_ = MPI_BOTTOM;
+    message.count_ = 1;
+    message.used_ = true;
+    return true;
   }
 
   inline void BufferedCommunicator::free()
@@ -1262,72 +1804,48 @@ namespace Dune
 
 
   template<class Data, class GatherScatter, bool FORWARD>
-  inline void BufferedCommunicator::MessageGatherer<Data,GatherScatter,FORWARD,VariableSize>::operator()(const InterfaceMap& interfaces,const Data& data, Type* buffer, size_t bufferSize) const
+  inline void BufferedCommunicator::MessageGatherer<Data,GatherScatter,FORWARD,VariableSize>::operator()(const InterfaceMap& interfaces,const Data& data, Type* buffer, const int& proc,
+                                                                                                        std::size_t begin, std::size_t end) const
   {
-    DUNE_UNUSED_PARAMETER(bufferSize);
-    typedef typename InterfaceMap::const_iterator
-    const_iterator;
-
-    int rank;
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    const const_iterator end = interfaces.end();
-    size_t index=0;
+    typedef typename InterfaceMap::value_type::second_type::first_type Information;
+    const typename InterfaceMap::const_iterator infoPair = interfaces.find(proc);
 
-    for(const_iterator interfacePair = interfaces.begin();
-        interfacePair != end; ++interfacePair) {
-      int size = forward ? interfacePair->second.first.size() :
-                 interfacePair->second.second.size();
+    assert(infoPair!=interfaces.end());
 
-      for(int i=0; i < size; i++) {
-        int local = forward ? interfacePair->second.first[i] :
-                    interfacePair->second.second[i];
-        for(std::size_t j=0; j < CommPolicy<Data>::getSize(data, local); j++, index++) {
+    const Information& info = FORWARD ? infoPair->second.first :
+                              infoPair->second.second;
 
-#ifdef DUNE_ISTL_WITH_CHECKING
-          assert(bufferSize>=(index+1)*sizeof(typename CommPolicy<Data>::IndexedType));
-#endif
-          buffer[index]=GatherScatter::gather(data, local, j);
-        }
+    size_t index=0;
+    for(size_t i=0; i < begin; i++)
+      index += CommPolicy<Data>::getSize(data, info[i]);
 
-      }
+    for(size_t i=begin; i < end; i++) {
+      for(size_t j=0; j < CommPolicy<Data>::getSize(data, info[i]); j++)
+        buffer[index++]=GatherScatter::gather(data, info[i], j);
     }
-
   }
 
 
   template<class Data, class GatherScatter, bool FORWARD>
-  inline void BufferedCommunicator::MessageGatherer<Data,GatherScatter,FORWARD,SizeOne>::operator()(const InterfaceMap& interfaces, const Data& data, Type* buffer, size_t bufferSize) const
+  inline void BufferedCommunicator::MessageGatherer<Data,GatherScatter,FORWARD,SizeOne>::operator()(const InterfaceMap& interfaces, const Data& data, Type* buffer, const int& proc,
+                                                                                                   std::size_t begin, std::size_t end) const
   {
-    DUNE_UNUSED_PARAMETER(bufferSize);
-    typedef typename InterfaceMap::const_iterator
-    const_iterator;
-    const const_iterator end = interfaces.end();
-    size_t index = 0;
-
-    int rank;
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-
-    for(const_iterator interfacePair = interfaces.begin();
-        interfacePair != end; ++interfacePair) {
-      size_t size = FORWARD ? interfacePair->second.first.size() :
-                    interfacePair->second.second.size();
-
-      for(size_t i=0; i < size; i++) {
+    typedef typename InterfaceMap::value_type::second_type::first_type Information;
+    const typename InterfaceMap::const_iterator infoPair = interfaces.find(proc);
 
-#ifdef DUNE_ISTL_WITH_CHECKING
-        assert(bufferSize>=(index+1)*sizeof(typename CommPolicy<Data>::IndexedType));
-#endif
+    assert(infoPair!=interfaces.end());
 
-        buffer[index++] = GatherScatter::gather(data, FORWARD ? interfacePair->second.first[i] :
-                                                interfacePair->second.second[i]);
-      }
-    }
+    const Information& info = FORWARD ? infoPair->second.first :
+                              infoPair->second.second;
 
+    for(size_t i=begin; i < end; i++)
+      buffer[i] = GatherScatter::gather(data, info[i]);
   }
 
 
   template<class Data, class GatherScatter, bool FORWARD>
-  inline void BufferedCommunicator::MessageScatterer<Data,GatherScatter,FORWARD,VariableSize>::operator()(const InterfaceMap& interfaces, Data& data, Type* buffer, const int& proc) const
+  inline void BufferedCommunicator::MessageScatterer<Data,GatherScatter,FORWARD,VariableSize>::operator()(const InterfaceMap& interfaces, Data& data, Type* buffer, const int& proc,
+                                                                                                         std::size_t begin, std::size_t end) const
   {
     typedef typename InterfaceMap::value_type::second_type::first_type Information;
     const typename InterfaceMap::const_iterator infoPair = interfaces.find(proc);
@@ -1337,7 +1855,11 @@ namespace Dune
     const Information& info = FORWARD ? infoPair->second.second :
                               infoPair->second.first;
 
-    for(size_t i=0, index=0; i < info.size(); i++) {
+    size_t index=0;
+    for(size_t i=0; i < begin; i++)
+      index += CommPolicy<Data>::getSize(data, info[i]);
+
+    for(size_t i=begin; i < end; i++) {
       for(size_t j=0; j < CommPolicy<Data>::getSize(data, info[i]); j++)
         GatherScatter::scatter(data, buffer[index++], info[i], j);
     }
@@ -1345,7 +1867,8 @@ namespace Dune
 
 
   template<class Data, class GatherScatter, bool FORWARD>
-  inline void BufferedCommunicator::MessageScatterer<Data,GatherScatter,FORWARD,SizeOne>::operator()(const InterfaceMap& interfaces, Data& data, Type* buffer, const int& proc) const
+  inline void BufferedCommunicator::MessageScatterer<Data,GatherScatter,FORWARD,SizeOne>::operator()(const InterfaceMap& interfaces, Data& data, Type* buffer, const int& proc,
+                                                                                                    std::size_t begin, std::size_t end) const
   {
     typedef typename InterfaceMap::value_type::second_type::first_type Information;
     const typename InterfaceMap::const_iterator infoPair = interfaces.find(proc);
@@ -1355,7 +1878,7 @@ namespace Dune
     const Information& info = FORWARD ? infoPair->second.second :
                               infoPair->second.first;
 
-    for(size_t i=0; i < info.size(); i++) {
+    for(size_t i=begin; i < end; i++) {
       GatherScatter::scatter(data, buffer[i], info[i]);
     }
   }
@@ -1392,39 +1915,60 @@ namespace Dune
   template<class GatherScatter, bool FORWARD, class Data>
   void BufferedCommunicator::sendRecv(const Data& source, Data& dest)
   {
-    int rank, lrank;
+    CommunicationProfiler::Scope profile(FORWARD ? "BufferedCommunicator::forward" :
+                                         "BufferedCommunicator::backward", this);
+    int rank;
 
     MPI_Comm_rank(MPI_COMM_WORLD,&rank);
-    MPI_Comm_rank(MPI_COMM_WORLD,&lrank);
 
     typedef typename CommPolicy<Data>::IndexedType Type;
     Type *sendBuffer, *recvBuffer;
-    size_t sendBufferSize;
 #ifndef NDEBUG
+    size_t sendBufferSize;
     size_t recvBufferSize;
 #endif
 
     if(FORWARD) {
       sendBuffer = reinterpret_cast<Type*>(buffers_[0]);
-      sendBufferSize = bufferSize_[0];
       recvBuffer = reinterpret_cast<Type*>(buffers_[1]);
 #ifndef NDEBUG
+      sendBufferSize = bufferSize_[0];
       recvBufferSize = bufferSize_[1];
 #endif
     }else{
       sendBuffer = reinterpret_cast<Type*>(buffers_[1]);
-      sendBufferSize = bufferSize_[1];
       recvBuffer = reinterpret_cast<Type*>(buffers_[0]);
 #ifndef NDEBUG
+      sendBufferSize = bufferSize_[1];
       recvBufferSize = bufferSize_[0];
 #endif
     }
     typedef typename CommPolicy<Data>::IndexedTypeFlag Flag;
 
-    MessageGatherer<Data,GatherScatter,FORWARD,Flag>() (interfaces_, source, sendBuffer, sendBufferSize);
+    // Plain copies may be communicated from and into the data directly,
+    // unless received values could overwrite values still being sent.
+    const bool direct = minDirectRunLength_ > 0
+                        && std::is_same<Flag,SizeOne>::value
+                        && IsCopyGatherScatter<GatherScatter,Data>::value
+                        && (disjoint_ || static_cast<const void*>(&source) != static_cast<const void*>(&dest));
+
+    std::vector<MPI_Request> sendRequests(messageInformation_.size(), MPI_REQUEST_NULL);
+    std::vector<MPI_Request> recvRequests(messageInformation_.size(), MPI_REQUEST_NULL);
+    std::vector<DirectMessage> directSends(messageInformation_.size());
+    std::vector<DirectMessage> directRecvs(messageInformation_.size());
+
+    // Give the datatypes of the direct messages back to the registry in any case
+    struct ReleaseTypes
+    {
+      ~ReleaseTypes()
+      {
+        for(const DirectMessage& message : messages)
+          if(message.type_ != MPI_BYTE)
+            MPIDatatypeRegistry::release(message.type_);
+      }
+      const std::vector<DirectMessage>& messages;
+    } releaseSends{directSends}, releaseRecvs{directRecvs};
 
-    MPI_Request* sendRequests = new MPI_Request[messageInformation_.size()];
-    MPI_Request* recvRequests = new MPI_Request[messageInformation_.size()];
     /* Number of recvRequests that are not MPI_REQUEST_NULL */
     size_t numberOfRealRecvRequests = 0;
 
@@ -1433,62 +1977,84 @@ namespace Dune
 
     const const_iterator end = messageInformation_.end();
     size_t i=0;
-    int* processMap = new int[messageInformation_.size()];
+    std::vector<int> processMap(messageInformation_.size());
 
     for(const_iterator info = messageInformation_.begin(); info != end; ++info, ++i) {
       processMap[i]=info->first;
-      if(FORWARD) {
-        assert(info->second.second.start_*sizeof(typename CommPolicy<Data>::IndexedType)+info->second.second.size_ <= recvBufferSize );
-        Dune::dvverb<<rank<<": receiving "<<info->second.second.size_<<" from "<<info->first<<std::endl;
-        if(info->second.second.size_) {
-          MPI_Irecv(recvBuffer+info->second.second.start_, info->second.second.size_,
-                    MPI_BYTE, info->first, commTag_, communicator_,
-                    recvRequests+i);
-          numberOfRealRecvRequests += 1;
-        } else {
-          // Nothing to receive -> set request to inactive
-          recvRequests[i]=MPI_REQUEST_NULL;
-        }
-      }else{
-        assert(info->second.first.start_*sizeof(typename CommPolicy<Data>::IndexedType)+info->second.first.size_ <= recvBufferSize );
-        Dune::dvverb<<rank<<": receiving "<<info->second.first.size_<<" to "<<info->first<<std::endl;
-        if(info->second.first.size_) {
-          MPI_Irecv(recvBuffer+info->second.first.start_, info->second.first.size_,
+      const MessageInformation& recvInfo = FORWARD ? info->second.second : info->second.first;
+      assert(recvInfo.start_*sizeof(Type)+recvInfo.size_ <= recvBufferSize );
+      Dune::dvverb<<rank<<": receiving "<<recvInfo.size_<<" from "<<info->first<<std::endl;
+      if(recvInfo.size_) {
+        const typename InterfaceMap::const_iterator interfacePair = interfaces_.find(info->first);
+        assert(interfacePair != interfaces_.end());
+        if(direct && setupDirectMessage(dest, FORWARD ? interfacePair->second.second :
+                                        interfacePair->second.first, directRecvs[i]))
+          MPI_Irecv(directRecvs[i].address_, directRecvs[i].count_, directRecvs[i].type_,
+                    info->first, commTag_, communicator_, &recvRequests[i]);
+        else
+          MPI_Irecv(recvBuffer+recvInfo.start_, recvInfo.size_,
                     MPI_BYTE, info->first, commTag_, communicator_,
-                    recvRequests+i);
-          numberOfRealRecvRequests += 1;
-        } else {
-          // Nothing to receive -> set request to inactive
-          recvRequests[i]=MPI_REQUEST_NULL;
-        }
+                    &recvRequests[i]);
+        profile.receive(info->first, recvInfo.size_);
+        numberOfRealRecvRequests += 1;
+      } else {
+        // Nothing to receive -> set request to inactive
+        recvRequests[i]=MPI_REQUEST_NULL;
       }
     }
 
-    // now the send requests
+    // Gather the messages we cannot send directly, concurrently if possible.
+    // Variable sized messages are not split as their offsets are unknown.
+    const std::size_t threads = activeThreads();
+    const bool split = std::is_same<Flag,SizeOne>::value;
+    std::vector<MessageChunk> chunks;
+
     i=0;
-    for(const_iterator info = messageInformation_.begin(); info != end; ++info, ++i)
-      if(FORWARD) {
-        assert(info->second.second.start_*sizeof(typename CommPolicy<Data>::IndexedType)+info->second.second.size_ <= recvBufferSize );
-        Dune::dvverb<<rank<<": sending "<<info->second.first.size_<<" to "<<info->first<<std::endl;
-        assert(info->second.first.start_*sizeof(typename CommPolicy<Data>::IndexedType)+info->second.first.size_ <= sendBufferSize );
-        if(info->second.first.size_)
-          MPI_Issend(sendBuffer+info->second.first.start_, info->second.first.size_,
-                     MPI_BYTE, info->first, commTag_, communicator_,
-                     sendRequests+i);
+    for(const_iterator info = messageInformation_.begin(); info != end; ++info, ++i) {
+      const MessageInformation& sendInfo = FORWARD ? info->second.first : info->second.second;
+      assert(sendInfo.start_*sizeof(Type)+sendInfo.size_ <= sendBufferSize );
+      if(sendInfo.size_) {
+        const typename InterfaceMap::const_iterator interfacePair = interfaces_.find(info->first);
+        assert(interfacePair != interfaces_.end());
+        const InterfaceInformation& interface = FORWARD ? interfacePair->second.first :
+                                                interfacePair->second.second;
+        if(!(direct && setupDirectMessage(source, interface, directSends[i])))
+          addChunks(info->first, sendInfo.start_, interface.size(), split, chunks);
+      }
+    }
+
+    // If gathering or scattering throws, the exchange is completed anyway
+    // before the exception is rethrown. Otherwise the pending messages
+    // would be matched by the next exchange and the other processes would
+    // wait for our messages forever.
+    std::exception_ptr error;
+    try{
+      forEachChunk(chunks, threads, [&](const MessageChunk& chunk) {
+                     MessageGatherer<Data,GatherScatter,FORWARD,Flag>() (interfaces_, source, sendBuffer+chunk.start_,
+                                                                         chunk.proc_, chunk.begin_, chunk.end_);
+                   });
+    }catch(...) {
+      error = std::current_exception();
+    }
+
+    // now send the messages
+    i=0;
+    for(const_iterator info = messageInformation_.begin(); info != end; ++info, ++i) {
+      const MessageInformation& sendInfo = FORWARD ? info->second.first : info->second.second;
+      Dune::dvverb<<rank<<": sending "<<sendInfo.size_<<" to "<<info->first<<std::endl;
+      if(sendInfo.size_) {
+        if(directSends[i].used_)
+          MPI_Issend(directSends[i].address_, directSends[i].count_, directSends[i].type_,
+                     info->first, commTag_, communicator_, &sendRequests[i]);
         else
-          // Nothing to send -> set request to inactive
-          sendRequests[i]=MPI_REQUEST_NULL;
-      }else{
-        assert(info->second.second.start_*sizeof(typename CommPolicy<Data>::IndexedType)+info->second.second.size_ <= sendBufferSize );
-        Dune::dvverb<<rank<<": sending "<<info->second.second.size_<<" to "<<info->first<<std::endl;
-        if(info->second.second.size_)
-          MPI_Issend(sendBuffer+info->second.second.start_, info->second.second.size_,
+          MPI_Issend(sendBuffer+sendInfo.start_, sendInfo.size_,
                      MPI_BYTE, info->first, commTag_, communicator_,
-                     sendRequests+i);
-        else
-          // Nothing to send -> set request to inactive
-          sendRequests[i]=MPI_REQUEST_NULL;
-      }
+                     &sendRequests[i]);
+        profile.send(info->first, sendInfo.size_);
+      }else
+        // Nothing to send -> set request to inactive
+        sendRequests[i]=MPI_REQUEST_NULL;
+    }
 
     // Wait for completion of receive and immediately start scatter
     i=0;
@@ -1497,20 +2063,68 @@ namespace Dune
     MPI_Status status; //[messageInformation_.size()];
     //MPI_Waitall(messageInformation_.size(), recvRequests, status);
 
+    if(threads > 1 && unique_[FORWARD ? 1 : 0]) {
+      // Wait for all messages and scatter them concurrently
+      std::vector<MPI_Status> statuses(messageInformation_.size());
+      for(i=0; i< messageInformation_.size(); i++)
+        statuses[i].MPI_ERROR=MPI_SUCCESS;
+      const double waitStart = profile.beginWait();
+      MPI_Waitall(recvRequests.size(), recvRequests.data(), statuses.data());
+      profile.endWait(waitStart);
+
+      chunks.clear();
+      for(i=0; i< messageInformation_.size(); i++) {
+        if(statuses[i].MPI_ERROR!=MPI_SUCCESS) {
+          std::cerr<<rank<<": MPI_Error occurred while receiving message from "<<processMap[i]<<std::endl;
+          continue;
+        }
+        const typename InformationMap::const_iterator infoIter = messageInformation_.find(processMap[i]);
+        const MessageInformation& info = FORWARD ? infoIter->second.second : infoIter->second.first;
+        if(info.size_ && !directRecvs[i].used_) {
+          const typename InterfaceMap::const_iterator interfacePair = interfaces_.find(processMap[i]);
+          addChunks(processMap[i], info.start_, FORWARD ? interfacePair->second.second.size() :
+                    interfacePair->second.first.size(), split, chunks);
+        }
+      }
+
+      if(!error)
+        try{
+          forEachChunk(chunks, threads, [&](const MessageChunk& chunk) {
+                         MessageScatterer<Data,GatherScatter,FORWARD,Flag>() (interfaces_, dest, recvBuffer+chunk.start_,
+                                                                              chunk.proc_, chunk.begin_, chunk.end_);
+                       });
+        }catch(...) {
+          error = std::current_exception();
+        }
+      numberOfRealRecvRequests = 0;
+    }
+
     for(i=0; i< numberOfRealRecvRequests; i++) {
       status.MPI_ERROR=MPI_SUCCESS;
-      MPI_Waitany(messageInformation_.size(), recvRequests, &finished, &status);
+      const double waitStart = profile.beginWait();
+      MPI_Waitany(recvRequests.size(), recvRequests.data(), &finished, &status);
+      profile.endWait(waitStart);
       assert(finished != MPI_UNDEFINED);
 
       if(status.MPI_ERROR==MPI_SUCCESS) {
         int& proc = processMap[finished];
+        // Direct messages already arrived at their destination.
+        if(directRecvs[finished].used_ || error)
+          continue;
         typename InformationMap::const_iterator infoIter = messageInformation_.find(proc);
         assert(infoIter != messageInformation_.end());
 
         MessageInformation info = (FORWARD) ? infoIter->second.second : infoIter->second.first;
         assert(info.start_+info.size_ <= recvBufferSize);
 
-        MessageScatterer<Data,GatherScatter,FORWARD,Flag>() (interfaces_, dest, recvBuffer+info.start_, proc);
+        const typename InterfaceMap::const_iterator interfacePair = interfaces_.find(proc);
+        try{
+          MessageScatterer<Data,GatherScatter,FORWARD,Flag>() (interfaces_, dest, recvBuffer+info.start_, proc, 0,
+                                                               FORWARD ? interfacePair->second.second.size() :
+                                                               interfacePair->second.first.size());
+        }catch(...) {
+          error = std::current_exception();
+        }
       }else{
         std::cerr<<rank<<": MPI_Error occurred while receiving message from "<<processMap[finished]<<std::endl;
         //success=0;
@@ -1520,11 +2134,13 @@ namespace Dune
     MPI_Status recvStatus;
 
     // Wait for completion of sends
+    const double waitStart = profile.beginWait();
     for(i=0; i< messageInformation_.size(); i++)
-      if(MPI_SUCCESS!=MPI_Wait(sendRequests+i, &recvStatus)) {
-        std::cerr<<rank<<": MPI_Error occurred while sending message to "<<processMap[finished]<<std::endl;
+      if(MPI_SUCCESS!=MPI_Wait(&sendRequests[i], &recvStatus)) {
+        std::cerr<<rank<<": MPI_Error occurred while sending message to "<<processMap[i]<<std::endl;
         //success=0;
       }
+    profile.endWait(waitStart);
     /*
        int globalSuccess;
        MPI_Allreduce(&success, &globalSuccess, 1, MPI_INT, MPI_MIN, interface_->communicator());
@@ -1532,10 +2148,9 @@ namespace Dune
        if(!globalSuccess)
        DUNE_THROW(CommunicationError, "A communication error occurred!");
      */
-    delete[] processMap;
-    delete[] sendRequests;
-    delete[] recvRequests;
 
+    if(error)
+      std::rethrow_exception(error);
   }
 
 #endif  // DOXYGEN
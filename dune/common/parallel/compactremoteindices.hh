@@ -0,0 +1,508 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifndef DUNE_COMMON_PARALLEL_COMPACTREMOTEINDICES_HH
+#define DUNE_COMMON_PARALLEL_COMPACTREMOTEINDICES_HH
+
+#if HAVE_MPI
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <mpi.h>
+
+#include <dune/common/exceptions.hh>
+#include <dune/common/parallel/remoteindices.hh>
+
+namespace Dune {
+  /** @addtogroup Common_Parallel
+   *
+   * @{
+   */
+  /**
+   * @file
+   * @brief A compact copy of the remote indices stored in contiguous arrays.
+   */
+
+  template<class T, class I>
+  class CompactRemoteIndexList;
+
+  /**
+   * @brief A remote index stored in a CompactRemoteIndexList.
+   *
+   * Provides the interface of RemoteIndex and the local attribute and
+   * index without going through the local index pair.
+   */
+  template<class T, class I>
+  class CompactRemoteIndex
+  {
+  public:
+    typedef typename T::GlobalIndex GlobalIndex;
+    typedef typename T::LocalIndex::Attribute Attribute;
+    typedef typename T::IndexPair PairType;
+
+    CompactRemoteIndex(const CompactRemoteIndexList<T,I>* list, std::size_t i)
+      : list_(list), i_(i)
+    {}
+
+    /** @brief Get the attribute of the index on the remote process. */
+    Attribute attribute() const
+    {
+      return Attribute(list_->remoteAttribute_[i_]);
+    }
+
+    /** @brief Get the attribute of the index on this process. */
+    Attribute localAttribute() const
+    {
+      return Attribute(list_->localAttribute_[i_]);
+    }
+
+    /** @brief Get the local index on this process. */
+    std::size_t localIndex() const
+    {
+      return list_->local_[i_];
+    }
+
+    /**
+     * @brief Get the corresponding local index pair.
+     *
+     * It is looked up by its position in the index set.
+     */
+    const PairType& localIndexPair() const
+    {
+      return list_->indexSet_->begin()[list_->position_[i_]];
+    }
+
+  private:
+    const CompactRemoteIndexList<T,I>* list_;
+    std::size_t i_;
+  };
+
+  /**
+   * @brief Iterator over a CompactRemoteIndexList.
+   *
+   * Dereferencing yields a CompactRemoteIndex by value.
+   */
+  template<class T, class I>
+  class CompactRemoteIndexIterator
+  {
+    struct Pointer
+    {
+      const CompactRemoteIndex<T,I>* operator->() const
+      {
+        return &index;
+      }
+
+      CompactRemoteIndex<T,I> index;
+    };
+
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef CompactRemoteIndex<T,I> value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef Pointer pointer;
+    typedef CompactRemoteIndex<T,I> reference;
+
+    CompactRemoteIndexIterator()
+      : list_(nullptr), i_(0)
+    {}
+
+    CompactRemoteIndexIterator(const CompactRemoteIndexList<T,I>* list, std::size_t i)
+      : list_(list), i_(i)
+    {}
+
+    reference operator*() const
+    {
+      return reference(list_, i_);
+    }
+
+    pointer operator->() const
+    {
+      return Pointer{reference(list_, i_)};
+    }
+
+    CompactRemoteIndexIterator& operator++()
+    {
+      ++i_;
+      return *this;
+    }
+
+    CompactRemoteIndexIterator operator++(int)
+    {
+      CompactRemoteIndexIterator tmp(*this);
+      ++i_;
+      return tmp;
+    }
+
+    bool operator==(const CompactRemoteIndexIterator& other) const
+    {
+      return i_ == other.i_ && list_ == other.list_;
+    }
+
+    bool operator!=(const CompactRemoteIndexIterator& other) const
+    {
+      return !(*this == other);
+    }
+
+    //! @brief The remote index the iterator points to.
+    CompactRemoteIndex<T,I> index() const
+    {
+      return reference(list_, i_);
+    }
+
+  private:
+    const CompactRemoteIndexList<T,I>* list_;
+    std::size_t i_;
+  };
+
+  namespace Impl
+  {
+    template<class T, class I>
+    struct RemoteIndexAccess<CompactRemoteIndexIterator<T,I> >
+    {
+      typedef CompactRemoteIndexIterator<T,I> Iterator;
+
+      static typename T::LocalIndex::Attribute localAttribute(const Iterator& remote)
+      {
+        return remote.index().localAttribute();
+      }
+
+      static std::size_t localIndex(const Iterator& remote)
+      {
+        return remote.index().localIndex();
+      }
+    };
+  }
+
+  /**
+   * @brief A read only list of the indices shared with one process.
+   *
+   * It is a view of a range of the arrays of CompactRemoteIndices and
+   * can be iterated like RemoteIndices::RemoteIndexList.
+   */
+  template<class T, class I>
+  class CompactRemoteIndexList
+  {
+    friend class CompactRemoteIndex<T,I>;
+    template<class, class> friend class CompactRemoteIndices;
+
+  public:
+    typedef typename T::LocalIndex::Attribute Attribute;
+    typedef CompactRemoteIndexIterator<T,I> const_iterator;
+    typedef const_iterator iterator;
+
+    CompactRemoteIndexList()
+      : indexSet_(nullptr), local_(nullptr), position_(nullptr),
+        localAttribute_(nullptr), remoteAttribute_(nullptr), size_(0)
+    {}
+
+    const_iterator begin() const
+    {
+      return const_iterator(this, 0);
+    }
+
+    const_iterator end() const
+    {
+      return const_iterator(this, size_);
+    }
+
+    /** @brief The number of remote indices in the list. */
+    std::size_t size() const
+    {
+      return size_;
+    }
+
+    bool empty() const
+    {
+      return size_ == 0;
+    }
+
+  private:
+    const T* indexSet_;
+    const I* local_;
+    const I* position_;
+    const char* localAttribute_;
+    const char* remoteAttribute_;
+    std::size_t size_;
+  };
+
+  /**
+   * @brief A compact copy of RemoteIndices.
+   *
+   * RemoteIndices keeps the indices shared with each process in singly
+   * linked lists of pointers to the local index pairs. This class copies
+   * all lists into a few arrays instead, one per field, with the lists
+   * of all processes stored one after another (compressed sparse rows).
+   * Each remote index takes two integers of type I and two chars,
+   * and building an interface from it reads the arrays sequentially.
+   * Lists for sending and receiving that are shared by RemoteIndices
+   * are stored once.
+   *
+   * It provides the read only part of the interface of RemoteIndices,
+   * so it can replace it in Interface::build:
+   * \code
+   * CompactRemoteIndices<ParallelIndexSet> compact(remoteIndices);
+   * Interface interface;
+   * interface.build(compact, sourceFlags, destFlags);
+   * \endcode
+   *
+   * The copy does not change with the remote indices. Like them it
+   * becomes invalid when the index sets are resized, see isSynced().
+   *
+   * @tparam T The type of the underlying index set.
+   * @tparam I The unsigned integer type storing the local indices and the
+   * positions in the index set.
+   */
+  template<class T, class I=std::uint32_t>
+  class CompactRemoteIndices
+  {
+  public:
+    /** @brief Type of the index set we use, e.g. ParallelLocalIndexSet. */
+    typedef T ParallelIndexSet;
+
+    /** @brief The type of the global index. */
+    typedef typename ParallelIndexSet::GlobalIndex GlobalIndex;
+
+    /** @brief The type of the local index. */
+    typedef typename ParallelIndexSet::LocalIndex LocalIndex;
+
+    /** @brief The type of the attribute. */
+    typedef typename LocalIndex::Attribute Attribute;
+
+    /** @brief The type of the remote index list. */
+    typedef CompactRemoteIndexList<T,I> RemoteIndexList;
+
+    /** @brief The type of the remote indices in the lists. */
+    typedef CompactRemoteIndex<T,I> RemoteIndex;
+
+    /**
+     * @brief The type of the map from rank to the remote index lists for
+     * sending and receiving, sorted by rank.
+     */
+    typedef std::vector<std::pair<int, std::pair<const RemoteIndexList*,const RemoteIndexList*> > >
+    RemoteIndexMap;
+
+    typedef typename RemoteIndexMap::const_iterator const_iterator;
+
+    /** @brief Construct an empty copy. */
+    CompactRemoteIndices()
+      : source_(nullptr), target_(nullptr), comm_(MPI_COMM_NULL),
+        sourceSeqNo_(-1), destSeqNo_(-1), size_(0)
+    {}
+
+    /**
+     * @brief Copy remote indices.
+     * @param remoteIndices The remote indices to copy, they have to be
+     * synced with the index sets.
+     * @throw RangeError if a local index or the size of an index set does
+     * not fit into I.
+     */
+    template<class A>
+    explicit CompactRemoteIndices(const RemoteIndices<T,A>& remoteIndices);
+
+    CompactRemoteIndices(const CompactRemoteIndices&) = delete;
+
+    CompactRemoteIndices(CompactRemoteIndices&&) = default;
+
+    CompactRemoteIndices& operator=(const CompactRemoteIndices&) = delete;
+
+    CompactRemoteIndices& operator=(CompactRemoteIndices&&) = default;
+
+    /**
+     * @brief Checks whether the copied remote indices were synced with
+     * the index sets and the index sets did not change since.
+     */
+    bool isSynced() const
+    {
+      return source_ && sourceSeqNo_ == source_->seqNo() && destSeqNo_ == target_->seqNo();
+    }
+
+    /** @brief Get the mpi communicator used. */
+    MPI_Comm communicator() const
+    {
+      return comm_;
+    }
+
+    /**
+     * @brief Find an iterator over the remote index lists of a specific process.
+     * @return The iterator positioned at the process, or the end iterator
+     * if there is no list for it.
+     */
+    const_iterator find(int proc) const
+    {
+      const_iterator found = std::lower_bound(map_.begin(), map_.end(), proc,
+                                              [](const typename RemoteIndexMap::value_type& entry, int p) {
+                                                return entry.first < p;
+                                              });
+      return found != map_.end() && found->first == proc ? found : map_.end();
+    }
+
+    /** @brief Get an iterator over all remote index lists. */
+    const_iterator begin() const
+    {
+      return map_.begin();
+    }
+
+    /** @brief Get the end iterator over all remote index lists. */
+    const_iterator end() const
+    {
+      return map_.end();
+    }
+
+    /** @brief Get the number of processors we share indices with. */
+    int neighbours() const
+    {
+      return map_.size();
+    }
+
+    /** @brief Get the number of stored remote indices. */
+    std::size_t size() const
+    {
+      return size_;
+    }
+
+    /** @brief Get the number of bytes allocated for the copy. */
+    std::size_t memory() const
+    {
+      return (local_.capacity() + position_.capacity()) * sizeof(I)
+             + localAttribute_.capacity() + remoteAttribute_.capacity()
+             + lists_.capacity() * sizeof(RemoteIndexList)
+             + map_.capacity() * sizeof(typename RemoteIndexMap::value_type);
+    }
+
+    /** @brief Get the index set at the source. */
+    const ParallelIndexSet& sourceIndexSet() const
+    {
+      return *source_;
+    }
+
+    /** @brief Get the index set at destination. */
+    const ParallelIndexSet& destinationIndexSet() const
+    {
+      return *target_;
+    }
+
+  private:
+    template<class L>
+    void append(const L& list, const ParallelIndexSet& indexSet);
+
+    const ParallelIndexSet* source_;
+    const ParallelIndexSet* target_;
+    MPI_Comm comm_;
+    int sourceSeqNo_;
+    int destSeqNo_;
+    std::size_t size_;
+
+    /** @brief The local indices of all lists. */
+    std::vector<I> local_;
+    /** @brief The positions of the local index pairs in the index set. */
+    std::vector<I> position_;
+    /** @brief The attributes of the indices on this process, stored as char like in RemoteIndex. */
+    std::vector<char> localAttribute_;
+    /** @brief The attributes of the indices on the remote processes. */
+    std::vector<char> remoteAttribute_;
+    std::vector<RemoteIndexList> lists_;
+    RemoteIndexMap map_;
+  };
+
+  /** @} */
+
+#ifndef DOXYGEN
+
+  template<class T, class I>
+  template<class A>
+  CompactRemoteIndices<T,I>::CompactRemoteIndices(const RemoteIndices<T,A>& remoteIndices)
+    : source_(&remoteIndices.sourceIndexSet()), target_(&remoteIndices.destinationIndexSet()),
+      comm_(remoteIndices.communicator()), sourceSeqNo_(-1), destSeqNo_(-1), size_(0)
+  {
+    // Otherwise the pointers to the local index pairs might be dangling
+    if(!remoteIndices.isSynced())
+      DUNE_THROW(InvalidStateException, "RemoteIndices is not in sync with the index set. Call RemoteIndices::rebuild first!");
+    sourceSeqNo_ = source_->seqNo();
+    destSeqNo_ = target_->seqNo();
+    if(std::max(source_->size(), target_->size()) > std::numeric_limits<I>::max())
+      DUNE_THROW(RangeError, "The index set is too large for the position type");
+
+    // Reserve all memory in advance, the lists point into the arrays
+    std::size_t lists = 0;
+    typedef typename RemoteIndices<T,A>::const_iterator MapIterator;
+    for(MapIterator process = remoteIndices.begin(); process != remoteIndices.end(); ++process) {
+      size_ += process->second.first->size();
+      ++lists;
+      if(process->second.second != process->second.first) {
+        size_ += process->second.second->size();
+        ++lists;
+      }
+    }
+    local_.reserve(size_);
+    position_.reserve(size_);
+    localAttribute_.reserve(size_);
+    remoteAttribute_.reserve(size_);
+    lists_.reserve(lists);
+    map_.reserve(remoteIndices.neighbours());
+
+    for(MapIterator process = remoteIndices.begin(); process != remoteIndices.end(); ++process) {
+      append(*process->second.first, *source_);
+      const RemoteIndexList* send = &lists_.back();
+      const RemoteIndexList* receive = send;
+      if(process->second.second != process->second.first) {
+        append(*process->second.second, *target_);
+        receive = &lists_.back();
+      }
+      map_.push_back(std::make_pair(process->first, std::make_pair(send, receive)));
+    }
+  }
+
+  template<class T, class I>
+  template<class L>
+  void CompactRemoteIndices<T,I>::append(const L& list, const ParallelIndexSet& indexSet)
+  {
+    typedef typename ParallelIndexSet::const_iterator IndexIterator;
+    const IndexIterator begin = indexSet.begin();
+    const IndexIterator end = indexSet.end();
+
+    RemoteIndexList compact;
+    compact.indexSet_ = &indexSet;
+    compact.local_ = local_.data() + local_.size();
+    compact.position_ = position_.data() + position_.size();
+    compact.localAttribute_ = localAttribute_.data() + localAttribute_.size();
+    compact.remoteAttribute_ = remoteAttribute_.data() + remoteAttribute_.size();
+    compact.size_ = list.size();
+
+    // The lists are sorted by the global index like the index set
+    IndexIterator pair = begin;
+    for(const auto& remote : list) {
+      const auto& localPair = remote.localIndexPair();
+      pair = std::lower_bound(pair, end, localPair.global(),
+                              [](const typename ParallelIndexSet::IndexPair& p, const GlobalIndex& global) {
+                                return p.global() < global;
+                              });
+      while(pair != end && &*pair != &localPair)
+        ++pair;
+      if(pair == end)
+        // not sorted, fall back to a linear search
+        for(pair = begin; pair != end && &*pair != &localPair; ++pair) ;
+      if(pair == end)
+        DUNE_THROW(InvalidStateException, "A remote index does not refer to the index set");
+
+      if(localPair.local().local() > std::numeric_limits<I>::max())
+        DUNE_THROW(RangeError, "The local index "<<localPair.local().local()
+                   <<" is too large for the index type");
+      local_.push_back(localPair.local().local());
+      position_.push_back(pair - begin);
+      localAttribute_.push_back(char(localPair.local().attribute()));
+      remoteAttribute_.push_back(char(remote.attribute()));
+    }
+    lists_.push_back(compact);
+  }
+
+#endif // DOXYGEN
+}
+
+#endif // HAVE_MPI
+
+#endif
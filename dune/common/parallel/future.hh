@@ -0,0 +1,118 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifndef DUNE_COMMON_PARALLEL_FUTURE_HH
+#define DUNE_COMMON_PARALLEL_FUTURE_HH
+
+/*!
+   \file
+   \brief Futures returned by the nonblocking collective communication
+   methods of the sequential CollectiveCommunication.
+
+   \ingroup ParallelCommunication
+ */
+
+#include <utility>
+
+#include <dune/common/exceptions.hh>
+
+namespace Dune
+{
+
+  /*! @brief A future holding a result that is available immediately.
+
+     The nonblocking methods of the sequential CollectiveCommunication
+     return it. It has the same interface as MPIFuture, which allows for
+     writing code that overlaps communication with computation for both
+     sequential and parallel runs:
+     \code
+     auto norm = comm.template iallreduce<std::plus<double> >(localNorm);
+     // do some work
+     double globalNorm = norm.get();
+     \endcode
+
+     \tparam T The type of the result.
+     \ingroup ParallelCommunication
+   */
+  template<class T>
+  class PseudoFuture
+  {
+  public:
+    //! Construct an invalid future
+    PseudoFuture()
+      : valid_(false)
+    {}
+
+    //! Construct a future holding a result
+    explicit PseudoFuture(T result)
+      : result_(std::move(result)), valid_(true)
+    {}
+
+    //! Whether the future holds a result that was not retrieved yet
+    bool valid() const
+    {
+      return valid_;
+    }
+
+    //! Whether the operation completed, always true
+    bool ready() const
+    {
+      return true;
+    }
+
+    //! Wait for the completion of the operation, returns immediately
+    void wait()
+    {}
+
+    //! Retrieve the result, the future becomes invalid
+    T get()
+    {
+      if(!valid_)
+        DUNE_THROW(InvalidStateException, "The future holds no result");
+      valid_ = false;
+      return std::move(result_);
+    }
+
+  private:
+    T result_;
+    bool valid_;
+  };
+
+  //! A future for operations without a result that is available immediately
+  template<>
+  class PseudoFuture<void>
+  {
+  public:
+    //! Construct a valid future
+    PseudoFuture()
+      : valid_(true)
+    {}
+
+    //! @copydoc PseudoFuture::valid
+    bool valid() const
+    {
+      return valid_;
+    }
+
+    //! @copydoc PseudoFuture::ready
+    bool ready() const
+    {
+      return true;
+    }
+
+    //! @copydoc PseudoFuture::wait
+    void wait()
+    {}
+
+    //! Complete the operation, the future becomes invalid
+    void get()
+    {
+      valid_ = false;
+    }
+
+  private:
+    bool valid_;
+  };
+
+}
+
+#endif
@@ -0,0 +1,311 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifndef DUNE_COMMON_PARALLEL_HIERARCHICALCOLLECTIVES_HH
+#define DUNE_COMMON_PARALLEL_HIERARCHICALCOLLECTIVES_HH
+
+/*!
+   \file
+   \brief Collective operations in two levels, within the nodes through
+   shared memory and across the nodes by one process per node.
+
+   \ingroup ParallelCommunication
+ */
+
+#if HAVE_MPI
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include <mpi.h>
+
+#include <dune/common/visibility.hh>
+
+#if MPI_VERSION >= 3
+
+namespace Dune
+{
+  namespace Impl
+  {
+
+    /*! @brief Allreduce and broadcast in two levels.
+
+       The processes of a node put their data into an MPI-3 shared memory
+       window and reduce it there, each process a part of the vector. One
+       process per node, the leader, then communicates the result of the
+       node with the other leaders, and the processes of the node copy the
+       final result from the window.
+
+       The collectives of a communicator are created on the first call of
+       get(), which is a collective operation on the communicator. They
+       are attached to it as an attribute and freed with the communicator,
+       or by MPI_Finalize for MPI_COMM_WORLD.
+       CollectiveCommunication<MPI_Comm>::setHierarchical() uses them.
+     */
+    class HierarchicalCollectives
+    {
+    public:
+      //! Get the collectives of a communicator, creating them is collective
+      static HierarchicalCollectives& get (MPI_Comm comm);
+
+      /*! @brief Limit the number of processes forming a node.
+
+         Larger groups of processes sharing memory are split, e.g. to form
+         a node per socket. Applies to the collectives created afterwards.
+         Zero, the default, means no limit.
+       */
+      static void setMaxNodeSize (int size)
+      {
+        maxNodeSize() = size;
+      }
+
+      /*! @brief Reduce the data of all processes and distribute the result.
+
+         @param reduce The binary function combining two values.
+         @param type The MPI datatype, count, and operation describing the
+         reduction of len values of Type between the nodes.
+       */
+      template<class Type, class Reduce>
+      void allreduce (const Type* in, Type* out, int len, Reduce reduce,
+                      MPI_Datatype type, int count, MPI_Op op);
+
+      //! Send the data of the root process to all processes
+      template<class Type>
+      void broadcast (Type* inout, int len, int root, MPI_Datatype type, int count);
+
+      //! The number of processes on this node
+      int nodeSize () const
+      {
+        return nodeSize_;
+      }
+
+      //! The number of nodes
+      int nodes () const
+      {
+        return nodes_;
+      }
+
+    private:
+      explicit HierarchicalCollectives (MPI_Comm comm);
+      ~HierarchicalCollectives ();
+
+      HierarchicalCollectives (const HierarchicalCollectives&) = delete;
+      HierarchicalCollectives& operator= (const HierarchicalCollectives&) = delete;
+
+      // Buffers 0 and 1 take the results of alternate calls, so that a call
+      // may start while other processes still copy the previous result.
+      // Buffer 2+p takes the contribution of process p of the node.
+      char* buffer (int i)
+      {
+        return base_ + i*stride_;
+      }
+
+      void reserve (std::size_t bytes);
+      void freeWindow ();
+      void synchronize ();
+
+      static int deleteAttribute (MPI_Comm, int, void* state, void*);
+      static int deleteWorldAttribute (MPI_Comm, int, void*, void*);
+
+      DUNE_EXPORT static int& maxNodeSize ()
+      {
+        static int size = 0;
+        return size;
+      }
+
+      DUNE_EXPORT static int& keyval ()
+      {
+        static int keyval = MPI_KEYVAL_INVALID;
+        return keyval;
+      }
+
+      MPI_Comm node_;
+      MPI_Comm leaders_;
+      int rank_;
+      int nodeRank_;
+      int nodeSize_;
+      int nodes_;
+      // the rank of the leader of the node of each process
+      std::vector<int> leaderOf_;
+      MPI_Win window_;
+      char* base_;
+      std::size_t stride_;
+      int parity_;
+    };
+
+#ifndef DOXYGEN
+
+    inline HierarchicalCollectives& HierarchicalCollectives::get (MPI_Comm comm)
+    {
+      if(keyval() == MPI_KEYVAL_INVALID) {
+        MPI_Comm_create_keyval(MPI_COMM_NULL_COPY_FN, &deleteAttribute, &keyval(), nullptr);
+        // The attributes of MPI_COMM_SELF are deleted first in MPI_Finalize,
+        // those of MPI_COMM_WORLD might not be deleted at all.
+        int worldKeyval;
+        MPI_Comm_create_keyval(MPI_COMM_NULL_COPY_FN, &deleteWorldAttribute, &worldKeyval, nullptr);
+        MPI_Comm_set_attr(MPI_COMM_SELF, worldKeyval, nullptr);
+      }
+      void* state;
+      int found;
+      MPI_Comm_get_attr(comm, keyval(), &state, &found);
+      if(!found) {
+        state = new HierarchicalCollectives(comm);
+        MPI_Comm_set_attr(comm, keyval(), state);
+      }
+      return *static_cast<HierarchicalCollectives*>(state);
+    }
+
+    inline int HierarchicalCollectives::deleteAttribute (MPI_Comm, int, void* state, void*)
+    {
+      delete static_cast<HierarchicalCollectives*>(state);
+      return MPI_SUCCESS;
+    }
+
+    inline int HierarchicalCollectives::deleteWorldAttribute (MPI_Comm, int, void*, void*)
+    {
+      void* state;
+      int found;
+      MPI_Comm_get_attr(MPI_COMM_WORLD, keyval(), &state, &found);
+      if(found)
+        MPI_Comm_delete_attr(MPI_COMM_WORLD, keyval());
+      return MPI_SUCCESS;
+    }
+
+    inline HierarchicalCollectives::HierarchicalCollectives (MPI_Comm comm)
+      : window_(MPI_WIN_NULL), base_(nullptr), stride_(0), parity_(0)
+    {
+      int size;
+      MPI_Comm_rank(comm, &rank_);
+      MPI_Comm_size(comm, &size);
+      MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank_, MPI_INFO_NULL, &node_);
+      MPI_Comm_rank(node_, &nodeRank_);
+      MPI_Comm_size(node_, &nodeSize_);
+      if(maxNodeSize() > 0 && nodeSize_ > maxNodeSize()) {
+        MPI_Comm shared = node_;
+        MPI_Comm_split(shared, nodeRank_/maxNodeSize(), nodeRank_, &node_);
+        MPI_Comm_free(&shared);
+        MPI_Comm_rank(node_, &nodeRank_);
+        MPI_Comm_size(node_, &nodeSize_);
+      }
+      MPI_Comm_split(comm, nodeRank_ == 0 ? 0 : MPI_UNDEFINED, rank_, &leaders_);
+
+      int leader = 0;
+      if(leaders_ != MPI_COMM_NULL)
+        MPI_Comm_rank(leaders_, &leader);
+      MPI_Bcast(&leader, 1, MPI_INT, 0, node_);
+      leaderOf_.resize(size);
+      MPI_Allgather(&leader, 1, MPI_INT, leaderOf_.data(), 1, MPI_INT, comm);
+      nodes_ = *std::max_element(leaderOf_.begin(), leaderOf_.end()) + 1;
+    }
+
+    inline HierarchicalCollectives::~HierarchicalCollectives ()
+    {
+      freeWindow();
+      if(leaders_ != MPI_COMM_NULL)
+        MPI_Comm_free(&leaders_);
+      MPI_Comm_free(&node_);
+    }
+
+    inline void HierarchicalCollectives::freeWindow ()
+    {
+      if(window_ != MPI_WIN_NULL) {
+        MPI_Win_unlock_all(window_);
+        MPI_Win_free(&window_);
+      }
+    }
+
+    inline void HierarchicalCollectives::reserve (std::size_t bytes)
+    {
+      // cache line aligned buffers
+      const std::size_t stride = std::max<std::size_t>((bytes+63)/64*64, 64);
+      if(stride <= stride_)
+        return;
+      // all processes of the node grow the window in the same call
+      freeWindow();
+      stride_ = std::max(stride, 2*stride_);
+      const MPI_Aint size = nodeRank_ == 0 ? (2+nodeSize_)*stride_ : 0;
+      MPI_Win_allocate_shared(size, 1, MPI_INFO_NULL, node_, &base_, &window_);
+      MPI_Aint querySize;
+      int displacementUnit;
+      MPI_Win_shared_query(window_, 0, &querySize, &displacementUnit, &base_);
+      MPI_Win_lock_all(MPI_MODE_NOCHECK, window_);
+    }
+
+    inline void HierarchicalCollectives::synchronize ()
+    {
+      MPI_Win_sync(window_);
+      MPI_Barrier(node_);
+      MPI_Win_sync(window_);
+    }
+
+    template<class Type, class Reduce>
+    void HierarchicalCollectives::allreduce (const Type* in, Type* out, int len, Reduce reduce,
+                                             MPI_Datatype type, int count, MPI_Op op)
+    {
+      if(nodeSize_ == 1) {
+        // nothing to share, the process is the leader of its node
+        MPI_Allreduce(in == out ? MPI_IN_PLACE : const_cast<Type*>(in), out, count, type, op, leaders_);
+        return;
+      }
+      const std::size_t bytes = len*sizeof(Type);
+      reserve(bytes);
+      std::memcpy(buffer(2+nodeRank_), in, bytes);
+      Type* result = reinterpret_cast<Type*>(buffer(parity_));
+      parity_ ^= 1;
+      synchronize();
+
+      // every process of the node reduces a part of the contributions
+      const int begin = (long(len)*nodeRank_)/nodeSize_;
+      const int end = (long(len)*(nodeRank_+1))/nodeSize_;
+      std::memcpy(result+begin, buffer(2)+begin*sizeof(Type), (end-begin)*sizeof(Type));
+      for(int p=1; p<nodeSize_; ++p) {
+        const Type* contribution = reinterpret_cast<const Type*>(buffer(2+p));
+        for(int i=begin; i<end; ++i)
+          result[i] = reduce(result[i], contribution[i]);
+      }
+      synchronize();
+
+      if(nodes_ > 1) {
+        if(leaders_ != MPI_COMM_NULL)
+          MPI_Allreduce(MPI_IN_PLACE, result, count, type, op, leaders_);
+        synchronize();
+      }
+      std::memcpy(out, result, bytes);
+    }
+
+    template<class Type>
+    void HierarchicalCollectives::broadcast (Type* inout, int len, int root, MPI_Datatype type, int count)
+    {
+      if(nodeSize_ == 1) {
+        MPI_Bcast(inout, count, type, leaderOf_[root], leaders_);
+        return;
+      }
+      const std::size_t bytes = len*sizeof(Type);
+      reserve(bytes);
+      Type* result = reinterpret_cast<Type*>(buffer(parity_));
+      parity_ ^= 1;
+      const bool isRoot = root == rank_;
+      if(isRoot)
+        std::memcpy(result, inout, bytes);
+      synchronize();
+
+      if(nodes_ > 1) {
+        if(leaders_ != MPI_COMM_NULL)
+          MPI_Bcast(result, count, type, leaderOf_[root], leaders_);
+        synchronize();
+      }
+      if(!isRoot)
+        std::memcpy(inout, result, bytes);
+    }
+
+#endif // DOXYGEN
+
+  } // namespace Impl
+} // namespace Dune
+
+#endif // MPI_VERSION >= 3
+
+#endif // HAVE_MPI
+
+#endif
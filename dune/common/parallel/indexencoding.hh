@@ -0,0 +1,186 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifndef DUNE_COMMON_PARALLEL_INDEXENCODING_HH
+#define DUNE_COMMON_PARALLEL_INDEXENCODING_HH
+
+/*!
+   \file
+   \brief The compressed encoding of global indices in the messages of
+   RemoteIndices and IndicesSyncer.
+
+   \ingroup ParallelCommunication
+ */
+
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+
+#include <dune/common/exceptions.hh>
+
+namespace Dune
+{
+
+  namespace Impl
+  {
+
+    /* Whether global indices of type G can be compressed, and their
+       conversion to unsigned integers of the same width. Arithmetic on the
+       unsigned values wraps around, so the difference of any two indices
+       can be encoded. */
+    template<class G, bool = std::is_integral<G>::value && !std::is_same<G,bool>::value>
+    struct CompressedIndexTraits
+    {
+      static constexpr bool compressible = true;
+
+      typedef typename std::make_unsigned<G>::type Unsigned;
+
+      static Unsigned toUnsigned (const G& global)
+      {
+        return Unsigned(global);
+      }
+
+      static G fromUnsigned (Unsigned value)
+      {
+        return G(value);
+      }
+    };
+
+    template<class G>
+    struct CompressedIndexTraits<G,false>
+    {
+      static constexpr bool compressible = false;
+
+      typedef unsigned char Unsigned;
+
+      static Unsigned toUnsigned (const G&)
+      {
+        DUNE_THROW(NotImplemented, "Only integral global indices can be compressed");
+      }
+
+      static G fromUnsigned (Unsigned)
+      {
+        DUNE_THROW(NotImplemented, "Only integral global indices can be compressed");
+      }
+    };
+
+    /* Writes global indices as the differences to their predecessors,
+       and nonnegative integers, with seven bits per byte. The high bit of
+       a byte tells whether another one follows. The differences of sorted
+       indices are small, so most of them take a single byte. */
+    template<class G>
+    class IndexEncoder
+    {
+      typedef CompressedIndexTraits<G> Traits;
+      typedef typename Traits::Unsigned Unsigned;
+
+    public:
+      // The maximal number of bytes of a global index
+      static constexpr std::size_t maxGlobalSize ()
+      {
+        return (8*sizeof(Unsigned)+6)/7;
+      }
+
+      // The maximal number of bytes of an integer
+      static constexpr std::size_t maxIntSize ()
+      {
+        return (8*sizeof(unsigned)+6)/7;
+      }
+
+      explicit IndexEncoder (char* buffer)
+        : buffer_(buffer), size_(0), previous_(0)
+      {}
+
+      void writeGlobal (const G& global)
+      {
+        const Unsigned value = Traits::toUnsigned(global);
+        write(Unsigned(value-previous_));
+        previous_ = value;
+      }
+
+      void writeInt (int i)
+      {
+        assert(i >= 0);
+        write(unsigned(i));
+      }
+
+      void writeByte (char c)
+      {
+        buffer_[size_++] = c;
+      }
+
+      // The number of bytes written
+      std::size_t size () const
+      {
+        return size_;
+      }
+
+    private:
+      template<class U>
+      void write (U value)
+      {
+        while(value >= 0x80) {
+          buffer_[size_++] = char((value & 0x7f) | 0x80);
+          value >>= 7;
+        }
+        buffer_[size_++] = char(value);
+      }
+
+      char* buffer_;
+      std::size_t size_;
+      Unsigned previous_;
+    };
+
+    // Reads what an IndexEncoder wrote, in the same order
+    template<class G>
+    class IndexDecoder
+    {
+      typedef CompressedIndexTraits<G> Traits;
+      typedef typename Traits::Unsigned Unsigned;
+
+    public:
+      IndexDecoder (const char* buffer, std::size_t size)
+        : buffer_(buffer), size_(size), position_(0), previous_(0)
+      {}
+
+      G readGlobal ()
+      {
+        previous_ = Unsigned(previous_+read<Unsigned>());
+        return Traits::fromUnsigned(previous_);
+      }
+
+      int readInt ()
+      {
+        return int(read<unsigned>());
+      }
+
+      char readByte ()
+      {
+        assert(position_ < size_);
+        return buffer_[position_++];
+      }
+
+    private:
+      template<class U>
+      U read ()
+      {
+        U value = 0;
+        for(unsigned shift = 0;; shift += 7) {
+          assert(position_ < size_);
+          const unsigned char byte = buffer_[position_++];
+          value |= U(byte & 0x7f) << shift;
+          if(!(byte & 0x80))
+            return value;
+        }
+      }
+
+      const char* buffer_;
+      std::size_t size_;
+      std::size_t position_;
+      Unsigned previous_;
+    };
+
+  } // namespace Impl
+
+} // namespace Dune
+
+#endif
@@ -5,16 +5,21 @@
 
 #include "indexset.hh"
 #include "remoteindices.hh"
+#include "communicationprofiler.hh"
+#include "indexencoding.hh"
+#include "sparseexchange.hh"
 #include <dune/common/stdstreams.hh>
 #include <dune/common/sllist.hh>
 #include <dune/common/unused.hh>
 #include <cassert>
 #include <cmath>
+#include <cstring>
 #include <limits>
 #include <algorithm>
 #include <functional>
 #include <map>
 #include <tuple>
+#include <type_traits>
 
 #if HAVE_MPI
 namespace Dune
@@ -34,6 +39,10 @@ namespace Dune
    * @brief Class for recomputing missing indices of a distributed index set.
    *
    * Missing local and remote indices will be added.
+   *
+   * The index information is sent as binary records. Therefore the global
+   * index has to be trivially copyable and all processes need to use the
+   * same data representation.
    */
   template<typename T>
   class IndicesSyncer
@@ -73,7 +82,10 @@ namespace Dune
      * @brief Sync the index set.
      *
      * Computes the missing indices in the local and the remote index list and adds them.
-     * No global communication is necessary!
+     * Messages are only sent to neighbours that need information. If MPI-3 is
+     * available, the end of the exchange is detected with a nonblocking barrier.
+     * Then all processes of the communicator of the remote indices have to call
+     * this method.
      * All indices added to the index will become the local index
      * std::numeric_limits<size_t>::max()
      *
@@ -84,7 +96,7 @@ namespace Dune
      * @brief Synce the index set and assign local numbers to new indices
      *
      * Computes the missing indices in the local and the remote index list and adds them.
-     * No global communication is necessary!
+     * See sync() for the communication involved.
      * @param numberer Functor providing the local indices for the added global indices.
      * has to provide a function size_t operator()(const TG& global) that provides the
      * local index to a global one. It will be called for ascending global indices.
@@ -113,6 +125,42 @@ namespace Dune
     /** @brief The size of the receive buffer in bytes. */
     int receiveBufferSize_; // int because of MPI
 
+    static_assert(std::is_trivially_copyable<GlobalIndex>::value,
+                  "IndicesSyncer sends the global indices bytewise");
+
+    /**
+     * @brief The record of a published index in a message.
+     *
+     * It is followed by the given number of PairRecords.
+     */
+    struct IndexRecord
+    {
+      /** @brief The global index. */
+      GlobalIndex global;
+      /** @brief The number of processes knowing the index. */
+      int pairs;
+      /** @brief The attribute on the sending process. */
+      char attribute;
+    };
+
+    /**
+     * @brief The record of a process knowing a published index.
+     */
+    struct PairRecord
+    {
+      /** @brief The rank of the process. */
+      int process;
+      /** @brief The attribute on that process. */
+      char attribute;
+    };
+
+    /**
+     * @brief The tags of the messages.
+     *
+     * Consecutive calls of sync() alternate between them.
+     */
+    enum { tag = 345, otherTag = 346 };
+
     /**
      * @brief Information about the messages to send to a neighbouring process.
      */
@@ -352,15 +400,26 @@ namespace Dune
      * @param buffer The allocated buffer to use.
      * @param bufferSize The size of the buffer.
      * @param req The MPI_Request to setup the nonblocking send.
+     * @param messageTag The tag to send the message with.
+     * @param profile The profiler scope recording the message.
      */
-    void packAndSend(int destination, char* buffer, std::size_t bufferSize, MPI_Request& req);
+    void packAndSend(int destination, char* buffer, std::size_t bufferSize, MPI_Request& req,
+                     int messageTag, CommunicationProfiler::Scope& profile);
 
     /**
-     * @brief Recv and unpack the message from another process and add the indices.
+     * @brief Unpack the message in the receive buffer and add the indices.
+     * @param source The rank of the process that sent the message.
+     * @param count The size of the message in bytes.
      * @param numberer Functor providing local indices for added global indices.
      */
     template<typename T1>
-    void recvAndUnpack(T1& numberer);
+    void unpack(int source, int count, T1& numberer);
+
+    /**
+     * @brief Make sure the receive buffer can hold a message.
+     * @param count The size of the message in bytes.
+     */
+    void reserveReceiveBuffer(int count);
 
     /**
      * @brief Register the MPI datatype for the MessageInformation.
@@ -697,7 +756,7 @@ namespace Dune
 
     // registerMessageDatatype();
 
-    // Now determine the buffersizes needed for each neighbour using MPI_Pack_size
+    // Now determine the buffersizes needed for each neighbour
     MessageInformation dummy;
 
     MessageIterator messageIter= infoSend_.begin();
@@ -708,7 +767,6 @@ namespace Dune
 
     for(RemoteIterator remote = remoteIndices_.begin(); remote != rend; ++remote, ++neighbour) {
       MessageInformation* message;
-      MessageInformation recv;
 
       if(messageIter != end && messageIter->first==remote->first) {
         // We want to send message information to that process
@@ -718,31 +776,15 @@ namespace Dune
         // We do not want to send information but the other process might.
         message = &dummy;
 
-      sendBufferSizes_[neighbour]=0;
-      int tsize;
-      // The number of indices published
-      MPI_Pack_size(1, MPI_INT,remoteIndices_.communicator(), &tsize);
-      sendBufferSizes_[neighbour] += tsize;
-
-      for(int i=0; i < message->publish; ++i) {
-        // The global index
-        MPI_Pack_size(1, MPITraits<GlobalIndex>::getType(), remoteIndices_.communicator(), &tsize);
-        sendBufferSizes_[neighbour] += tsize;
-        // The attribute in the local index
-        MPI_Pack_size(1, MPI_CHAR, remoteIndices_.communicator(), &tsize);
-        sendBufferSizes_[neighbour] += tsize;
-        // The number of corresponding remote indices
-        MPI_Pack_size(1, MPI_INT, remoteIndices_.communicator(), &tsize);
-        sendBufferSizes_[neighbour] += tsize;
-      }
-      for(int i=0; i < message->pairs; ++i) {
-        // The process of the remote index
-        MPI_Pack_size(1, MPI_INT, remoteIndices_.communicator(), &tsize);
-        sendBufferSizes_[neighbour] += tsize;
-        // The attribute of the remote index
-        MPI_Pack_size(1, MPI_CHAR, remoteIndices_.communicator(), &tsize);
-        sendBufferSizes_[neighbour] += tsize;
-      }
+      // The number of indices published, followed by the records
+      if(remoteIndices_.compressIndices()) {
+        typedef Impl::IndexEncoder<GlobalIndex> Encoder;
+        sendBufferSizes_[neighbour] = sizeof(int)
+                                      + message->publish*(Encoder::maxGlobalSize()+Encoder::maxIntSize()+1)
+                                      + message->pairs*(Encoder::maxIntSize()+1);
+      }else
+        sendBufferSizes_[neighbour] = sizeof(int) + message->publish*sizeof(IndexRecord)
+                                      + message->pairs*sizeof(PairRecord);
 
       Dune::dverb<<rank_<<": Buffer (neighbour="<<remote->first<<") size is "<< sendBufferSizes_[neighbour]<<" for publish="<<message->publish<<" pairs="<<message->pairs<<std::endl;
     }
@@ -760,6 +802,7 @@ namespace Dune
   template<typename T1>
   void IndicesSyncer<T>::sync(T1& numberer)
   {
+    CommunicationProfiler::Scope profile("IndicesSyncer::sync", this);
 
     // The pointers to the local indices in the remote indices
     // will become invalid due to the resorting of the index set.
@@ -831,25 +874,55 @@ namespace Dune
 
     MPI_Request* requests = new MPI_Request[noOldNeighbours];
     MPI_Status* statuses = new MPI_Status[noOldNeighbours];
+    MPI_Comm comm = remoteIndices_.communicator();
+    const Impl::SparseExchange exchange(comm, tag, otherTag);
 
+#if MPI_VERSION >= 3
+    // Pack Message data and start the sends. With the sparse consensus
+    // below we only need to send to neighbours that need information.
+    for(std::size_t i = 0; i<noOldNeighbours; ++i)
+      if(infoSend_[oldNeighbours[i]].publish)
+        packAndSend(oldNeighbours[i], sendBuffers_[i], sendBufferSizes_[i], requests[i], exchange.tag(), profile);
+      else
+        requests[i] = MPI_REQUEST_NULL;
+
+    // Process the incoming messages in the order of their arrival
+    exchange.receive(noOldNeighbours, requests,
+                     [&](int source, int count, MPI_Message& message)
+                     {
+                       reserveReceiveBuffer(count);
+                       MPI_Mrecv(receiveBuffer_, count, MPI_BYTE, &message, MPI_STATUS_IGNORE);
+                       unpack(source, count, numberer);
+                     }, profile);
+#else
     // Pack Message data and start the sends
     for(std::size_t i = 0; i<noOldNeighbours; ++i)
-      packAndSend(oldNeighbours[i], sendBuffers_[i], sendBufferSizes_[i], requests[i]);
+      packAndSend(oldNeighbours[i], sendBuffers_[i], sendBufferSizes_[i], requests[i], exchange.tag(), profile);
 
     // Probe for incoming messages, receive and unpack them
-    for(std::size_t i = 0; i<noOldNeighbours; ++i)
-      recvAndUnpack(numberer);
-    //       }else{
-    //  recvAndUnpack(oldNeighbours[i], numberer);
-    //  packAndSend(oldNeighbours[i]);
-    //       }
-    //     }
+    for(std::size_t i = 0; i<noOldNeighbours; ++i) {
+      MPI_Status status;
+      // We have to determine the message size and source before the receive
+      const double waitStart = profile.beginWait();
+      MPI_Probe(MPI_ANY_SOURCE, exchange.tag(), comm, &status);
+      profile.endWait(waitStart);
+      int count;
+      MPI_Get_count(&status, MPI_BYTE, &count);
+      reserveReceiveBuffer(count);
+      MPI_Recv(receiveBuffer_, count, MPI_BYTE, status.MPI_SOURCE, exchange.tag(), comm, MPI_STATUS_IGNORE);
+      profile.receive(status.MPI_SOURCE, count);
+      unpack(status.MPI_SOURCE, count, numberer);
+    }
+#endif
 
     delete[] receiveBuffer_;
 
     // Wait for the completion of the sends
     // Wait for completion of sends
-    if(MPI_SUCCESS!=MPI_Waitall(noOldNeighbours, requests, statuses)) {
+    const double waitStart = profile.beginWait();
+    const int waited = MPI_Waitall(noOldNeighbours, requests, statuses);
+    profile.endWait(waitStart);
+    if(MPI_SUCCESS!=waited) {
       std::cerr<<": MPI_Error occurred while sending message"<<std::endl;
       for(std::size_t i=0; i< noOldNeighbours; i++)
         if(MPI_SUCCESS!=statuses[i].MPI_ERROR)
@@ -882,20 +955,25 @@ namespace Dune
   }
 
   template<typename T>
-  void IndicesSyncer<T>::packAndSend(int destination, char* buffer, std::size_t bufferSize, MPI_Request& request)
+  void IndicesSyncer<T>::packAndSend(int destination, char* buffer, std::size_t bufferSize, MPI_Request& request,
+                                     int messageTag, CommunicationProfiler::Scope& profile)
   {
     typedef typename ParallelIndexSet::const_iterator IndexIterator;
 
     IndexIterator iEnd       = indexSet_.end();
-    int bpos       = 0;
+    std::size_t bpos = 0;
     int published  = 0;
     int pairs      = 0;
 
     assert(checkReset());
 
     // Pack the number of indices we publish
-    MPI_Pack(&(infoSend_[destination].publish), 1, MPI_INT, buffer, bufferSize, &bpos,
-             remoteIndices_.communicator());
+    std::memcpy(buffer, &(infoSend_[destination].publish), sizeof(int));
+    bpos += sizeof(int);
+
+    // The records follow either as they are or compressed
+    const bool compressed = remoteIndices_.compressIndices();
+    Impl::IndexEncoder<GlobalIndex> encoder(buffer+bpos);
 
     for(IndexIterator index = indexSet_.begin(); index != iEnd; ++index) {
       // Search for corresponding remote indices in all iterator tuples
@@ -939,32 +1017,39 @@ namespace Dune
       Dune::dverb<<rank_<<": sending "<<indices<<" for index "<<index->global()<<" to "<<destination<<std::endl;
 
 
-      // Pack the global index, the attribute and the number
-      MPI_Pack(const_cast<GlobalIndex*>(&(index->global())), 1, MPITraits<GlobalIndex>::getType(), buffer, bufferSize, &bpos,
-               remoteIndices_.communicator());
-
-      char attr = index->local().attribute();
-      MPI_Pack(&attr, 1, MPI_CHAR, buffer, bufferSize, &bpos,
-               remoteIndices_.communicator());
-
-      // Pack the number of remote indices we send.
-      MPI_Pack(&indices, 1, MPI_INT, buffer, bufferSize, &bpos,
-               remoteIndices_.communicator());
+      // Pack the global index, the number of remote indices we send and the attribute
+      IndexRecord record;
+      record.global = index->global();
+      record.pairs = indices;
+      record.attribute = index->local().attribute();
+      if(compressed) {
+        encoder.writeGlobal(record.global);
+        encoder.writeInt(record.pairs);
+        encoder.writeByte(record.attribute);
+      }else{
+        assert(bpos+sizeof(IndexRecord) <= bufferSize);
+        std::memcpy(buffer+bpos, &record, sizeof(IndexRecord));
+        bpos += sizeof(IndexRecord);
+      }
 
       // Pack the information about the remote indices
       for(Iterator iterators = iteratorsMap_.begin(); iteratorsEnd != iterators; ++iterators)
         if(iterators->second.isNotAtEnd() && iterators->second.isOld()
            && iterators->second.globalIndexPair().first == index->global()) {
-          int process = iterators->first;
+          PairRecord pair;
+          pair.process = iterators->first;
+          pair.attribute = iterators->second.remoteIndex().attribute();
 
           ++pairs;
           assert(pairs <= infoSend_[destination].pairs);
-          MPI_Pack(&process, 1, MPI_INT, buffer, bufferSize, &bpos,
-                   remoteIndices_.communicator());
-          char attr2 = iterators->second.remoteIndex().attribute();
-
-          MPI_Pack(&attr2, 1, MPI_CHAR, buffer, bufferSize, &bpos,
-                   remoteIndices_.communicator());
+          if(compressed) {
+            encoder.writeInt(pair.process);
+            encoder.writeByte(pair.attribute);
+          }else{
+            assert(bpos+sizeof(PairRecord) <= bufferSize);
+            std::memcpy(buffer+bpos, &pair, sizeof(PairRecord));
+            bpos += sizeof(PairRecord);
+          }
           --indices;
         }
       assert(indices==0);
@@ -976,11 +1061,14 @@ namespace Dune
     // Make sure we send all expected entries
     assert(published == infoSend_[destination].publish);
     assert(pairs == infoSend_[destination].pairs);
+    bpos += encoder.size();
+    assert(bpos <= bufferSize);
     resetIteratorsMap();
 
     Dune::dverb << rank_<<": Sending message of "<<bpos<<" bytes to "<<destination<<std::endl;
 
-    MPI_Issend(buffer, bpos, MPI_PACKED, destination, 345, remoteIndices_.communicator(),&request);
+    MPI_Issend(buffer, bpos, MPI_BYTE, destination, messageTag, remoteIndices_.communicator(),&request);
+    profile.send(destination, bpos);
   }
 
   template<typename T>
@@ -1037,55 +1125,55 @@ namespace Dune
       iterators.insert(RemoteIndex(Attribute(attribute)),globalPair);
   }
 
+  template<typename T>
+  void IndicesSyncer<T>::reserveReceiveBuffer(int count)
+  {
+    if(count>receiveBufferSize_) {
+      receiveBufferSize_=count;
+      delete[] receiveBuffer_;
+      receiveBuffer_ = new char[receiveBufferSize_];
+    }
+  }
+
   template<typename T>
   template<typename T1>
-  void IndicesSyncer<T>::recvAndUnpack(T1& numberer)
+  void IndicesSyncer<T>::unpack(int source, int count, T1& numberer)
   {
     typedef typename ParallelIndexSet::const_iterator IndexIterator;
 
     IndexIterator iEnd   = indexSet_.end();
     IndexIterator index  = indexSet_.begin();
-    int bpos   = 0;
+    std::size_t bpos = 0;
     int publish;
 
     assert(checkReset());
 
-    MPI_Status status;
-
-    // We have to determine the message size and source before the receive
-    MPI_Probe(MPI_ANY_SOURCE, 345, remoteIndices_.communicator(), &status);
-
-    int source=status.MPI_SOURCE;
-    int count;
-    MPI_Get_count(&status, MPI_PACKED, &count);
-
     Dune::dvverb<<rank_<<": Receiving message from "<< source<<" with "<<count<<" bytes"<<std::endl;
 
-    if(count>receiveBufferSize_) {
-      receiveBufferSize_=count;
-      delete[] receiveBuffer_;
-      receiveBuffer_ = new char[receiveBufferSize_];
-    }
-
-    MPI_Recv(receiveBuffer_, count, MPI_PACKED, source, 345, remoteIndices_.communicator(), &status);
-
     // How many global entries were published?
-    MPI_Unpack(receiveBuffer_,  count, &bpos, &publish, 1, MPI_INT, remoteIndices_.communicator());
+    std::memcpy(&publish, receiveBuffer_, sizeof(int));
+    bpos += sizeof(int);
+
+    const bool compressed = remoteIndices_.compressIndices();
+    Impl::IndexDecoder<GlobalIndex> decoder(receiveBuffer_+bpos, count-bpos);
 
     // Now unpack the remote indices and add them.
     while(publish>0) {
 
       // Unpack information about the local index on the source process
-      GlobalIndex global;           // global index of the current entry
-      char sourceAttribute; // Attribute on the source process
-      int pairs;
-
-      MPI_Unpack(receiveBuffer_,  count, &bpos, &global, 1, MPITraits<GlobalIndex>::getType(),
-                 remoteIndices_.communicator());
-      MPI_Unpack(receiveBuffer_,  count, &bpos, &sourceAttribute, 1, MPI_CHAR,
-                 remoteIndices_.communicator());
-      MPI_Unpack(receiveBuffer_,  count, &bpos, &pairs, 1, MPI_INT,
-                 remoteIndices_.communicator());
+      IndexRecord record;
+      if(compressed) {
+        record.global = decoder.readGlobal();
+        record.pairs = decoder.readInt();
+        record.attribute = decoder.readByte();
+      }else{
+        assert(bpos+sizeof(IndexRecord) <= std::size_t(count));
+        std::memcpy(&record, receiveBuffer_+bpos, sizeof(IndexRecord));
+        bpos += sizeof(IndexRecord);
+      }
+      const GlobalIndex& global = record.global;       // global index of the current entry
+      char sourceAttribute = record.attribute;         // Attribute on the source process
+      int pairs = record.pairs;
 
       // Insert the entry on the remote process to our
       // remote index list
@@ -1098,14 +1186,18 @@ namespace Dune
 
       // Unpack the remote indices
       for(; pairs>0; --pairs) {
-        // Unpack the process id that knows the index
-        int process;
-        char attribute;
-        MPI_Unpack(receiveBuffer_,  count, &bpos, &process, 1, MPI_INT,
-                   remoteIndices_.communicator());
-        // Unpack the attribute
-        MPI_Unpack(receiveBuffer_,  count, &bpos, &attribute, 1, MPI_CHAR,
-                   remoteIndices_.communicator());
+        // Unpack the process id that knows the index and its attribute there
+        PairRecord pair;
+        if(compressed) {
+          pair.process = decoder.readInt();
+          pair.attribute = decoder.readByte();
+        }else{
+          assert(bpos+sizeof(PairRecord) <= std::size_t(count));
+          std::memcpy(&pair, receiveBuffer_+bpos, sizeof(PairRecord));
+          bpos += sizeof(PairRecord);
+        }
+        int process = pair.process;
+        char attribute = pair.attribute;
 
         if(process==rank_) {
 #ifndef NDEBUG
@@ -5,6 +5,10 @@
 
 #if HAVE_MPI
 
+#include <algorithm>
+#include <memory>
+#include <vector>
+
 #include "remoteindices.hh"
 #include <dune/common/enumset.hh>
 
@@ -88,6 +92,29 @@ namespace Dune
                          Op& functor) const;
   };
 
+  /**
+   * @brief A run of equally spaced local indices in an interface.
+   *
+   * The entries offset, ..., offset+size-1 of the interface refer to
+   * the local indices start, start+stride, ..., start+(size-1)*stride.
+   * The indices of runs with stride one are consecutive.
+   */
+  struct IndexRun
+  {
+    IndexRun(std::size_t o, std::size_t s, std::size_t n, std::size_t st=1)
+      : offset(o), start(s), size(n), stride(st)
+    {}
+
+    /** @brief The position of the first entry of the run in the interface. */
+    std::size_t offset;
+    /** @brief The first local index of the run. */
+    std::size_t start;
+    /** @brief The number of indices in the run. */
+    std::size_t size;
+    /** @brief The distance between the local indices of the run. */
+    std::size_t stride;
+  };
+
   /**
    * @brief Information describing an interface.
    *
@@ -133,6 +160,7 @@ namespace Dune
     {
       indices_ = new std::size_t[size];
       maxSize_ = size;
+      runs_ = std::make_shared<std::vector<IndexRun> >();
 
     }
     /**
@@ -145,6 +173,7 @@ namespace Dune
       maxSize_ = 0;
       size_=0;
       indices_=0;
+      runs_ = std::make_shared<std::vector<IndexRun> >();
     }
     /**
      * @brief Add a new index to the interface.
@@ -155,8 +184,44 @@ namespace Dune
       indices_[size_++]=index;
     }
 
+    /**
+     * @brief Detect the runs of consecutive local indices.
+     *
+     * Has to be called again whenever indices are added.
+     * @param strided If true, runs of at least three equally spaced
+     * ascending indices are detected, too.
+     */
+    void computeRuns(bool strided=false)
+    {
+      std::vector<IndexRun>& runs = *runs_;
+      runs.clear();
+      for(std::size_t i=0; i<size_; ) {
+        std::size_t stride=1;
+        if(strided && i+2<size_ && indices_[i+1]>indices_[i]+1
+           && indices_[i+2]>indices_[i+1] && indices_[i+2]-indices_[i+1]==indices_[i+1]-indices_[i])
+          stride=indices_[i+1]-indices_[i];
+        std::size_t n=1;
+        while(i+n<size_ && indices_[i+n]==indices_[i]+n*stride)
+          ++n;
+        runs.push_back(IndexRun(i, indices_[i], n, stride));
+        i+=n;
+      }
+    }
+
+    /**
+     * @brief Get the runs of local indices.
+     *
+     * Empty unless computeRuns() was called. Like the local indices,
+     * the runs are shared by all copies made after reserve().
+     */
+    const std::vector<IndexRun>& runs() const
+    {
+      return *runs_;
+    }
+
     InterfaceInformation()
-      : size_(0), maxSize_(0), indices_(0)
+      : size_(0), maxSize_(0), indices_(0),
+        runs_(std::make_shared<std::vector<IndexRun> >())
     {}
 
     virtual ~InterfaceInformation()
@@ -190,6 +255,10 @@ namespace Dune
      * @brief The local indices of the interface.
      */
     std::size_t* indices_;
+    /**
+     * @brief The runs of consecutive local indices.
+     */
+    std::shared_ptr<std::vector<IndexRun> > runs_;
   };
 
   /** @addtogroup Common_Parallel
@@ -225,7 +294,8 @@ namespace Dune
      * for checking whether the set contains a specific flag.
      * This functionality is for example provided the classes
      * EnumItem, EnumRange and Combine.
-     * @param remoteIndices The indices known to remote processes.
+     * @param remoteIndices The indices known to remote processes, either
+     * RemoteIndices or their compact copy CompactRemoteIndices.
      * @param sourceFlags The set of flags marking indices we send from.
      * @param destFlags The set of flags marking indices we receive for.
      */
@@ -233,6 +303,23 @@ namespace Dune
     void build(const R& remoteIndices, const T1& sourceFlags,
                const T2& destFlags);
 
+    /**
+     * @brief Reorder the interface for streaming access to the data.
+     *
+     * Sorts the indices sent to each process by local index and detects
+     * runs of consecutive and of equally spaced indices, see
+     * InterfaceInformation::runs(). The entries sent and received have to
+     * match, so each process sends the permutation of its send indices to
+     * the receiving process, which applies it to its receive indices.
+     * Therefore the receive indices are only sorted if the local indices
+     * are numbered in the same order on both processes.
+     *
+     * This is a collective operation, it has to be called on all processes
+     * of the communicator after build(). Communicators already built for
+     * the interface share its indices and runs, so they use the new order.
+     */
+    void compress();
+
     /**
      * @brief Frees memory allocated during the build.
      */
@@ -314,6 +401,12 @@ namespace Dune
     MPI_Comm communicator_;
 
   private:
+    /** @brief The tag for exchanging the permutations in compress(). */
+    const static int compressTag_=336;
+
+    /** @brief Reorder the entries of an interface, the new entry i is the old entry permutation[i]. */
+    static void permute(InterfaceInformation& info, const std::vector<std::size_t>& permutation);
+
     /**
      * @brief Information about the interfaces.
      *
@@ -373,6 +466,7 @@ namespace Dune
       // Messure the number of indices send to the remote process first
       int size=0;
       typedef typename RemoteIndices::RemoteIndexList::const_iterator RemoteIterator;
+      typedef Impl::RemoteIndexAccess<RemoteIterator> Access;
       const RemoteIterator remoteEnd = send ? process->second.first->end() :
                                        process->second.second->end();
       RemoteIterator remote = send ? process->second.first->begin() : process->second.second->begin();
@@ -382,8 +476,8 @@ namespace Dune
             sourceFlags.contains(remote->attribute())) {
 
           // do we send the index?
-          if( send ? sourceFlags.contains(remote->localIndexPair().local().attribute()) :
-              destFlags.contains(remote->localIndexPair().local().attribute()))
+          if( send ? sourceFlags.contains(Access::localAttribute(remote)) :
+              destFlags.contains(Access::localAttribute(remote)))
             ++size;
         }
         ++remote;
@@ -395,6 +489,7 @@ namespace Dune
 
     for(const_iterator process=remoteIndices.begin(); process != end; ++process) {
       typedef typename RemoteIndices::RemoteIndexList::const_iterator RemoteIterator;
+      typedef Impl::RemoteIndexAccess<RemoteIterator> Access;
       const RemoteIterator remoteEnd = send ? process->second.first->end() :
                                        process->second.second->end();
       RemoteIterator remote = send ? process->second.first->begin() : process->second.second->begin();
@@ -403,9 +498,9 @@ namespace Dune
         if( send ?  destFlags.contains(remote->attribute()) :
             sourceFlags.contains(remote->attribute())) {
           // do we send the index?
-          if( send ? sourceFlags.contains(remote->localIndexPair().local().attribute()) :
-              destFlags.contains(remote->localIndexPair().local().attribute()))
-            interfaceInformation.add(process->first,remote->localIndexPair().local().local());
+          if( send ? sourceFlags.contains(Access::localAttribute(remote)) :
+              destFlags.contains(Access::localAttribute(remote)))
+            interfaceInformation.add(process->first,Access::localIndex(remote));
         }
         ++remote;
       }
@@ -473,7 +568,66 @@ namespace Dune
     this->template buildInterface<R,T1,T2,InformationBuilder<false>,false>(remoteIndices,sourceFlags,
                                                                            destFlags, recvInformation);
     strip();
+
+    // Detect contiguous runs for the communicators
+    typedef InformationMap::iterator iterator;
+    for(iterator interfacePair = interfaces_.begin(); interfacePair != interfaces_.end(); ++interfacePair) {
+      interfacePair->second.first.computeRuns();
+      interfacePair->second.second.computeRuns();
+    }
+  }
+  inline void Interface::permute(InterfaceInformation& info, const std::vector<std::size_t>& permutation)
+  {
+    std::vector<std::size_t> indices(info.size());
+    for(std::size_t i=0; i < info.size(); ++i)
+      indices[i] = info[permutation[i]];
+    for(std::size_t i=0; i < info.size(); ++i)
+      info[i] = indices[i];
+  }
+
+  inline void Interface::compress()
+  {
+    typedef InformationMap::iterator iterator;
+    std::vector<std::vector<std::size_t> > sendPermutations(interfaces_.size()),
+    recvPermutations(interfaces_.size());
+    std::vector<MPI_Request> requests;
+    requests.reserve(2*interfaces_.size());
+
+    std::size_t i=0;
+    for(iterator interfacePair = interfaces_.begin(); interfacePair != interfaces_.end(); ++interfacePair, ++i) {
+      InterfaceInformation& send = interfacePair->second.first;
+      std::vector<std::size_t>& permutation = sendPermutations[i];
+      permutation.resize(send.size());
+      for(std::size_t j=0; j < send.size(); ++j)
+        permutation[j] = j;
+      std::stable_sort(permutation.begin(), permutation.end(), [&send](std::size_t a, std::size_t b) {
+                         return send[a] < send[b];
+                       });
+      permute(send, permutation);
+      if(send.size()) {
+        requests.push_back(MPI_REQUEST_NULL);
+        MPI_Isend(permutation.data(), send.size(), MPITraits<std::size_t>::getType(),
+                  interfacePair->first, compressTag_, communicator_, &requests.back());
+      }
+
+      const InterfaceInformation& recv = interfacePair->second.second;
+      recvPermutations[i].resize(recv.size());
+      if(recv.size()) {
+        requests.push_back(MPI_REQUEST_NULL);
+        MPI_Irecv(recvPermutations[i].data(), recv.size(), MPITraits<std::size_t>::getType(),
+                  interfacePair->first, compressTag_, communicator_, &requests.back());
+      }
+    }
+    MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+
+    i=0;
+    for(iterator interfacePair = interfaces_.begin(); interfacePair != interfaces_.end(); ++interfacePair, ++i) {
+      permute(interfacePair->second.second, recvPermutations[i]);
+      interfacePair->second.first.computeRuns(true);
+      interfacePair->second.second.computeRuns(true);
+    }
   }
+
   inline void Interface::strip()
   {
     typedef InformationMap::iterator const_iterator;
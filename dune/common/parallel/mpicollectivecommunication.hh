@@ -14,15 +14,28 @@
 #if HAVE_MPI
 
 #include <algorithm>
+#include <array>
+#include <cstddef>
 #include <functional>
 #include <memory>
+#include <numeric>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include <mpi.h>
 
 #include <dune/common/binaryfunctions.hh>
+#include <dune/common/exactsum.hh>
 #include <dune/common/exceptions.hh>
 #include <dune/common/parallel/collectivecommunication.hh>
+#include <dune/common/parallel/communicationprofiler.hh>
+#include <dune/common/parallel/hierarchicalcollectives.hh>
+#include <dune/common/parallel/mpifuture.hh>
 #include <dune/common/parallel/mpitraits.hh>
+#include <dune/common/typetraits.hh>
+#include <dune/common/unused.hh>
 
 namespace Dune
 {
@@ -37,6 +50,9 @@ namespace Dune
   {
 
   public:
+    //! Whether the operation is a builtin MPI operation
+    static constexpr bool builtin = false;
+
     static MPI_Op get ()
     {
       if (!op)
@@ -50,12 +66,11 @@ namespace Dune
     static void operation (Type *in, Type *inout, int *len, MPI_Datatype*)
     {
       BinaryFunction func;
+      const int n = *len;
 
-      for (int i=0; i< *len; ++i, ++in, ++inout) {
-        Type temp;
-        temp = func(*in, *inout);
-        *inout = temp;
-      }
+      // plain indexed loop without temporaries, which compilers vectorize
+      for (int i=0; i<n; ++i)
+        inout[i] = func(in[i], inout[i]);
     }
     Generic_MPI_Op () {}
     Generic_MPI_Op (const Generic_MPI_Op& ) {}
@@ -70,6 +85,7 @@ namespace Dune
   template<> \
   class Generic_MPI_Op<type, func<type> >{ \
   public:\
+    static constexpr bool builtin = true; \
     static MPI_Op get(){ \
       return op; \
     } \
@@ -129,6 +145,68 @@ namespace Dune
 
 #undef ComposeMPIOp
 
+  namespace Impl
+  {
+    /*! \brief The MPI datatype, operation and count used to reduce a type.
+
+       Types described by ElementwiseReductionTraits are reduced as arrays
+       of scalars, with the builtin MPI operation if there is one for the
+       scalar type and with a Generic_MPI_Op on the scalars otherwise. All
+       other types are reduced with a Generic_MPI_Op on the whole type.
+       Value and Function are the type and the binary function the
+       operation applies to count() values.
+     */
+    template<typename Type, typename BinaryFunction, typename = void>
+    struct MPIReduction
+    {
+      typedef Type Value;
+      typedef BinaryFunction Function;
+
+      static MPI_Datatype type()
+      {
+        return MPITraits<Type>::getType();
+      }
+
+      static MPI_Op op()
+      {
+        return Generic_MPI_Op<Type, BinaryFunction>::get();
+      }
+
+      static int count(int len)
+      {
+        return len;
+      }
+    };
+
+    template<typename Type, typename BinaryFunction>
+    struct MPIReduction<Type, BinaryFunction,
+                        void_t<std::enable_if_t<(ElementwiseReductionTraits<Type>::size > 1)
+                                                && sizeof(Type) == ElementwiseReductionTraits<Type>::size
+                                                * sizeof(typename ElementwiseReductionTraits<Type>::scalar_type)>,
+                               typename ScalarBinaryFunction<BinaryFunction,
+                                                             typename ElementwiseReductionTraits<Type>::scalar_type>::type> >
+    {
+      typedef typename ElementwiseReductionTraits<Type>::scalar_type Scalar;
+      typedef Scalar Value;
+      typedef typename ScalarBinaryFunction<BinaryFunction, Scalar>::type Function;
+
+      static MPI_Datatype type()
+      {
+        return MPITraits<Scalar>::getType();
+      }
+
+      static MPI_Op op()
+      {
+        return Generic_MPI_Op<Scalar, typename ScalarBinaryFunction<BinaryFunction, Scalar>::type>::get();
+      }
+
+      static int count(int len)
+      {
+        return len*ElementwiseReductionTraits<Type>::size;
+      }
+    };
+  }
+
 
   //=======================================================
   // use singleton pattern and template specialization to
@@ -144,7 +222,7 @@ namespace Dune
   public:
     //! Instantiation using a MPI communicator
     CollectiveCommunication (const MPI_Comm& c = MPI_COMM_WORLD)
-      : communicator(c)
+      : communicator(c), reproducibleSums_(false), hierarchical_(nullptr)
     {
       if(communicator!=MPI_COMM_NULL) {
         int initialized = 0;
@@ -171,12 +249,49 @@ namespace Dune
       return procs;
     }
 
+    //! @copydoc CollectiveCommunication::setReproducibleSums
+    void setReproducibleSums (bool reproducible)
+    {
+      reproducibleSums_ = reproducible;
+    }
+
+    //! @copydoc CollectiveCommunication::reproducibleSums
+    bool reproducibleSums () const
+    {
+      return reproducibleSums_;
+    }
+
+    /**
+     * @copydoc CollectiveCommunication::setHierarchical
+     *
+     * Enabling it is a collective operation on the communicator when it
+     * is done for the first time. The node communicators and the shared
+     * memory window are attached to the communicator and shared by all
+     * CollectiveCommunication objects using it. They are freed with the
+     * communicator, or by MPI_Finalize for MPI_COMM_WORLD. Requires MPI-3,
+     * with older versions the flat operations are used.
+     */
+    void setHierarchical (bool hierarchical)
+    {
+#if MPI_VERSION >= 3
+      hierarchical_ = hierarchical ? &Impl::HierarchicalCollectives::get(communicator) : nullptr;
+#else
+      DUNE_UNUSED_PARAMETER(hierarchical);
+#endif
+    }
+
+    //! @copydoc CollectiveCommunication::hierarchical
+    bool hierarchical () const
+    {
+      return hierarchical_ != nullptr;
+    }
+
     //! @copydoc CollectiveCommunication::sum
     template<typename T>
     T sum (const T& in) const
     {
       T out;
-      allreduce<std::plus<T> >(&in,&out,1);
+      sum(&in, &out, 1, HasExactSum<T>());
       return out;
     }
 
@@ -184,7 +299,7 @@ namespace Dune
     template<typename T>
     int sum (T* inout, int len) const
     {
-      return allreduce<std::plus<T> >(inout,len);
+      return sum(inout, inout, len, HasExactSum<T>());
     }
 
     //! @copydoc CollectiveCommunication::prod
@@ -239,6 +354,7 @@ namespace Dune
     //! @copydoc CollectiveCommunication::barrier
     int barrier () const
     {
+      CommunicationProfiler::Scope profile("CollectiveCommunication::barrier");
       return MPI_Barrier(communicator);
     }
 
@@ -246,6 +362,17 @@ namespace Dune
     template<typename T>
     int broadcast (T* inout, int len, int root) const
     {
+      CommunicationProfiler::Scope profile("CollectiveCommunication::broadcast");
+      if(me == root)
+        profile.send(-1, len*sizeof(T));
+      else
+        profile.receive(-1, len*sizeof(T));
+#if MPI_VERSION >= 3
+      if(hierarchical_ && std::is_trivially_copyable<T>::value) {
+        hierarchical_->broadcast(inout, len, root, MPITraits<T>::getType(), len);
+        return MPI_SUCCESS;
+      }
+#endif
       return MPI_Bcast(inout,len,MPITraits<T>::getType(),root,communicator);
     }
 
@@ -254,6 +381,10 @@ namespace Dune
     template<typename T>
     int gather (const T* in, T* out, int len, int root) const
     {
+      CommunicationProfiler::Scope profile("CollectiveCommunication::gather");
+      profile.send(-1, len*sizeof(T));
+      if(me == root)
+        profile.receive(-1, procs*len*sizeof(T));
       return MPI_Gather(const_cast<T*>(in),len,MPITraits<T>::getType(),
                         out,len,MPITraits<T>::getType(),
                         root,communicator);
@@ -263,6 +394,10 @@ namespace Dune
     template<typename T>
     int gatherv (const T* in, int sendlen, T* out, int* recvlen, int* displ, int root) const
     {
+      CommunicationProfiler::Scope profile("CollectiveCommunication::gatherv");
+      profile.send(-1, sendlen*sizeof(T));
+      if(me == root && profile.active())
+        profile.receive(-1, std::accumulate(recvlen, recvlen+procs, std::size_t(0))*sizeof(T));
       return MPI_Gatherv(const_cast<T*>(in),sendlen,MPITraits<T>::getType(),
                          out,recvlen,displ,MPITraits<T>::getType(),
                          root,communicator);
@@ -273,6 +408,10 @@ namespace Dune
     template<typename T>
     int scatter (const T* send, T* recv, int len, int root) const
     {
+      CommunicationProfiler::Scope profile("CollectiveCommunication::scatter");
+      if(me == root)
+        profile.send(-1, procs*len*sizeof(T));
+      profile.receive(-1, len*sizeof(T));
       return MPI_Scatter(const_cast<T*>(send),len,MPITraits<T>::getType(),
                          recv,len,MPITraits<T>::getType(),
                          root,communicator);
@@ -282,6 +421,10 @@ namespace Dune
     template<typename T>
     int scatterv (const T* send, int* sendlen, int* displ, T* recv, int recvlen, int root) const
     {
+      CommunicationProfiler::Scope profile("CollectiveCommunication::scatterv");
+      if(me == root && profile.active())
+        profile.send(-1, std::accumulate(sendlen, sendlen+procs, std::size_t(0))*sizeof(T));
+      profile.receive(-1, recvlen*sizeof(T));
       return MPI_Scatterv(const_cast<T*>(send),sendlen,displ,MPITraits<T>::getType(),
                           recv,recvlen,MPITraits<T>::getType(),
                           root,communicator);
@@ -297,6 +440,9 @@ namespace Dune
     template<typename T, typename T1>
     int allgather(const T* sbuf, int count, T1* rbuf) const
     {
+      CommunicationProfiler::Scope profile("CollectiveCommunication::allgather");
+      profile.send(-1, count*sizeof(T));
+      profile.receive(-1, procs*count*sizeof(T1));
       return MPI_Allgather(const_cast<T*>(sbuf), count, MPITraits<T>::getType(),
                            rbuf, count, MPITraits<T1>::getType(),
                            communicator);
@@ -306,6 +452,10 @@ namespace Dune
     template<typename T>
     int allgatherv (const T* in, int sendlen, T* out, int* recvlen, int* displ) const
     {
+      CommunicationProfiler::Scope profile("CollectiveCommunication::allgatherv");
+      profile.send(-1, sendlen*sizeof(T));
+      if(profile.active())
+        profile.receive(-1, std::accumulate(recvlen, recvlen+procs, std::size_t(0))*sizeof(T));
       return MPI_Allgatherv(const_cast<T*>(in),sendlen,MPITraits<T>::getType(),
                             out,recvlen,displ,MPITraits<T>::getType(),
                             communicator);
@@ -315,25 +465,210 @@ namespace Dune
     template<typename BinaryFunction, typename Type>
     int allreduce(Type* inout, int len) const
     {
-      Type* out = new Type[len];
-      int ret = allreduce<BinaryFunction>(inout,out,len);
-      std::copy(out, out+len, inout);
-      delete[] out;
-      return ret;
+      CommunicationProfiler::Scope profile("CollectiveCommunication::allreduce");
+      profile.send(-1, len*sizeof(Type));
+      profile.receive(-1, len*sizeof(Type));
+      typedef Impl::MPIReduction<Type, BinaryFunction> Reduction;
+      if(hierarchicalAllreduce<BinaryFunction>(inout, inout, len, std::is_trivially_copyable<Type>()))
+        return MPI_SUCCESS;
+      return MPI_Allreduce(MPI_IN_PLACE, inout, Reduction::count(len), Reduction::type(),
+                           Reduction::op(), communicator);
     }
 
     //! @copydoc CollectiveCommunication::allreduce(Type* in,Type* out,int len) const
     template<typename BinaryFunction, typename Type>
     int allreduce(const Type* in, Type* out, int len) const
     {
-      return MPI_Allreduce(const_cast<Type*>(in), out, len, MPITraits<Type>::getType(),
-                           (Generic_MPI_Op<Type, BinaryFunction>::get()),communicator);
+      CommunicationProfiler::Scope profile("CollectiveCommunication::allreduce");
+      profile.send(-1, len*sizeof(Type));
+      profile.receive(-1, len*sizeof(Type));
+      typedef Impl::MPIReduction<Type, BinaryFunction> Reduction;
+      if(hierarchicalAllreduce<BinaryFunction>(in, out, len, std::is_trivially_copyable<Type>()))
+        return MPI_SUCCESS;
+      return MPI_Allreduce(const_cast<Type*>(in), out, Reduction::count(len), Reduction::type(),
+                           Reduction::op(), communicator);
+    }
+
+    //! @copydoc CollectiveCommunication::allreduce(const std::tuple<std::pair<Type,BinaryFunction>...>&) const
+    template<typename... Type, typename... BinaryFunction>
+    std::tuple<Type...> allreduce(const std::tuple<std::pair<Type,BinaryFunction>...>& values) const
+    {
+      std::tuple<Type...> in = Impl::reductionValues(values, std::index_sequence_for<Type...>());
+      std::tuple<Type...> out;
+      allreduce<TupleBinaryFunction<BinaryFunction...> >(&in, &out, 1);
+      return out;
+    }
+
+    //! @copydoc CollectiveCommunication::iallreduce(const std::tuple<std::pair<Type,BinaryFunction>...>&) const
+    template<typename... Type, typename... BinaryFunction>
+    MPIFuture<std::tuple<Type...> >
+    iallreduce(const std::tuple<std::pair<Type,BinaryFunction>...>& values) const
+    {
+      return iallreduce<TupleBinaryFunction<BinaryFunction...> >(
+        Impl::reductionValues(values, std::index_sequence_for<Type...>()));
+    }
+
+    //! @copydoc CollectiveCommunication::iallreduce(const Type&) const
+    template<typename BinaryFunction, typename Type>
+    MPIFuture<Type> iallreduce(const Type& in) const
+    {
+      MPIFuture<Type> future(in);
+#if MPI_VERSION >= 3
+      typedef Impl::MPIReduction<Type, BinaryFunction> Reduction;
+      MPI_Iallreduce(&(future.buffers_->send), &(future.buffers_->recv), Reduction::count(1),
+                     Reduction::type(), Reduction::op(), communicator, &future.request_);
+#else
+      allreduce<BinaryFunction>(&(future.buffers_->send), &(future.buffers_->recv), 1);
+#endif
+      return future;
+    }
+
+    //! @copydoc CollectiveCommunication::iallreduce(const Type*,Type*,int) const
+    template<typename BinaryFunction, typename Type>
+    MPIFuture<void> iallreduce(const Type* in, Type* out, int len) const
+    {
+      MPIFuture<void> future(true);
+#if MPI_VERSION >= 3
+      typedef Impl::MPIReduction<Type, BinaryFunction> Reduction;
+      MPI_Iallreduce(const_cast<Type*>(in), out, Reduction::count(len), Reduction::type(),
+                     Reduction::op(), communicator, &future.request_);
+#else
+      allreduce<BinaryFunction>(in, out, len);
+#endif
+      return future;
+    }
+
+    //! @copydoc CollectiveCommunication::isum
+    template<typename T>
+    MPIFuture<T> isum (const T& in) const
+    {
+      return iallreduce<std::plus<T> >(in);
+    }
+
+    //! @copydoc CollectiveCommunication::iprod
+    template<typename T>
+    MPIFuture<T> iprod (const T& in) const
+    {
+      return iallreduce<std::multiplies<T> >(in);
+    }
+
+    //! @copydoc CollectiveCommunication::imin
+    template<typename T>
+    MPIFuture<T> imin (const T& in) const
+    {
+      return iallreduce<Min<T> >(in);
+    }
+
+    //! @copydoc CollectiveCommunication::imax
+    template<typename T>
+    MPIFuture<T> imax (const T& in) const
+    {
+      return iallreduce<Max<T> >(in);
+    }
+
+    //! @copydoc CollectiveCommunication::ibarrier
+    MPIFuture<void> ibarrier () const
+    {
+      MPIFuture<void> future(true);
+#if MPI_VERSION >= 3
+      MPI_Ibarrier(communicator, &future.request_);
+#else
+      barrier();
+#endif
+      return future;
+    }
+
+    //! @copydoc CollectiveCommunication::ibroadcast
+    template<typename T>
+    MPIFuture<void> ibroadcast (T* inout, int len, int root) const
+    {
+      MPIFuture<void> future(true);
+#if MPI_VERSION >= 3
+      MPI_Ibcast(inout,len,MPITraits<T>::getType(),root,communicator,&future.request_);
+#else
+      broadcast(inout, len, root);
+#endif
+      return future;
+    }
+
+    //! @copydoc CollectiveCommunication::iallgather
+    template<typename T, typename T1>
+    MPIFuture<void> iallgather(const T* sbuf, int count, T1* rbuf) const
+    {
+      MPIFuture<void> future(true);
+#if MPI_VERSION >= 3
+      MPI_Iallgather(const_cast<T*>(sbuf), count, MPITraits<T>::getType(),
+                     rbuf, count, MPITraits<T1>::getType(),
+                     communicator, &future.request_);
+#else
+      allgather(sbuf, count, rbuf);
+#endif
+      return future;
     }
 
   private:
+    //! Whether sums of T can be made reproducible with ExactSum
+    template<typename T>
+    using HasExactSum = std::integral_constant<bool, std::is_same<T,double>::value
+                                                     || std::is_same<T,float>::value>;
+
+    template<typename T>
+    int sum (const T* in, T* out, int len, std::false_type) const
+    {
+      if(in == out)
+        return allreduce<std::plus<T> >(out, len);
+      return allreduce<std::plus<T> >(in, out, len);
+    }
+
+    template<typename T>
+    int sum (const T* in, T* out, int len, std::true_type) const
+    {
+      if(!reproducibleSums_)
+        return sum(in, out, len, std::false_type());
+      std::vector<ExactSum> sums(in, in+len);
+      int ret = allreduce<std::plus<ExactSum> >(sums.data(), len);
+      for(int i=0; i<len; ++i)
+        out[i] = T(sums[i].value());
+      return ret;
+    }
+
+    // Reduce in two levels if enabled, returns whether it did
+    template<typename BinaryFunction, typename Type>
+    bool hierarchicalAllreduce (const Type* in, Type* out, int len, std::true_type) const
+    {
+#if MPI_VERSION >= 3
+      if(hierarchical_) {
+        typedef Impl::MPIReduction<Type, BinaryFunction> Reduction;
+        typedef typename Reduction::Value Value;
+        hierarchical_->allreduce(reinterpret_cast<const Value*>(in), reinterpret_cast<Value*>(out),
+                                 Reduction::count(len), typename Reduction::Function(),
+                                 Reduction::type(), Reduction::count(len), Reduction::op());
+        return true;
+      }
+#else
+      DUNE_UNUSED_PARAMETER(in);
+      DUNE_UNUSED_PARAMETER(out);
+      DUNE_UNUSED_PARAMETER(len);
+#endif
+      return false;
+    }
+
+    // Types that cannot be copied into shared memory are reduced flat
+    template<typename BinaryFunction, typename Type>
+    bool hierarchicalAllreduce (const Type*, Type*, int, std::false_type) const
+    {
+      return false;
+    }
+
     MPI_Comm communicator;
     int me;
     int procs;
+    bool reproducibleSums_;
+#if MPI_VERSION >= 3
+    Impl::HierarchicalCollectives* hierarchical_;
+#else
+    void* hierarchical_;
+#endif
   };
 } // namespace dune
 
@@ -0,0 +1,291 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifndef DUNE_COMMON_PARALLEL_MPIDATATYPEREGISTRY_HH
+#define DUNE_COMMON_PARALLEL_MPIDATATYPEREGISTRY_HH
+
+/*!
+   \file
+   \brief A cache of committed MPI datatypes, looked up by their structure.
+
+   \ingroup ParallelCommunication
+ */
+
+#if HAVE_MPI
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include <mpi.h>
+
+#include <dune/common/hash.hh>
+#include <dune/common/visibility.hh>
+
+namespace Dune
+{
+
+  /*! @brief Caches committed MPI datatypes by their structure.
+
+     Creating and committing a derived datatype is expensive compared to
+     using it. The registry returns the same committed type for the same
+     structure, so communicators that are rebuilt, or that build their
+     types on every communication, reuse the types of previous calls:
+     \code
+     MPI_Datatype type = MPIDatatypeRegistry::hindexed(n, lengths, displacements, MPI_DOUBLE);
+     // ... communicate
+     MPIDatatypeRegistry::release(type);
+     \endcode
+
+     Every call returning a type acquires a reference to it, which is
+     given back with release(). Types without references are kept for
+     reuse, up to setMaxUnused() of them; the least recently released
+     ones are freed first. The MPITraits of composite types never release
+     their types. All types are freed when MPI is finalized, e.g. by
+     MPIHelper, and release() does nothing afterwards.
+
+     The structure is described by a key of integers. The constructors
+     of the registry use keys starting with a positive tag. Keys of
+     acquire() should start with a negative one. Component types are part
+     of the key by their handle, so they have to stay committed while the
+     composite type is in use, as the types of MPITraits do.
+
+     The registry is not thread safe, only the thread calling MPI may use it.
+     \ingroup ParallelCommunication
+   */
+  class MPIDatatypeRegistry
+  {
+  public:
+    //! The description of the structure of a datatype
+    typedef std::vector<MPI_Aint> Key;
+
+    /*! @brief Get the committed type with the key, or create it.
+
+       @param create Creates the type described by the key, which is then
+       committed by the registry.
+     */
+    template<class Create>
+    static MPI_Datatype acquire (const Key& key, Create&& create);
+
+    //! A contiguous type of count elements of type base
+    static MPI_Datatype contiguous (int count, MPI_Datatype base);
+
+    //! An hindexed type of blocks of type base
+    static MPI_Datatype hindexed (int count, const int* lengths, const MPI_Aint* displacements,
+                                  MPI_Datatype base);
+
+    //! A struct type with the given extent
+    static MPI_Datatype structure (int count, const int* lengths, const MPI_Aint* displacements,
+                                   const MPI_Datatype* types, MPI_Aint extent);
+
+    /*! @brief Give back a reference to a type of the registry.
+
+       Other types, like predefined ones, are ignored.
+     */
+    static void release (MPI_Datatype type);
+
+    /*! @brief Set the number of unused types kept for reuse.
+
+       Defaults to 256.
+     */
+    static void setMaxUnused (std::size_t maxUnused)
+    {
+      storage().maxUnused = maxUnused;
+      storage().evict();
+    }
+
+    //! The number of types cached, used or not
+    static std::size_t size ()
+    {
+      return storage().entries.size();
+    }
+
+    //! The number of types created since the start of the program
+    static std::size_t created ()
+    {
+      return storage().created;
+    }
+
+  private:
+    struct KeyHash
+    {
+      std::size_t operator() (const Key& key) const
+      {
+        return hash_range(key.begin(), key.end());
+      }
+    };
+
+    struct Entry
+    {
+      MPI_Datatype type;
+      std::size_t references;
+      std::list<const Key*>::iterator unused;
+    };
+
+    struct Storage
+    {
+      Storage ()
+        : maxUnused(256), created(0), registered(false), finalized(false)
+      {}
+
+      // Free the least recently released types exceeding maxUnused
+      void evict ();
+
+      std::unordered_map<Key,Entry,KeyHash> entries;
+      // the keys of the types by handle
+      std::map<MPI_Fint,const Key*> keys;
+      // the keys of the types without references, least recently released first
+      std::list<const Key*> unused;
+      std::size_t maxUnused;
+      std::size_t created;
+      bool registered;
+      bool finalized;
+    };
+
+    // Never destroyed, as MPI may be finalized by the destructor of
+    // another static object, like the MPIHelper
+    DUNE_EXPORT static Storage& storage ()
+    {
+      static Storage* storage = new Storage;
+      return *storage;
+    }
+
+    // Append a component type to a key
+    static void append (Key& key, MPI_Datatype type)
+    {
+      key.push_back(MPI_Type_c2f(type));
+    }
+
+    static int freeAll (MPI_Comm, int, void*, void*);
+  };
+
+#ifndef DOXYGEN
+
+  template<class Create>
+  MPI_Datatype MPIDatatypeRegistry::acquire (const Key& key, Create&& create)
+  {
+    Storage& s = storage();
+    if(!s.registered) {
+      // The attributes of MPI_COMM_SELF are deleted first in MPI_Finalize
+      s.registered = true;
+      int keyval;
+      MPI_Comm_create_keyval(MPI_COMM_NULL_COPY_FN, &freeAll, &keyval, nullptr);
+      MPI_Comm_set_attr(MPI_COMM_SELF, keyval, nullptr);
+      MPI_Comm_free_keyval(&keyval);
+    }
+    auto found = s.entries.find(key);
+    if(found != s.entries.end()) {
+      Entry& entry = found->second;
+      if(entry.references++ == 0)
+        s.unused.erase(entry.unused);
+      return entry.type;
+    }
+    MPI_Datatype type = create();
+    MPI_Type_commit(&type);
+    ++s.created;
+    auto inserted = s.entries.emplace(key, Entry{type, 1, s.unused.end()});
+    s.keys[MPI_Type_c2f(type)] = &inserted.first->first;
+    return type;
+  }
+
+  inline MPI_Datatype MPIDatatypeRegistry::contiguous (int count, MPI_Datatype base)
+  {
+    Key key{1, count};
+    append(key, base);
+    return acquire(key, [&]
+    {
+      MPI_Datatype type;
+      MPI_Type_contiguous(count, base, &type);
+      return type;
+    });
+  }
+
+  inline MPI_Datatype MPIDatatypeRegistry::hindexed (int count, const int* lengths,
+                                                     const MPI_Aint* displacements, MPI_Datatype base)
+  {
+    Key key;
+    key.reserve(2*count+3);
+    key.push_back(2);
+    key.push_back(count);
+    key.insert(key.end(), lengths, lengths+count);
+    key.insert(key.end(), displacements, displacements+count);
+    append(key, base);
+    return acquire(key, [&]
+    {
+      MPI_Datatype type;
+      MPI_Type_create_hindexed(count, const_cast<int*>(lengths), const_cast<MPI_Aint*>(displacements),
+                               base, &type);
+      return type;
+    });
+  }
+
+  inline MPI_Datatype MPIDatatypeRegistry::structure (int count, const int* lengths,
+                                                      const MPI_Aint* displacements,
+                                                      const MPI_Datatype* types, MPI_Aint extent)
+  {
+    Key key;
+    key.reserve(3*count+3);
+    key.push_back(3);
+    key.push_back(count);
+    key.insert(key.end(), lengths, lengths+count);
+    key.insert(key.end(), displacements, displacements+count);
+    for(int i=0; i<count; ++i)
+      append(key, types[i]);
+    key.push_back(extent);
+    return acquire(key, [&]
+    {
+      MPI_Datatype tmp, type;
+      MPI_Type_create_struct(count, const_cast<int*>(lengths), const_cast<MPI_Aint*>(displacements),
+                             const_cast<MPI_Datatype*>(types), &tmp);
+      MPI_Type_create_resized(tmp, 0, extent, &type);
+      MPI_Type_free(&tmp);
+      return type;
+    });
+  }
+
+  inline void MPIDatatypeRegistry::release (MPI_Datatype type)
+  {
+    Storage& s = storage();
+    if(s.finalized || s.keys.empty() || type == MPI_DATATYPE_NULL)
+      return;
+    auto key = s.keys.find(MPI_Type_c2f(type));
+    if(key == s.keys.end())
+      return;
+    Entry& entry = s.entries.find(*key->second)->second;
+    if(--entry.references == 0) {
+      entry.unused = s.unused.insert(s.unused.end(), key->second);
+      s.evict();
+    }
+  }
+
+  inline void MPIDatatypeRegistry::Storage::evict ()
+  {
+    while(unused.size() > maxUnused) {
+      auto entry = entries.find(*unused.front());
+      unused.pop_front();
+      keys.erase(MPI_Type_c2f(entry->second.type));
+      MPI_Type_free(&entry->second.type);
+      entries.erase(entry);
+    }
+  }
+
+  inline int MPIDatatypeRegistry::freeAll (MPI_Comm, int, void*, void*)
+  {
+    Storage& s = storage();
+    for(auto& entry : s.entries)
+      MPI_Type_free(&entry.second.type);
+    s.entries.clear();
+    s.keys.clear();
+    s.unused.clear();
+    s.finalized = true;
+    return MPI_SUCCESS;
+  }
+
+#endif // DOXYGEN
+
+} // namespace Dune
+
+#endif // HAVE_MPI
+
+#endif
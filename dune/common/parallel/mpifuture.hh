@@ -0,0 +1,189 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifndef DUNE_COMMON_PARALLEL_MPIFUTURE_HH
+#define DUNE_COMMON_PARALLEL_MPIFUTURE_HH
+
+/*!
+   \file
+   \brief Futures returned by the nonblocking collective communication
+   methods of CollectiveCommunication<MPI_Comm>.
+
+   \ingroup ParallelCommunication
+ */
+
+#if HAVE_MPI
+
+#include <memory>
+#include <utility>
+
+#include <mpi.h>
+
+#include <dune/common/exceptions.hh>
+
+namespace Dune
+{
+
+  template<class> class CollectiveCommunication;
+
+  namespace Impl
+  {
+    /*! @brief The request handling shared by all MPIFutures.
+
+       The request is completed on destruction, as MPI might still access
+       the buffers of the operation otherwise.
+     */
+    class MPIFutureBase
+    {
+    public:
+      MPIFutureBase()
+        : request_(MPI_REQUEST_NULL), valid_(false)
+      {}
+
+      MPIFutureBase(MPIFutureBase&& other)
+        : request_(other.request_), valid_(other.valid_)
+      {
+        other.request_ = MPI_REQUEST_NULL;
+        other.valid_ = false;
+      }
+
+      MPIFutureBase& operator=(MPIFutureBase&& other)
+      {
+        complete();
+        request_ = other.request_;
+        valid_ = other.valid_;
+        other.request_ = MPI_REQUEST_NULL;
+        other.valid_ = false;
+        return *this;
+      }
+
+      ~MPIFutureBase()
+      {
+        complete();
+      }
+
+      //! Whether the future belongs to an operation whose result was not retrieved yet
+      bool valid() const
+      {
+        return valid_;
+      }
+
+      //! Test without blocking whether the operation completed
+      bool ready()
+      {
+        if(request_ == MPI_REQUEST_NULL)
+          return true;
+        int flag;
+        MPI_Test(&request_, &flag, MPI_STATUS_IGNORE);
+        return flag;
+      }
+
+      //! Block until the operation completed
+      void wait()
+      {
+        if(!valid_)
+          DUNE_THROW(InvalidStateException, "The future belongs to no operation");
+        complete();
+      }
+
+    protected:
+      void complete()
+      {
+        if(request_ != MPI_REQUEST_NULL)
+          MPI_Wait(&request_, MPI_STATUS_IGNORE);
+      }
+
+      MPI_Request request_;
+      bool valid_;
+    };
+  }
+
+  /*! @brief A future for the result of a nonblocking collective MPI operation.
+
+     The nonblocking methods of CollectiveCommunication<MPI_Comm> return it.
+     If the future is destroyed before the operation completed, the
+     destructor waits for its completion. Futures can be moved but not copied.
+
+     \tparam T The type of the result. The future owns the send and the
+     receive buffer of the operation.
+     \ingroup ParallelCommunication
+   */
+  template<class T>
+  class MPIFuture : public Impl::MPIFutureBase
+  {
+    friend class CollectiveCommunication<MPI_Comm>;
+
+    struct Buffers
+    {
+      Buffers(const T& s)
+        : send(s), recv(s)
+      {}
+      T send;
+      T recv;
+    };
+
+  public:
+    //! Construct an invalid future
+    MPIFuture() = default;
+
+    MPIFuture(MPIFuture&&) = default;
+
+    MPIFuture& operator=(MPIFuture&&) = default;
+
+    ~MPIFuture()
+    {
+      // MPI must not access the buffers after they were freed
+      complete();
+    }
+
+    //! Wait for the completion of the operation and retrieve its result, the future becomes invalid
+    T get()
+    {
+      wait();
+      valid_ = false;
+      return std::move(buffers_->recv);
+    }
+
+  private:
+    explicit MPIFuture(const T& send)
+      : buffers_(new Buffers(send))
+    {
+      valid_ = true;
+    }
+
+    std::unique_ptr<Buffers> buffers_;
+  };
+
+  /*! @brief A future for a nonblocking collective MPI operation on buffers
+     owned by the caller.
+
+     The buffers must stay valid until the operation completed.
+     \ingroup ParallelCommunication
+   */
+  template<>
+  class MPIFuture<void> : public Impl::MPIFutureBase
+  {
+    friend class CollectiveCommunication<MPI_Comm>;
+
+  public:
+    //! Construct an invalid future
+    MPIFuture() = default;
+
+    //! Wait for the completion of the operation, the future becomes invalid
+    void get()
+    {
+      wait();
+      valid_ = false;
+    }
+
+  private:
+    explicit MPIFuture(bool valid)
+    {
+      valid_ = valid;
+    }
+  };
+
+}
+
+#endif // HAVE_MPI
+
+#endif
@@ -11,6 +11,8 @@
 #ifndef DUNE_COMMON_MPIGUARD_HH
 #define DUNE_COMMON_MPIGUARD_HH
 
+#include <utility>
+
 #include "mpihelper.hh"
 #include "collectivecommunication.hh"
 #include "mpicollectivecommunication.hh"
@@ -32,6 +34,10 @@ namespace Dune
     virtual int rank() = 0;
     virtual int size() = 0;
     virtual int sum(int i) = 0;
+    // start a nonblocking sum, test and wait for its result
+    virtual void startSum(int i) = 0;
+    virtual bool sumReady() = 0;
+    virtual int finishSum() = 0;
     // create a new GuardCommunicator pointer
     template <class C>
     static GuardCommunicator * create(const C & c);
@@ -52,11 +58,15 @@ namespace Dune
       : public GuardCommunicator
     {
       const CollectiveCommunication<T> comm;
+      decltype(std::declval<const CollectiveCommunication<T>&>().isum(0)) future;
       GenericGuardCommunicator(const CollectiveCommunication<T> & c) :
         comm(c) {}
       int rank() override { return comm.rank(); };
       int size() override { return comm.size(); };
       int sum(int i) override { return comm.sum(i); }
+      void startSum(int i) override { future = comm.isum(i); }
+      bool sumReady() override { return future.ready(); }
+      int finishSum() override { return future.get(); }
     };
 
 #if HAVE_MPI
@@ -111,6 +121,42 @@ namespace Dune
      other processes are informed that an error occurred and the
      MPIGuard throws an exception of type MPIGuardError.
 
+     Each finalize call sums the errors over the communicator. To save
+     reductions, guards can be nested: a guard constructed from another
+     guard does not communicate, but passes its errors on to the enclosing
+     guard, whose finalize call reports them on all processes.
+     @code
+     {
+       MPIGuard guard(...);
+       for(auto& phase : phases) {
+         MPIGuard phaseGuard(guard);
+         phase.run();
+         phaseGuard.finalize();
+       }
+       // throws on all processes if any phase failed on any process
+       guard.finalize();
+     }
+     @endcode
+
+     With setNonblocking() finalize starts a nonblocking sum of the errors
+     instead and returns immediately. The sum is checked by the next call
+     of finalize, or by wait(), so the reduction overlaps with the work
+     in between.
+     @code
+     {
+       MPIGuard guard(..., false);
+       guard.setNonblocking();
+       for(auto& phase : phases) {
+         guard.reactivate();
+         phase.run();
+         // throws if the previous phase failed on any process
+         guard.finalize();
+       }
+       // throws if the last phase failed on any process
+       guard.wait();
+     }
+     @endcode
+
      @note You can initialize the MPIGuard from different types of communication objects:
      - MPIHelper
      - CollectiveCommunication
@@ -119,7 +165,13 @@ namespace Dune
   class MPIGuard
   {
     GuardCommunicator * comm_;
+    MPIGuard * parent_;
     bool active_;
+    bool nonblocking_;
+    // errors reported by nested guards
+    bool failed_;
+    // a nonblocking sum of the errors was started and not checked yet
+    bool pending_;
 
     // we don't want to copy this class
     MPIGuard (const MPIGuard &);
@@ -132,7 +184,8 @@ namespace Dune
     MPIGuard (bool active=true) :
       comm_(GuardCommunicator::create(
               MPIHelper::getCollectiveCommunication())),
-      active_(active)
+      parent_(nullptr), active_(active), nonblocking_(false),
+      failed_(false), pending_(false)
     {}
 
     /*! @brief create an MPIGuard operating on the Communicator of a special Dune::MPIHelper m
@@ -143,7 +196,22 @@ namespace Dune
     MPIGuard (MPIHelper & m, bool active=true) :
       comm_(GuardCommunicator::create(
               m.getCollectiveCommunication())),
-      active_(active)
+      parent_(nullptr), active_(active), nonblocking_(false),
+      failed_(false), pending_(false)
+    {}
+
+    /*! @brief create an MPIGuard nested into another guard
+
+       The nested guard does not communicate. Errors detected by it are
+       reported by the next finalize call of the enclosing guard, which
+       has to outlive it.
+
+       @param parent the enclosing guard
+       @param active should the MPIGuard be active upon creation?
+     */
+    MPIGuard (MPIGuard & parent, bool active=true) :
+      comm_(nullptr), parent_(&parent), active_(active), nonblocking_(false),
+      failed_(false), pending_(false)
     {}
 
     /*! @brief create an MPIGuard operating on an arbitrary communicator.
@@ -159,10 +227,14 @@ namespace Dune
     template <class C>
     MPIGuard (const C & comm, bool active=true) :
       comm_(GuardCommunicator::create(comm)),
-      active_(active)
+      parent_(nullptr), active_(active), nonblocking_(false),
+      failed_(false), pending_(false)
     {}
 
     /*! @brief destroy the guard and check for undetected exceptions
+
+       A pending nonblocking check is completed, but its errors are not
+       thrown, call wait() before to get them.
      */
     ~MPIGuard()
     {
@@ -171,9 +243,47 @@ namespace Dune
         active_ = false;
         finalize(false);
       }
+      complete();
       delete comm_;
     }
 
+    /*! @brief check the errors by nonblocking reductions.
+
+       finalize() then only starts the sum of the errors, which is checked
+       by the next call of finalize() or wait(). Guards nested into this
+       one are not affected, they never communicate.
+
+       @param nonblocking whether to check the errors by nonblocking reductions
+     */
+    void setNonblocking(bool nonblocking = true)
+    {
+      wait();
+      nonblocking_ = nonblocking && comm_;
+    }
+
+    /*! @brief whether a nonblocking check of the errors is still running.
+     */
+    bool pending()
+    {
+      return pending_ && !comm_->sumReady();
+    }
+
+    /*! @brief wait for the nonblocking check of the errors started by the last finalize call.
+
+       Throws MPIGuardError if an error occurred on any of the processes.
+       Returns immediately if no check is pending.
+     */
+    void wait()
+    {
+      int result = complete();
+      if (result>0)
+      {
+        DUNE_THROW(MPIGuardError, "Terminating process "
+                   << comm_->rank() << " due to "
+                   << result << " remote error(s)");
+      }
+    }
+
     /*! @brief reactivate the guard.
 
        If the guard is still active finalize(true) is called first.
@@ -192,13 +302,44 @@ namespace Dune
        (or exception) occurred on any of the processors in the
        communicator.
 
+       A nested guard passes its errors on to the enclosing guard instead.
+       A nonblocking guard throws the errors of the previous call and
+       starts the check of this one.
+
        @param success inform the guard about possible errors
      */
     void finalize(bool success = true)
     {
-      int result = success ? 0 : 1;
+      int result = (success && !failed_) ? 0 : 1;
       bool was_active = active_;
       active_ = false;
+      failed_ = false;
+      if (parent_)
+      {
+        if (result>0)
+          parent_->failed_ = true;
+        return;
+      }
+      if (nonblocking_)
+      {
+        // After an error all processes stop communicating, including
+        // those unwinding.
+        int previous = complete();
+        if (previous>0)
+        {
+          if (was_active)
+            DUNE_THROW(MPIGuardError, "Terminating process "
+                       << comm_->rank() << " due to "
+                       << previous << " remote error(s)");
+          return;
+        }
+        comm_->startSum(result);
+        pending_ = true;
+        // while unwinding the check is completed right away
+        if (!was_active)
+          complete();
+        return;
+      }
       result = comm_->sum(result);
       if (result>0 && was_active)
       {
@@ -207,8 +348,19 @@ namespace Dune
                    << result << " remote error(s)");
       }
     }
+
+  private:
+    // complete the pending nonblocking sum and return the number of errors
+    int complete()
+    {
+      if (!pending_)
+        return 0;
+      pending_ = false;
+      return comm_->finishSum();
+    }
   };
 
+
 }
 
 #endif // DUNE_COMMON_MPIGUARD_HH
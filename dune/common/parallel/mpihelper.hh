@@ -3,6 +3,8 @@
 #ifndef DUNE_MPIHELPER
 #define DUNE_MPIHELPER
 
+#include <cstddef>
+
 #if HAVE_MPI
 #include <cassert>
 #endif
@@ -139,6 +141,24 @@ namespace Dune
       return singleton;
     }
 
+    /**
+     * @brief Get the singleton instance of the helper.
+     *
+     * The thread level is ignored, without MPI there are no restrictions.
+     */
+    static FakeMPIHelper& instance(int argc, char** argv, int threadLevel)
+    {
+      (void)threadLevel;
+      return instance(argc, argv);
+    }
+
+    /**
+     * @brief The thread levels of MPI, in increasing order.
+     */
+    enum {
+      threadSingle, threadFunneled, threadSerialized, threadMultiple
+    };
+
     /**
      * @brief return rank of process, i.e. zero
      */
@@ -148,7 +168,56 @@ namespace Dune
      */
     int size () const { return 1; }
 
+    /**
+     * @brief Return the provided thread level, i.e. threadMultiple
+     */
+    int threadLevel () const { return threadMultiple; }
+
+    /**
+     * @brief Get a communicator with the processes on this node
+     *
+     * \returns a fake communicator
+     */
+    MPICommunicator nodeCommunicator () const
+    {
+      return getCommunicator();
+    }
+
+    /**
+     * @brief Get a communicator with one process per node
+     *
+     * \returns a fake communicator
+     */
+    MPICommunicator interNodeCommunicator () const
+    {
+      return getCommunicator();
+    }
+
+    /**
+     * @brief Set the default number of threads the communicators use
+     * for gathering and scattering data.
+     */
+    static void setCommunicationThreads (std::size_t threads)
+    {
+      communicationThreadsStorage() = threads;
+    }
+
+    /**
+     * @brief Get the default number of threads the communicators use
+     * for gathering and scattering data.
+     */
+    static std::size_t communicationThreads ()
+    {
+      return communicationThreadsStorage();
+    }
+
   private:
+    DUNE_EXPORT static std::size_t& communicationThreadsStorage()
+    {
+      static std::size_t threads = 1;
+      return threads;
+    }
+
     FakeMPIHelper() {}
     FakeMPIHelper(const FakeMPIHelper&);
     FakeMPIHelper& operator=(const FakeMPIHelper);
@@ -220,12 +289,45 @@ namespace Dune
      * @param argv The arguments provided to main.
      */
     DUNE_EXPORT static MPIHelper& instance(int& argc, char**& argv)
+    {
+      return instance(argc, argv, threadSingle);
+    }
+
+    /**
+     * @brief Get the singleton instance of the helper and request a
+     * thread level from MPI.
+     *
+     * If MPI is initialized by the helper, MPI_Init_thread is called with
+     * the thread level. Only the first call of instance() initializes
+     * MPI, later calls return the same instance regardless of the thread
+     * level. Check the thread level provided by MPI with threadLevel().
+     * \code
+     * MPIHelper& helper = MPIHelper::instance(argc, argv, MPIHelper::threadFunneled);
+     * if(helper.threadLevel() >= MPIHelper::threadFunneled)
+     *   MPIHelper::setCommunicationThreads(4);
+     * \endcode
+     * @param argc The number of arguments provided to main.
+     * @param argv The arguments provided to main.
+     * @param threadLevel The requested thread level, one of threadSingle,
+     * threadFunneled, threadSerialized and threadMultiple.
+     */
+    DUNE_EXPORT static MPIHelper& instance(int& argc, char**& argv, int threadLevel)
     {
       // create singleton instance
-      static MPIHelper singleton (argc, argv);
+      static MPIHelper singleton (argc, argv, threadLevel);
       return singleton;
     }
 
+    /**
+     * @brief The thread levels of MPI, in increasing order.
+     */
+    enum {
+      threadSingle = MPI_THREAD_SINGLE,
+      threadFunneled = MPI_THREAD_FUNNELED,
+      threadSerialized = MPI_THREAD_SERIALIZED,
+      threadMultiple = MPI_THREAD_MULTIPLE
+    };
+
     /**
      * @brief return rank of process
      */
@@ -235,15 +337,87 @@ namespace Dune
      */
     int size () const { return size_; }
 
+    /**
+     * @brief Return the thread level provided by MPI
+     */
+    int threadLevel () const { return threadLevel_; }
+
+    /**
+     * @brief Get a communicator with the processes on this node
+     *
+     * The processes that can share memory form a node. With MPI versions
+     * before 3 every process forms a node of its own.
+     *
+     * The communicator is created on the first call, which is a
+     * collective operation on MPI_COMM_WORLD. It is freed before
+     * MPI_Finalize.
+     */
+    MPICommunicator nodeCommunicator ()
+    {
+      createNodeCommunicators();
+      return nodeCommunicator_;
+    }
+
+    /**
+     * @brief Get a communicator with one process per node
+     *
+     * It contains the processes with the same rank in their
+     * nodeCommunicator(), so the communicator of the processes with rank
+     * zero connects all nodes. The ranks are ordered as in MPI_COMM_WORLD.
+     *
+     * The communicator is created on the first call, which is a
+     * collective operation on MPI_COMM_WORLD. It is freed before
+     * MPI_Finalize.
+     */
+    MPICommunicator interNodeCommunicator ()
+    {
+      createNodeCommunicators();
+      return interNodeCommunicator_;
+    }
+
+    /**
+     * @brief Set the default number of threads the communicators use
+     * for gathering and scattering data.
+     *
+     * Only the calling thread communicates via MPI. Therefore the threads
+     * are only used if MPI was initialized with at least MPI_THREAD_FUNNELED.
+     * The default is one, i.e. no additional threads.
+     *
+     * @see BufferedCommunicator::setThreads
+     */
+    static void setCommunicationThreads (std::size_t threads)
+    {
+      communicationThreadsStorage() = threads;
+    }
+
+    /**
+     * @brief Get the default number of threads the communicators use
+     * for gathering and scattering data.
+     */
+    static std::size_t communicationThreads ()
+    {
+      return communicationThreadsStorage();
+    }
+
   private:
+    DUNE_EXPORT static std::size_t& communicationThreadsStorage()
+    {
+      static std::size_t threads = 1;
+      return threads;
+    }
+
     int rank_;
     int size_;
+    int threadLevel_;
     bool initializedHere_;
+    MPI_Comm nodeCommunicator_;
+    MPI_Comm interNodeCommunicator_;
     void prevent_warning(int){}
 
-    //! \brief calls MPI_Init with argc and argv as parameters
-    MPIHelper(int& argc, char**& argv)
-    : initializedHere_(false)
+    //! \brief calls MPI_Init or MPI_Init_thread with argc and argv as parameters
+    MPIHelper(int& argc, char**& argv, int threadLevel)
+    : initializedHere_(false), nodeCommunicator_(MPI_COMM_NULL),
+      interNodeCommunicator_(MPI_COMM_NULL)
     {
       int wasInitialized = -1;
       MPI_Initialized( &wasInitialized );
@@ -251,24 +425,37 @@ namespace Dune
       {
         rank_ = -1;
         size_ = -1;
-        static int is_initialized = MPI_Init(&argc, &argv);
+        int provided;
+        static int is_initialized = threadLevel == threadSingle ? MPI_Init(&argc, &argv)
+                                    : MPI_Init_thread(&argc, &argv, threadLevel, &provided);
         prevent_warning(is_initialized);
         initializedHere_ = true;
       }
 
       MPI_Comm_rank(MPI_COMM_WORLD,&rank_);
       MPI_Comm_size(MPI_COMM_WORLD,&size_);
+      MPI_Query_thread(&threadLevel_);
 
       assert( rank_ >= 0 );
       assert( size_ >= 1 );
 
       dverb << "Called  MPI_Init on p=" << rank_ << "!" << std::endl;
+      if(initializedHere_ && threadLevel_ < threadLevel && rank_ == 0)
+        dwarn << "MPI provides thread level " << threadLevel_ << " instead of "
+              << threadLevel << std::endl;
     }
     //! \brief calls MPI_Finalize
     ~MPIHelper()
     {
       int wasFinalized = -1;
       MPI_Finalized( &wasFinalized );
+      if(!wasFinalized)
+      {
+        if(nodeCommunicator_ != MPI_COMM_NULL)
+          MPI_Comm_free(&nodeCommunicator_);
+        if(interNodeCommunicator_ != MPI_COMM_NULL)
+          MPI_Comm_free(&interNodeCommunicator_);
+      }
       if(!wasFinalized && initializedHere_)
       {
         MPI_Finalize();
@@ -276,6 +463,21 @@ namespace Dune
       }
 
     }
+
+    void createNodeCommunicators()
+    {
+      if(nodeCommunicator_ != MPI_COMM_NULL)
+        return;
+#if MPI_VERSION >= 3
+      MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank_, MPI_INFO_NULL,
+                          &nodeCommunicator_);
+#else
+      MPI_Comm_dup(MPI_COMM_SELF, &nodeCommunicator_);
+#endif
+      int nodeRank;
+      MPI_Comm_rank(nodeCommunicator_, &nodeRank);
+      MPI_Comm_split(MPI_COMM_WORLD, nodeRank, rank_, &interNodeCommunicator_);
+    }
     MPIHelper(const MPIHelper&);
     MPIHelper& operator=(const MPIHelper);
   };
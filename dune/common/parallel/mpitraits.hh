@@ -22,6 +22,8 @@
 
 #include <mpi.h>
 
+#include <dune/common/parallel/mpidatatyperegistry.hh>
+
 namespace Dune
 {
   /**
@@ -32,6 +34,9 @@ namespace Dune
    * \code
    * static MPI_Datatype getType();
    * \endcode
+   * Derived types are taken from the MPIDatatypeRegistry, so types with
+   * the same layout share one committed type, which is freed by
+   * MPI_Finalize.
    */
   template<typename T>
   struct MPITraits
@@ -44,10 +49,8 @@ namespace Dune
   public:
     static inline MPI_Datatype getType()
     {
-      if(datatype==MPI_DATATYPE_NULL) {
-        MPI_Type_contiguous(sizeof(T),MPI_BYTE,&datatype);
-        MPI_Type_commit(&datatype);
-      }
+      if(datatype==MPI_DATATYPE_NULL)
+        datatype = MPIDatatypeRegistry::contiguous(sizeof(T), MPI_BYTE);
       return datatype;
     }
 
@@ -92,8 +95,7 @@ namespace Dune
     static inline MPI_Datatype getType()
     {
       if(datatype==MPI_DATATYPE_NULL) {
-        MPI_Type_contiguous(n, MPITraits<K>::getType(), &vectortype);
-        MPI_Type_commit(&vectortype);
+        vectortype = MPIDatatypeRegistry::contiguous(n, MPITraits<K>::getType());
         FieldVector<K,n> fvector;
         MPI_Aint base;
         MPI_Aint displ;
@@ -102,8 +104,8 @@ namespace Dune
         displ -= base;
         int length[1]={1};
 
-        MPI_Type_create_struct(1, length, &displ, &vectortype, &datatype);
-        MPI_Type_commit(&datatype);
+        datatype = MPIDatatypeRegistry::structure(1, length, &displ, &vectortype,
+                                                  sizeof(FieldVector<K,n>));
       }
       return datatype;
     }
@@ -128,9 +130,8 @@ namespace Dune
     static inline MPI_Datatype getType()
     {
       if(datatype==MPI_DATATYPE_NULL) {
-        MPI_Type_contiguous(bigunsignedint<k>::n, MPITraits<std::uint16_t>::getType(),
-                            &vectortype);
-        //MPI_Type_commit(&vectortype);
+        vectortype = MPIDatatypeRegistry::contiguous(bigunsignedint<k>::n,
+                                                     MPITraits<std::uint16_t>::getType());
         bigunsignedint<k> data;
         MPI_Aint base;
         MPI_Aint displ;
@@ -138,8 +139,8 @@ namespace Dune
         MPI_Get_address(&(data.digit), &displ);
         displ -= base;
         int length[1]={1};
-        MPI_Type_create_struct(1, length, &displ, &vectortype, &datatype);
-        MPI_Type_commit(&datatype);
+        datatype = MPIDatatypeRegistry::structure(1, length, &displ, &vectortype,
+                                                  sizeof(bigunsignedint<k>));
       }
       return datatype;
     }
@@ -175,13 +176,7 @@ namespace Dune
       disp[0] = offsetof(Pair, first);
       disp[1] = offsetof(Pair, second);
 
-      MPI_Datatype tmp;
-      MPI_Type_create_struct(2, length, disp, types, &tmp);
-
-      MPI_Type_create_resized(tmp, 0, sizeof(Pair), &type);
-      MPI_Type_commit(&type);
-
-      MPI_Type_free(&tmp);
+      type = MPIDatatypeRegistry::structure(2, length, disp, types, sizeof(Pair));
     }
     return type;
   }
@@ -297,13 +297,7 @@ namespace Dune
       MPI_Get_address(&(rep.attribute_), &disp);
       disp -= base;
 
-      MPI_Datatype tmp;
-      MPI_Type_create_struct(1, &length, &disp, types, &tmp);
-
-      MPI_Type_create_resized(tmp, 0, sizeof(ParallelLocalIndex<T>), &type);
-      MPI_Type_commit(&type);
-
-      MPI_Type_free(&tmp);
+      type = MPIDatatypeRegistry::structure(1, &length, &disp, types, sizeof(ParallelLocalIndex<T>));
     }
     return type;
   }
@@ -0,0 +1,362 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifndef DUNE_COMMON_PARALLEL_REDISTRIBUTION_HH
+#define DUNE_COMMON_PARALLEL_REDISTRIBUTION_HH
+
+/*!
+   \file
+   \brief Moves the indices of a parallel index set and their data to
+   other processes, e.g. after repartitioning.
+
+   \ingroup ParallelCommunication
+ */
+
+#if HAVE_MPI
+
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include <mpi.h>
+
+#include <dune/common/exceptions.hh>
+#include <dune/common/parallel/communicationprofiler.hh>
+#include <dune/common/parallel/indexset.hh>
+#include <dune/common/parallel/mpitraits.hh>
+#include <dune/common/parallel/sparseexchange.hh>
+
+namespace Dune
+{
+
+  namespace Impl
+  {
+    //! The buffer passed to the data handles of a Redistribution
+    template<class T>
+    class RedistributionBuffer
+    {
+    public:
+      RedistributionBuffer ()
+        : position_(0)
+      {}
+
+      //! Write an item to the buffer
+      void write (const T& data)
+      {
+        data_.push_back(data);
+      }
+
+      //! Read the next item from the buffer
+      void read (T& data)
+      {
+        data = data_[position_++];
+      }
+
+      std::vector<T>& data ()
+      {
+        return data_;
+      }
+
+    private:
+      std::vector<T> data_;
+      std::size_t position_;
+    };
+  }
+
+  /*! @brief Moves indices and their data to other processes.
+
+     After repartitioning, each process knows the new owner of each of its
+     indices. build() sends the indices to their targets and sets up the
+     new index set, which numbers the local indices in the order of the
+     global indices. redistribute() then moves the data of the indices:
+     \code
+     std::vector<int> targets(oldSet.size());
+     for(const auto& pair : oldSet)
+       targets[pair.local()] = pair.local().attribute() == owner ? partition(pair.global()) : -1;
+     Redistribution<ParallelIndexSet> redistribution(MPI_COMM_WORLD);
+     redistribution.build(oldSet, targets, newSet);
+     redistribution.redistribute(handle);
+     \endcode
+
+     The processes do not need to know from which processes they receive.
+     build() exchanges the indices with one sparse all-to-all, using a
+     nonblocking barrier with MPI-3. Afterwards the plan is known on both
+     sides, so redistribute() exchanges the data with the processes
+     concerned only, and may be called for several data handles.
+
+     The global indices and the attributes are sent bytewise, so they have
+     to be trivially copyable. The local indices have to be ParallelLocalIndex.
+     \ingroup ParallelCommunication
+   */
+  template<class T>
+  class Redistribution
+  {
+  public:
+    //! The type of the index set
+    typedef T ParallelIndexSet;
+    //! The type of the global index
+    typedef typename ParallelIndexSet::GlobalIndex GlobalIndex;
+    //! The type of the local index
+    typedef typename ParallelIndexSet::LocalIndex LocalIndex;
+    //! The type of the attribute
+    typedef typename LocalIndex::Attribute Attribute;
+
+    //! Redistribute between the processes of a communicator
+    explicit Redistribution (MPI_Comm comm)
+      : comm_(comm)
+    {
+      MPI_Comm_rank(comm_, &rank_);
+    }
+
+    /*! @brief Compute the new index set and the plan for moving the data.
+
+       This is a collective operation.
+       @param oldSet The current indices of this process.
+       @param targets The rank of the new process of each index by local
+       index, or a negative number for indices that are not moved, like
+       copies of indices owned by other processes.
+       @param newSet Takes the indices sent to this process, with their
+       attributes and public flags. It has to be in GROUND state.
+       @throws InvalidIndexSetState if a global index was sent to a
+       process several times.
+     */
+    void build (const ParallelIndexSet& oldSet, const std::vector<int>& targets,
+                ParallelIndexSet& newSet);
+
+    /*! @brief Move the data of the indices to their new processes.
+
+       This is a collective operation. The handle has the interface of the
+       data handles of VariableSizeCommunicator, see
+       VariableSizeCommunicator::forward(). The index passed to size() and
+       gather() is the local index in the old index set, the one passed to
+       scatter() the local index in the new index set.
+     */
+    template<class DataHandle>
+    void redistribute (DataHandle& handle) const;
+
+    //! The number of indices sent to each process, by rank
+    std::map<int,std::size_t> sendSizes () const
+    {
+      std::map<int,std::size_t> sizes;
+      for(const auto& list : sendLists_)
+        sizes[list.first] = list.second.size();
+      return sizes;
+    }
+
+    //! The number of indices received from each process, by rank
+    std::map<int,std::size_t> receiveSizes () const
+    {
+      std::map<int,std::size_t> sizes;
+      for(const auto& list : receiveLists_)
+        sizes[list.first] = list.second.size();
+      return sizes;
+    }
+
+  private:
+    struct Record
+    {
+      GlobalIndex global;
+      Attribute attribute;
+      bool isPublic;
+    };
+
+    static_assert(std::is_trivially_copyable<Record>::value,
+                  "The global indices and attributes have to be trivially copyable");
+
+    // consecutive builds alternate between the two plan tags
+    enum { planTag = 337, sizeTag = 338, dataTag = 339, otherPlanTag = 340 };
+
+    //! Exchange the records with the processes sending to and receiving from us
+    void exchange (const std::map<int,std::vector<Record> >& outgoing,
+                   std::map<int,std::vector<Record> >& incoming,
+                   CommunicationProfiler::Scope& profile) const;
+
+    MPI_Comm comm_;
+    int rank_;
+    // the old local indices sent to each process, in the order of the messages
+    std::map<int,std::vector<std::size_t> > sendLists_;
+    // the new local indices received from each process, in the order of the messages
+    std::map<int,std::vector<std::size_t> > receiveLists_;
+  };
+
+#ifndef DOXYGEN
+
+  template<class T>
+  void Redistribution<T>::build (const ParallelIndexSet& oldSet, const std::vector<int>& targets,
+                                 ParallelIndexSet& newSet)
+  {
+    CommunicationProfiler::Scope profile("Redistribution::build", this);
+    int procs;
+    MPI_Comm_size(comm_, &procs);
+    sendLists_.clear();
+    receiveLists_.clear();
+
+    std::map<int,std::vector<Record> > outgoing, incoming;
+    for(const auto& pair : oldSet) {
+      const std::size_t local = pair.local();
+      if(local >= targets.size())
+        DUNE_THROW(RangeError, "No target for the local index " << local);
+      const int target = targets[local];
+      if(target < 0)
+        continue;
+      if(target >= procs)
+        DUNE_THROW(RangeError, "Invalid target " << target << " of the global index " << pair.global());
+      outgoing[target].push_back(Record{pair.global(), pair.local().attribute(), pair.local().isPublic()});
+      sendLists_[target].push_back(local);
+    }
+    exchange(outgoing, incoming, profile);
+
+    // Number the indices in the order of the global indices
+    std::vector<std::tuple<GlobalIndex,int,std::size_t> > order;
+    for(const auto& records : incoming) {
+      receiveLists_[records.first].resize(records.second.size());
+      for(std::size_t i=0; i<records.second.size(); ++i)
+        order.emplace_back(records.second[i].global, records.first, i);
+    }
+    std::sort(order.begin(), order.end());
+
+    typedef IndexPair<GlobalIndex,LocalIndex> Pair;
+    std::vector<Pair> pairs;
+    pairs.reserve(order.size());
+    for(std::size_t local=0; local<order.size(); ++local) {
+      const Record& record = incoming[std::get<1>(order[local])][std::get<2>(order[local])];
+      if(local > 0 && !(std::get<0>(order[local-1]) < record.global))
+        DUNE_THROW(InvalidIndexSetState, "The global index " << record.global
+                   << " was sent to process " << rank_ << " several times");
+      pairs.push_back(Pair(record.global, LocalIndex(local, record.attribute, record.isPublic)));
+      receiveLists_[std::get<1>(order[local])][std::get<2>(order[local])] = local;
+    }
+    newSet.assign(pairs);
+  }
+
+  template<class T>
+  void Redistribution<T>::exchange (const std::map<int,std::vector<Record> >& outgoing,
+                                    std::map<int,std::vector<Record> >& incoming,
+                                    CommunicationProfiler::Scope& profile) const
+  {
+    const Impl::SparseExchange plan(comm_, planTag, otherPlanTag);
+    std::vector<MPI_Request> requests;
+    requests.reserve(outgoing.size());
+    for(const auto& records : outgoing) {
+      if(records.first == rank_) {
+        incoming[rank_] = records.second;
+        continue;
+      }
+      const std::size_t bytes = records.second.size()*sizeof(Record);
+      requests.push_back(MPI_REQUEST_NULL);
+      MPI_Issend(const_cast<Record*>(records.second.data()), bytes, MPI_BYTE, records.first,
+                 plan.tag(), comm_, &requests.back());
+      profile.send(records.first, bytes);
+    }
+
+#if MPI_VERSION >= 3
+    plan.receive(requests.size(), requests.data(),
+                 [&](int source, int bytes, MPI_Message& message)
+                 {
+                   std::vector<Record>& records = incoming[source];
+                   records.resize(bytes/sizeof(Record));
+                   MPI_Mrecv(records.data(), bytes, MPI_BYTE, &message, MPI_STATUS_IGNORE);
+                 }, profile);
+#else
+    // Count the messages for each process
+    int procs;
+    MPI_Comm_size(comm_, &procs);
+    std::vector<int> messages(procs, 0);
+    for(const auto& records : outgoing)
+      if(records.first != rank_)
+        messages[records.first] = 1;
+    MPI_Allreduce(MPI_IN_PLACE, messages.data(), procs, MPI_INT, MPI_SUM, comm_);
+    for(int i=0; i<messages[rank_]; ++i) {
+      MPI_Status status;
+      const double waitStart = profile.beginWait();
+      MPI_Probe(MPI_ANY_SOURCE, plan.tag(), comm_, &status);
+      profile.endWait(waitStart);
+      int bytes;
+      MPI_Get_count(&status, MPI_BYTE, &bytes);
+      profile.receive(status.MPI_SOURCE, bytes);
+      std::vector<Record>& records = incoming[status.MPI_SOURCE];
+      records.resize(bytes/sizeof(Record));
+      MPI_Recv(records.data(), bytes, MPI_BYTE, status.MPI_SOURCE, plan.tag(), comm_,
+               MPI_STATUS_IGNORE);
+    }
+    MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+#endif
+  }
+
+  template<class T>
+  template<class DataHandle>
+  void Redistribution<T>::redistribute (DataHandle& handle) const
+  {
+    typedef typename DataHandle::DataType DataType;
+    CommunicationProfiler::Scope profile("Redistribution::redistribute", this);
+    const bool fixedSize = handle.fixedsize();
+    MPI_Datatype type = MPITraits<DataType>::getType();
+
+    // Gather and send the data, variable sizes in a separate message
+    std::map<int,std::vector<std::size_t> > sizes;
+    std::map<int,Impl::RedistributionBuffer<DataType> > buffers;
+    std::vector<MPI_Request> requests;
+    requests.reserve(2*sendLists_.size());
+    for(const auto& list : sendLists_) {
+      std::vector<std::size_t>& s = sizes[list.first];
+      Impl::RedistributionBuffer<DataType>& buffer = buffers[list.first];
+      for(std::size_t local : list.second) {
+        if(!fixedSize)
+          s.push_back(handle.size(local));
+        handle.gather(buffer, local);
+      }
+      if(list.first == rank_)
+        continue;
+      if(!fixedSize) {
+        requests.push_back(MPI_REQUEST_NULL);
+        MPI_Isend(s.data(), s.size(), MPITraits<std::size_t>::getType(), list.first,
+                  sizeTag, comm_, &requests.back());
+      }
+      requests.push_back(MPI_REQUEST_NULL);
+      MPI_Isend(buffer.data().data(), buffer.data().size(), type, list.first, dataTag,
+                comm_, &requests.back());
+      profile.send(list.first, buffer.data().size()*sizeof(DataType));
+    }
+
+    // Receive and scatter the data, the data sent to ourselves is taken from the buffer
+    for(const auto& list : receiveLists_) {
+      const int source = list.first;
+      std::vector<std::size_t> receivedSizes;
+      Impl::RedistributionBuffer<DataType> received;
+      std::vector<std::size_t>& s = source == rank_ ? sizes[rank_] : receivedSizes;
+      Impl::RedistributionBuffer<DataType>& buffer = source == rank_ ? buffers[rank_] : received;
+      if(source != rank_) {
+        const double waitStart = profile.beginWait();
+        if(!fixedSize) {
+          receivedSizes.resize(list.second.size());
+          MPI_Recv(receivedSizes.data(), receivedSizes.size(), MPITraits<std::size_t>::getType(),
+                   source, sizeTag, comm_, MPI_STATUS_IGNORE);
+        }
+        MPI_Status status;
+        MPI_Probe(source, dataTag, comm_, &status);
+        int count;
+        MPI_Get_count(&status, type, &count);
+        received.data().resize(count);
+        MPI_Recv(received.data().data(), count, type, source, dataTag, comm_, MPI_STATUS_IGNORE);
+        profile.endWait(waitStart);
+        profile.receive(source, count*sizeof(DataType));
+      }
+      const std::size_t perIndex = list.second.empty() ? 0 : buffer.data().size()/list.second.size();
+      for(std::size_t i=0; i<list.second.size(); ++i)
+        handle.scatter(buffer, list.second[i], fixedSize ? perIndex : s[i]);
+    }
+
+    const double waitStart = profile.beginWait();
+    MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+    profile.endWait(waitStart);
+  }
+
+#endif // DOXYGEN
+
+} // namespace Dune
+
+#endif // HAVE_MPI
+
+#endif
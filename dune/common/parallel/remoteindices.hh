@@ -5,19 +5,25 @@
 
 #if HAVE_MPI
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <ostream>
 #include <map>
 #include <memory>
 #include <set>
+#include <tuple>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
 #include <mpi.h>
 
 #include <dune/common/exceptions.hh>
+#include <dune/common/parallel/communicationprofiler.hh>
+#include <dune/common/parallel/indexencoding.hh>
 #include <dune/common/parallel/indexset.hh>
+#include <dune/common/parallel/mpidatatyperegistry.hh>
 #include <dune/common/parallel/mpitraits.hh>
 #include <dune/common/parallel/plocalindex.hh>
 #include <dune/common/sllist.hh>
@@ -148,6 +154,32 @@ namespace Dune {
     char attribute_;
   };
 
+  namespace Impl
+  {
+    /**
+     * @brief Access to the local side of the remote index an iterator of a
+     * remote index list points to.
+     *
+     * InterfaceBuilder uses it to read the local attribute and index.
+     * Remote index lists that store them directly specialize it to avoid
+     * going through the local index pair.
+     */
+    template<class Iterator>
+    struct RemoteIndexAccess
+    {
+      static auto localAttribute(const Iterator& remote)
+      -> decltype(remote->localIndexPair().local().attribute())
+      {
+        return remote->localIndexPair().local().attribute();
+      }
+
+      static std::size_t localIndex(const Iterator& remote)
+      {
+        return remote->localIndexPair().local().local();
+      }
+    };
+  }
+
   template<class T, class A>
   std::ostream& operator<<(std::ostream& os, const RemoteIndices<T,A>& indices);
 
@@ -275,6 +307,28 @@ namespace Dune {
      */
     void setIncludeSelf(bool includeSelf);
 
+    /**
+     * @brief Tell whether the indices are sent compressed by rebuild() and
+     * by the IndicesSyncer of these remote indices.
+     *
+     * The sorted global indices are sent as the differences to their
+     * predecessors with seven bits per byte, followed by the attribute.
+     * Indices that are contiguous or nearly so take two bytes each. The
+     * setting has to be the same on all processes and has no effect for
+     * global indices that are not integral. The size of the messages is
+     * recorded by the CommunicationProfiler.
+     *
+     * @param compress If true the indices are compressed.
+     */
+    void setCompressIndices(bool compress);
+
+    /**
+     * @brief Whether the indices are sent compressed.
+     *
+     * Always false for global indices that are not integral.
+     */
+    bool compressIndices() const;
+
     /**
      * @brief Set the index sets and communicator we work with.
      *
@@ -324,6 +378,58 @@ namespace Dune {
     template<bool ignorePublic>
     void rebuild();
 
+    /**
+     * @brief Prepare an incremental update of the remote indices.
+     *
+     * After local changes of the index set, e.g. due to adaptive refinement,
+     * endUpdate() patches the remote index lists by exchanging only the
+     * changes with the neighbours instead of rebuilding them from scratch.
+     * As the index set invalidates the pointers to its pairs on resize,
+     * this has to be called before the index set is changed:
+     * \code
+     * remoteIndices.beginUpdate();
+     * indexSet.beginResize();
+     * // add and delete indices, change attributes and public flags
+     * indexSet.endResize();
+     * remoteIndices.endUpdate(changedGlobals);
+     * \endcode
+     *
+     * Only remote indices built for one index set (source and destination
+     * are the same) with unique global indices can be updated.
+     * @exception InvalidStateException If the remote indices are not synced.
+     * @exception NotImplemented If there are two index sets.
+     */
+    void beginUpdate();
+
+    /**
+     * @brief Update the remote indices after changes of the index set.
+     *
+     * Each process sends the new state of its changed indices to all its
+     * neighbours, i.e. the processes it has remote indices for and the
+     * ones set with setNeighbours(). Neighbours answer only for indices that
+     * become shared by the change. Indices shared with processes that are
+     * not neighbours yet are not found, call rebuild() in that case.
+     *
+     * Has to be called by all neighbouring processes, after beginUpdate()
+     * and the changes of the index set.
+     * @param changed The global indices of the pairs that were added or
+     * removed or whose attribute or public flag changed on this process.
+     */
+    void endUpdate(const std::vector<GlobalIndex>& changed);
+
+    /**
+     * @brief Get the processes whose remote index lists changed during the
+     * last endUpdate().
+     *
+     * Only the parts of interfaces built from the remote indices belonging
+     * to these processes are stale, provided the local indices of unchanged
+     * pairs were kept.
+     */
+    const std::set<int>& updatedProcesses() const
+    {
+      return updatedProcesses_;
+    }
+
     bool operator==(const RemoteIndices& ri);
 
     /**
@@ -451,10 +557,78 @@ namespace Dune {
      */
     bool includeSelf;
 
+    /** @brief Whether the indices are sent compressed. */
+    bool compressIndices_;
+
     /** @brief The index pair type. */
     typedef IndexPair<GlobalIndex, LocalIndex>
     PairType;
 
+    /** @brief Reads the index pairs of a message packed with MPI_Pack. */
+    struct PackedPairReader
+    {
+      void operator()(PairType& index)
+      {
+        MPI_Unpack(buffer, bufferSize, &position, &index, 1, type, comm);
+      }
+
+      char* buffer;
+      int bufferSize;
+      int position;
+      MPI_Datatype type;
+      MPI_Comm comm;
+    };
+
+    /** @brief Reads the index pairs of a compressed message. */
+    struct CompressedPairReader
+    {
+      void operator()(PairType& index)
+      {
+        const GlobalIndex global = decoder.readGlobal();
+        index = PairType(global, LocalIndex(Attribute(decoder.readByte()), true));
+      }
+
+      Impl::IndexDecoder<GlobalIndex> decoder;
+    };
+
+    /** @brief The communicator tag used by endUpdate(). */
+    const static int updateTag_=334;
+
+    /** @brief The new state of an index sent by endUpdate(). */
+    struct UpdateRecord
+    {
+      GlobalIndex global;
+      Attribute attribute;
+      //! Whether the index is present and public on the sending process
+      char present;
+    };
+
+    /**
+     * @brief The global indices and attributes of the remote indices of each
+     * process, recorded by beginUpdate().
+     */
+    std::map<int, std::vector<std::pair<GlobalIndex,Attribute> > > updateIndices_;
+
+    /** @brief Whether beginUpdate() was called. */
+    bool updating_;
+
+    /** @brief The processes whose remote index lists changed during the last update. */
+    std::set<int> updatedProcesses_;
+
+    /**
+     * @brief Find the pair of a global index in the index set.
+     * @return The pair or a null pointer if the global index is not present
+     * or not public.
+     */
+    inline const PairType* findUpdatedPair(const GlobalIndex& global) const;
+
+    /**
+     * @brief Exchange update records with all neighbours.
+     */
+    void exchangeUpdateRecords(const std::set<int>& neighbours,
+                               std::map<int, std::vector<UpdateRecord> >& send,
+                               std::map<int, std::vector<UpdateRecord> >& receive, int tag);
+
     /**
      * @brief The remote indices.
      *
@@ -474,7 +648,7 @@ namespace Dune {
      * sending and receiving side.
      */
     template<bool ignorePublic>
-    inline void buildRemote(bool includeSelf);
+    inline void buildRemote(bool includeSelf, CommunicationProfiler::Scope& profile);
 
     /**
      * @brief Count the number of public indices in an index set.
@@ -499,6 +673,18 @@ namespace Dune {
                             char* p_out, MPI_Datatype type, int bufferSize,
                             int* position, int n);
 
+    /**
+     * @brief Encode the indices to send compressed.
+     *
+     * If the template parameter ignorePublic is true all indices will be treated
+     * as public.
+     * @param myPairs Array to store references to the public indices in.
+     * @param encoder The encoder to write the indices to.
+     */
+    template<bool ignorePublic>
+    inline void encodeEntries(PairType** myPairs, const ParallelIndexSet& indexSet,
+                              Impl::IndexEncoder<GlobalIndex>& encoder, int n);
+
     /**
      * @brief unpacks the received indices and builds the remote index list.
      *
@@ -507,25 +693,33 @@ namespace Dune {
      * @param local The local indices to check whether we know the remote
      *              indices.
      * @param localEntries The number of local indices.
-     * @param type The mpi data type for unpacking.
-     * @param p_in The input buffer to unpack from.
-     * @param position The position in the buffer to start unpacking from.
-     * @param bufferSize The size of the input buffer.
+     * @param read The reader of the received indices.
      */
+    template<class Reader>
     inline void unpackIndices(RemoteIndexList& remote, int remoteEntries,
-                              PairType** local, int localEntries, char* p_in,
-                              MPI_Datatype type, int* position, int bufferSize,
+                              PairType** local, int localEntries, Reader& read,
                               bool fromOurself);
 
+    template<class Reader>
     inline void unpackIndices(RemoteIndexList& send, RemoteIndexList& receive,
                               int remoteEntries, PairType** localSource,
                               int localSourceEntries, PairType** localDest,
-                              int localDestEntries, char* p_in,
-                              MPI_Datatype type, int* position, int bufferSize);
+                              int localDestEntries, Reader& read);
 
     void unpackCreateRemote(char* p_in, PairType** sourcePairs, PairType** DestPairs,
                             int remoteProc,  int sourcePublish, int destPublish,
                             int bufferSize, bool sendTwo, bool fromOurSelf=false);
+
+    /**
+     * @brief Build the remote index lists of a process from its received indices.
+     *
+     * @param read The reader positioned at the first received index.
+     */
+    template<class Reader>
+    void createRemote(Reader& read, PairType** sourcePairs, PairType** destPairs,
+                      int remoteProc, int sourcePublish, int destPublish,
+                      bool twoIndexSets, int noRemoteSource, int noRemoteDest,
+                      bool sendTwo, bool fromOurSelf);
   };
 
   /** @} */
@@ -903,13 +1097,8 @@ namespace Dune {
       for (MPI_Aint& d : disp)
         d -= base;
 
-      MPI_Datatype tmp;
-      MPI_Type_create_struct(2, length, disp, types, &tmp);
-
-      MPI_Type_create_resized(tmp, 0, sizeof(IndexPair<TG,ParallelLocalIndex<TA> >), &type);
-      MPI_Type_commit(&type);
-
-      MPI_Type_free(&tmp);
+      type = MPIDatatypeRegistry::structure(2, length, disp, types,
+                                            sizeof(IndexPair<TG,ParallelLocalIndex<TA> >));
     }
     return type;
   }
@@ -963,7 +1152,7 @@ namespace Dune {
                                            bool includeSelf_)
     : source_(&source), target_(&destination), comm_(comm),
       sourceSeqNo_(-1), destSeqNo_(-1), publicIgnored(false), firstBuild(true),
-      includeSelf(includeSelf_)
+      includeSelf(includeSelf_), compressIndices_(false), updating_(false)
   {
     setNeighbours(neighbours);
   }
@@ -974,11 +1163,23 @@ namespace Dune {
     includeSelf=b;
   }
 
+  template<typename T, typename A>
+  void RemoteIndices<T,A>::setCompressIndices(bool compress)
+  {
+    compressIndices_=compress;
+  }
+
+  template<typename T, typename A>
+  bool RemoteIndices<T,A>::compressIndices() const
+  {
+    return compressIndices_ && Impl::CompressedIndexTraits<GlobalIndex>::compressible;
+  }
+
   template<typename T, typename A>
   RemoteIndices<T,A>::RemoteIndices()
     : source_(0), target_(0), sourceSeqNo_(-1),
       destSeqNo_(-1), publicIgnored(false), firstBuild(true),
-      includeSelf(false)
+      includeSelf(false), compressIndices_(false), updating_(false)
   {}
 
   template<class T, typename A>
@@ -1045,6 +1246,27 @@ namespace Dune {
     assert(i==n);
   }
 
+  template<typename T, typename A>
+  template<bool ignorePublic>
+  inline void RemoteIndices<T,A>::encodeEntries(PairType** pairs,
+                                                const ParallelIndexSet& indexSet,
+                                                Impl::IndexEncoder<GlobalIndex>& encoder,
+                                                int n)
+  {
+    DUNE_UNUSED_PARAMETER(n);
+    typedef typename ParallelIndexSet::const_iterator const_iterator;
+    const const_iterator end = indexSet.end();
+
+    int i=0;
+    for(const_iterator index = indexSet.begin(); index != end; ++index)
+      if(ignorePublic || index->local().isPublic()) {
+        encoder.writeGlobal(index->global());
+        encoder.writeByte(char(index->local().attribute()));
+        pairs[i++] = const_cast<PairType*>(&(*index));
+      }
+    assert(i==n);
+  }
+
   template<typename T, typename A>
   inline int RemoteIndices<T,A>::noPublic(const ParallelIndexSet& indexSet)
   {
@@ -1082,38 +1304,60 @@ namespace Dune {
     MPI_Unpack(p_in, bufferSize, &position, &noRemoteDest, 1, MPI_INT, comm_);
 
 
+    if(compressIndices()) {
+      // The indices follow as a block of bytes
+      int size;
+      MPI_Unpack(p_in, bufferSize, &position, &size, 1, MPI_INT, comm_);
+      std::vector<char> encoded(size>0 ? size : 1);
+      MPI_Unpack(p_in, bufferSize, &position, encoded.data(), size, MPI_BYTE, comm_);
+      CompressedPairReader read{Impl::IndexDecoder<GlobalIndex>(encoded.data(), size)};
+      createRemote(read, sourcePairs, destPairs, remoteProc, sourcePublish, destPublish,
+                   twoIndexSets, noRemoteSource, noRemoteDest, sendTwo, fromOurSelf);
+    }else{
+      PackedPairReader read{p_in, bufferSize, position, MPITraits<PairType>::getType(), comm_};
+      createRemote(read, sourcePairs, destPairs, remoteProc, sourcePublish, destPublish,
+                   twoIndexSets, noRemoteSource, noRemoteDest, sendTwo, fromOurSelf);
+    }
+  }
+
+  template<typename T, typename A>
+  template<class Reader>
+  void RemoteIndices<T,A>::createRemote(Reader& read, PairType** sourcePairs,
+                                        PairType** destPairs, int remoteProc,
+                                        int sourcePublish, int destPublish,
+                                        bool twoIndexSets, int noRemoteSource,
+                                        int noRemoteDest, bool sendTwo, bool fromOurSelf)
+  {
     // Indices for which we receive
     RemoteIndexList* receive= new RemoteIndexList();
     // Indices for which we send
     RemoteIndexList* send=0;
 
-    MPI_Datatype type= MPITraits<PairType>::getType();
-
     if(!twoIndexSets) {
       if(sendTwo) {
         send = new RemoteIndexList();
         // Create both remote index sets simultaneously
         unpackIndices(*send, *receive, noRemoteSource, sourcePairs, sourcePublish,
-                      destPairs, destPublish, p_in, type, &position, bufferSize);
+                      destPairs, destPublish, read);
       }else{
         // we only need one list
         unpackIndices(*receive, noRemoteSource, sourcePairs, sourcePublish,
-                      p_in, type, &position, bufferSize, fromOurSelf);
+                      read, fromOurSelf);
         send=receive;
       }
     }else{
 
-      int oldPos=position;
+      const Reader start=read;
       // Two index sets received
       unpackIndices(*receive, noRemoteSource, destPairs, destPublish,
-                    p_in, type, &position, bufferSize, fromOurSelf);
+                    read, fromOurSelf);
       if(!sendTwo)
         //unpack source entries again as destination entries
-        position=oldPos;
+        read=start;
 
       send = new RemoteIndexList();
       unpackIndices(*send, noRemoteDest, sourcePairs, sourcePublish,
-                    p_in, type, &position, bufferSize, fromOurSelf);
+                    read, fromOurSelf);
     }
 
     if(receive->empty() && send->empty()) {
@@ -1132,7 +1376,8 @@ namespace Dune {
 
   template<typename T, typename A>
   template<bool ignorePublic>
-  inline void RemoteIndices<T,A>::buildRemote(bool includeSelf_)
+  inline void RemoteIndices<T,A>::buildRemote(bool includeSelf_,
+                                              CommunicationProfiler::Scope& profile)
   {
     // Processor configuration
     int rank, procs;
@@ -1158,10 +1403,7 @@ namespace Dune {
       // we only need to send one set of indices
       destPublish = 0;
 
-    int maxPublish, publish=sourcePublish+destPublish;
-
-    // Calucate maximum number of indices send
-    MPI_Allreduce(&publish, &maxPublish, 1, MPI_INT, MPI_MAX, comm_);
+    int publish=sourcePublish+destPublish;
 
     // allocate buffers
     typedef IndexPair<GlobalIndex,LocalIndex> PairType;
@@ -1182,18 +1424,40 @@ namespace Dune {
 
     // calculate buffer size
     MPI_Datatype type = MPITraits<PairType>::getType();
+    const bool compressed = compressIndices();
+    std::vector<char> encoded;
+    int messageSize;
 
-    MPI_Pack_size(maxPublish, type, comm_,
-                  &bufferSize);
     MPI_Pack_size(1, MPI_INT, comm_,
                   &intSize);
     MPI_Pack_size(1, MPI_CHAR, comm_,
                   &charSize);
+
+    if(compressed) {
+      // Encode the source and destination indices and setup the pairs
+      typedef Impl::IndexEncoder<GlobalIndex> Encoder;
+      encoded.resize(publish*(Encoder::maxGlobalSize()+1));
+      Encoder encoder(encoded.data());
+      encodeEntries<ignorePublic>(sourcePairs, *source_, encoder, sourcePublish);
+      if(sendTwo)
+        encodeEntries<ignorePublic>(destPairs, *target_, encoder, destPublish);
+      encoded.resize(encoder.size());
+      // The indices are sent as their number of bytes and the bytes
+      MPI_Pack_size(int(encoded.size()), MPI_BYTE, comm_,
+                    &messageSize);
+      messageSize += intSize;
+    }else
+      MPI_Pack_size(publish, type, comm_,
+                    &messageSize);
+
     // Our message will contain the following:
     // a bool whether two index sets where sent
     // the size of the source and the dest indexset,
     // then the source and destination indices
-    bufferSize += 2 * intSize + charSize;
+    messageSize += 2 * intSize + charSize;
+
+    // Calculate the maximum size of the messages sent
+    MPI_Allreduce(&messageSize, &bufferSize, 1, MPI_INT, MPI_MAX, comm_);
 
     if(bufferSize<=0) bufferSize=1;
 
@@ -1211,13 +1475,21 @@ namespace Dune {
     MPI_Pack(&destPublish, 1, MPI_INT, buffer[0], bufferSize, &position,
              comm_);
 
-    // Now pack the source indices and setup the destination pairs
-    packEntries<ignorePublic>(sourcePairs, *source_, buffer[0], type,
-                              bufferSize, &position, sourcePublish);
-    // If necessary send the dest indices and setup the source pairs
-    if(sendTwo)
-      packEntries<ignorePublic>(destPairs, *target_, buffer[0], type,
-                                bufferSize, &position, destPublish);
+    if(compressed) {
+      int size = encoded.size();
+      MPI_Pack(&size, 1, MPI_INT, buffer[0], bufferSize, &position,
+               comm_);
+      MPI_Pack(encoded.data(), size, MPI_BYTE, buffer[0], bufferSize, &position,
+               comm_);
+    }else{
+      // Now pack the source indices and setup the destination pairs
+      packEntries<ignorePublic>(sourcePairs, *source_, buffer[0], type,
+                                bufferSize, &position, sourcePublish);
+      // If necessary send the dest indices and setup the source pairs
+      if(sendTwo)
+        packEntries<ignorePublic>(destPairs, *target_, buffer[0], type,
+                                  bufferSize, &position, destPublish);
+    }
 
 
     // Update remote indices for ourself
@@ -1248,6 +1520,8 @@ namespace Dune {
           MPI_Ssend(p_out, bufferSize, MPI_PACKED, (rank+1)%procs,
                     commTag_, comm_);
         }
+        profile.send((rank+1)%procs, bufferSize);
+        profile.receive((rank+procs-1)%procs, bufferSize);
 
 
         // The process these indices are from
@@ -1272,6 +1546,7 @@ namespace Dune {
           neighbour!= neighbourIds.end(); ++neighbour) {
         // Only send the information to the neighbouring processors
         MPI_Issend(buffer[0], position , MPI_PACKED, *neighbour, commTag_, comm_, req++);
+        profile.send(*neighbour, position);
       }
 
       //Test for received messages
@@ -1287,6 +1562,7 @@ namespace Dune {
         // receive message
         MPI_Recv(buffer[1], size, MPI_PACKED, remoteProc,
                  commTag_, comm_, &status);
+        profile.receive(remoteProc, size);
 
         unpackCreateRemote(buffer[1], sourcePairs, destPairs, remoteProc, sourcePublish,
                            destPublish, bufferSize, sendTwo);
@@ -1317,22 +1593,19 @@ namespace Dune {
   }
 
   template<typename T, typename A>
+  template<class Reader>
   inline void RemoteIndices<T,A>::unpackIndices(RemoteIndexList& remote,
                                                 int remoteEntries,
                                                 PairType** local,
                                                 int localEntries,
-                                                char* p_in,
-                                                MPI_Datatype type,
-                                                int* position,
-                                                int bufferSize,
+                                                Reader& read,
                                                 bool fromOurSelf)
   {
     if(remoteEntries==0)
       return;
 
     PairType index(1);
-    MPI_Unpack(p_in, bufferSize, position, &index, 1,
-               type, comm_);
+    read(index);
     GlobalIndex oldGlobal=index.global();
     int n_in=0, localIndex=0;
 
@@ -1353,8 +1626,7 @@ namespace Dune {
 
         // unpack next remote index
         if((++n_in) < remoteEntries) {
-          MPI_Unpack(p_in, bufferSize, position, &index, 1,
-                     type, comm_);
+          read(index);
           if(index.global()==oldGlobal)
             // Restart comparison for the same global indices
             localIndex=oldLocalIndex;
@@ -1373,8 +1645,7 @@ namespace Dune {
       }else{
         // We do not know the index, unpack next
         if((++n_in) < remoteEntries) {
-          MPI_Unpack(p_in, bufferSize, position, &index, 1,
-                     type, comm_);
+          read(index);
           oldGlobal=index.global();
         }else
           // No more received indices
@@ -1384,12 +1655,12 @@ namespace Dune {
 
     // Unpack the other received indices without doing anything
     while(++n_in < remoteEntries)
-      MPI_Unpack(p_in, bufferSize, position, &index, 1,
-                 type, comm_);
+      read(index);
   }
 
 
   template<typename T, typename A>
+  template<class Reader>
   inline void RemoteIndices<T,A>::unpackIndices(RemoteIndexList& send,
                                                 RemoteIndexList& receive,
                                                 int remoteEntries,
@@ -1397,10 +1668,7 @@ namespace Dune {
                                                 int localSourceEntries,
                                                 PairType** localDest,
                                                 int localDestEntries,
-                                                char* p_in,
-                                                MPI_Datatype type,
-                                                int* position,
-                                                int bufferSize)
+                                                Reader& read)
   {
     int n_in=0, sourceIndex=0, destIndex=0;
 
@@ -1408,8 +1676,7 @@ namespace Dune {
     while(n_in<remoteEntries && (sourceIndex<localSourceEntries || destIndex<localDestEntries)) {
       // Unpack next index
       PairType index;
-      MPI_Unpack(p_in, bufferSize, position, &index, 1,
-                 type, comm_);
+      read(index);
       n_in++;
 
       // Advance until global index in localSource and localDest are >= than the one in the unpacked index
@@ -1463,9 +1730,10 @@ namespace Dune {
     if(firstBuild ||
        ignorePublic!=publicIgnored || !
        isSynced()) {
+      CommunicationProfiler::Scope profile("RemoteIndices::rebuild", this);
       free();
 
-      buildRemote<ignorePublic>(includeSelf);
+      buildRemote<ignorePublic>(includeSelf, profile);
 
       sourceSeqNo_ = source_->seqNo();
       destSeqNo_ = target_->seqNo();
@@ -1476,6 +1744,204 @@ namespace Dune {
 
   }
 
+  template<typename T, typename A>
+  void RemoteIndices<T,A>::beginUpdate()
+  {
+    if(!isSynced())
+      DUNE_THROW(InvalidStateException, "The remote indices have to be synced "
+                 <<"with the index set before an update");
+    if(source_ != target_)
+      DUNE_THROW(NotImplemented, "Only remote indices of one index set can be updated");
+
+    int rank;
+    MPI_Comm_rank(comm_, &rank);
+    if(remoteIndices_.find(rank) != remoteIndices_.end())
+      DUNE_THROW(NotImplemented, "Remote indices on the own process can not be updated");
+
+    // the pointers to the pairs are still valid
+    updateIndices_.clear();
+    typedef typename RemoteIndexMap::const_iterator MapIterator;
+    for(MapIterator lists = remoteIndices_.begin(); lists != remoteIndices_.end(); ++lists) {
+      std::vector<std::pair<GlobalIndex,Attribute> >& indices = updateIndices_[lists->first];
+      typedef typename RemoteIndexList::const_iterator Iterator;
+      for(Iterator index = lists->second.first->begin(); index != lists->second.first->end(); ++index)
+        indices.push_back(std::make_pair(index->localIndexPair().global(), index->attribute()));
+    }
+    updating_ = true;
+  }
+
+  template<typename T, typename A>
+  inline const typename RemoteIndices<T,A>::PairType*
+  RemoteIndices<T,A>::findUpdatedPair(const GlobalIndex& global) const
+  {
+    if(source_->size() == 0)
+      return 0;
+    const PairType& pair = (*source_)[global];
+    if(pair.global() != global || !(publicIgnored || pair.local().isPublic()))
+      return 0;
+    return &pair;
+  }
+
+  template<typename T, typename A>
+  void RemoteIndices<T,A>::exchangeUpdateRecords(const std::set<int>& neighbours,
+                                                 std::map<int, std::vector<UpdateRecord> >& send,
+                                                 std::map<int, std::vector<UpdateRecord> >& receive,
+                                                 int tag)
+  {
+    std::vector<MPI_Request> requests(neighbours.size());
+    std::size_t i=0;
+    for(int neighbour : neighbours) {
+      std::vector<UpdateRecord>& records = send[neighbour];
+      MPI_Isend(records.data(), records.size()*sizeof(UpdateRecord), MPI_BYTE,
+                neighbour, tag, comm_, &requests[i++]);
+    }
+    for(int neighbour : neighbours) {
+      MPI_Status status;
+      MPI_Probe(neighbour, tag, comm_, &status);
+      int bytes;
+      MPI_Get_count(&status, MPI_BYTE, &bytes);
+      std::vector<UpdateRecord>& records = receive[neighbour];
+      records.resize(bytes/sizeof(UpdateRecord));
+      MPI_Recv(records.data(), bytes, MPI_BYTE, neighbour, tag, comm_, MPI_STATUS_IGNORE);
+    }
+    MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+  }
+
+  template<typename T, typename A>
+  void RemoteIndices<T,A>::endUpdate(const std::vector<GlobalIndex>& changed)
+  {
+    static_assert(std::is_trivially_copyable<GlobalIndex>::value
+                  && std::is_trivially_copyable<Attribute>::value,
+                  "The global index and the attribute are sent bytewise");
+    if(!updating_)
+      DUNE_THROW(InvalidStateException, "beginUpdate() has to be called before endUpdate()");
+
+    int rank;
+    MPI_Comm_rank(comm_, &rank);
+
+    // the new state of our changed indices
+    std::vector<GlobalIndex> globals(changed);
+    std::sort(globals.begin(), globals.end());
+    globals.erase(std::unique(globals.begin(), globals.end()), globals.end());
+    std::vector<UpdateRecord> records(globals.size());
+    for(std::size_t i=0; i<globals.size(); ++i) {
+      const PairType* pair = findUpdatedPair(globals[i]);
+      records[i].global = globals[i];
+      records[i].attribute = pair ? Attribute(pair->local().attribute()) : Attribute();
+      records[i].present = pair != 0;
+    }
+
+    std::set<int> neighbours(neighbourIds);
+    for(const auto& indices : updateIndices_)
+      neighbours.insert(indices.first);
+    neighbours.erase(rank);
+
+    std::map<int, std::vector<UpdateRecord> > send, receive, replies, receivedReplies;
+    for(int neighbour : neighbours)
+      send[neighbour] = records;
+    exchangeUpdateRecords(neighbours, send, receive, updateTag_);
+
+    // The new remote indices of each neighbour, sorted by the global index
+    typedef std::tuple<GlobalIndex, Attribute, const PairType*> Entry;
+    std::map<int, std::vector<Entry> > entries;
+    for(int neighbour : neighbours) {
+      const std::vector<std::pair<GlobalIndex,Attribute> >& old = updateIndices_[neighbour];
+      const std::vector<UpdateRecord>& theirs = receive[neighbour];
+      std::vector<Entry>& current = entries[neighbour];
+      std::vector<UpdateRecord>& reply = replies[neighbour];
+
+      auto o = old.begin();
+      auto m = records.begin();
+      auto t = theirs.begin();
+      while(o != old.end() || t != theirs.end() || m != records.end()) {
+        // the smallest global index of the three sequences
+        const GlobalIndex* global = 0;
+        if(o != old.end())
+          global = &o->first;
+        if(m != records.end() && (!global || m->global < *global))
+          global = &m->global;
+        if(t != theirs.end() && (!global || t->global < *global))
+          global = &t->global;
+        const GlobalIndex g = *global;
+
+        const bool inOld = o != old.end() && o->first == g;
+        const bool inMine = m != records.end() && m->global == g;
+        const bool inTheirs = t != theirs.end() && t->global == g;
+
+        if(inTheirs || inOld) {
+          const PairType* pair = findUpdatedPair(g);
+          if(inTheirs) {
+            if(t->present && pair) {
+              current.push_back(Entry(g, t->attribute, pair));
+              // the neighbour does not know our attribute of a newly shared index
+              if(!inOld && !inMine) {
+                UpdateRecord answer = { g, Attribute(pair->local().attribute()), 1 };
+                reply.push_back(answer);
+              }
+            }
+          }else if(pair)
+            current.push_back(Entry(g, o->second, pair));
+        }
+        // indices only changed by us are answered by the neighbour if shared
+
+        if(inOld)
+          ++o;
+        if(inMine)
+          ++m;
+        if(inTheirs)
+          ++t;
+      }
+    }
+
+    exchangeUpdateRecords(neighbours, replies, receivedReplies, updateTag_+1);
+
+    updatedProcesses_.clear();
+    for(int neighbour : neighbours) {
+      std::vector<Entry>& current = entries[neighbour];
+      const std::vector<UpdateRecord>& answers = receivedReplies[neighbour];
+      if(!answers.empty()) {
+        std::vector<Entry> answered;
+        for(const UpdateRecord& answer : answers)
+          answered.push_back(Entry(answer.global, answer.attribute, findUpdatedPair(answer.global)));
+        std::vector<Entry> merged(current.size() + answered.size());
+        std::merge(current.begin(), current.end(), answered.begin(), answered.end(), merged.begin(),
+                   [](const Entry& a, const Entry& b){ return std::get<0>(a) < std::get<0>(b); });
+        current.swap(merged);
+      }
+
+      // check whether the list changed
+      const std::vector<std::pair<GlobalIndex,Attribute> >& old = updateIndices_[neighbour];
+      bool listChanged = old.size() != current.size();
+      for(std::size_t i=0; !listChanged && i<old.size(); ++i)
+        listChanged = old[i].first != std::get<0>(current[i]) || old[i].second != std::get<1>(current[i]);
+      if(listChanged)
+        updatedProcesses_.insert(neighbour);
+
+      // patch the list, the pointers to the pairs changed anyway
+      typename RemoteIndexMap::iterator lists = remoteIndices_.find(neighbour);
+      if(current.empty()) {
+        if(lists != remoteIndices_.end()) {
+          delete lists->second.first;
+          remoteIndices_.erase(lists);
+        }
+        continue;
+      }
+      if(lists == remoteIndices_.end()) {
+        RemoteIndexList* list = new RemoteIndexList();
+        lists = remoteIndices_.insert(std::make_pair(neighbour, std::make_pair(list, list))).first;
+      }
+      RemoteIndexList& list = *lists->second.first;
+      list.clear();
+      for(const Entry& entry : current)
+        list.push_back(RemoteIndex(std::get<1>(entry), std::get<2>(entry)));
+    }
+
+    updateIndices_.clear();
+    updating_ = false;
+    sourceSeqNo_ = source_->seqNo();
+    destSeqNo_ = target_->seqNo();
+  }
+
   template<typename T, typename A>
   inline bool RemoteIndices<T,A>::isSynced() const
   {
@@ -3,8 +3,14 @@
 #ifndef DUNE_SELECTION_HH
 #define DUNE_SELECTION_HH
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
 #include "indexset.hh"
 #include <dune/common/iteratorfacades.hh>
+#include <dune/common/iteratorrange.hh>
 
 namespace Dune
 {
@@ -334,6 +340,197 @@ namespace Dune
     indexSet_ = &indexset;
   }
 
+  /**
+   * @brief The local indices of an index set grouped by attribute.
+   *
+   * The local indices of each attribute are stored in one contiguous
+   * array sorted by the local index, and the arrays of all attributes are
+   * stored one after another. Loops over all indices with an attribute
+   * then run over plain arrays:
+   * \code
+   * AttributeSelection<int,ParallelLocalIndex<GridFlags>,N> selection(indexSet);
+   * selection.forEach<EnumItem<GridFlags,owner> >([&](std::size_t i) { x[i] = 0; });
+   * \endcode
+   *
+   * Unlike Selection the arrays are kept up to date with the index set:
+   * they are rebuilt on the next access after the sequence number of the
+   * index set changed. As this happens in const methods, concurrent
+   * access from several threads requires calling update() first.
+   *
+   * The attributes have to be small nonnegative integral values, as they
+   * are used as positions in the array of offsets.
+   */
+  template<typename TG, typename TL, int N>
+  class AttributeSelection
+  {
+  public:
+    /**
+     * @brief The type of the global index of the underlying index set.
+     */
+    typedef TG GlobalIndex;
+
+    /**
+     * @brief The type of the local index of the underlying index set.
+     *
+     * It has to provide a function
+     * \code AttributeType attribute(); \endcode
+     */
+    typedef TL LocalIndex;
+
+    /**
+     * @brief The type of the attributes.
+     */
+    typedef typename LocalIndex::Attribute Attribute;
+
+    /**
+     * @brief The type of the underlying index set.
+     */
+    typedef Dune::ParallelIndexSet<GlobalIndex,LocalIndex,N> ParallelIndexSet;
+
+    /**
+     * @brief The type of the iterator of the selected indices.
+     */
+    typedef const uint32_t* const_iterator;
+
+    /**
+     * @brief The type of the range of the indices with an attribute.
+     */
+    typedef IteratorRange<const_iterator> Range;
+
+    AttributeSelection()
+      : indexSet_(nullptr), seqNo_(-1)
+    {}
+
+    AttributeSelection(const ParallelIndexSet& indexset)
+      : indexSet_(&indexset), seqNo_(-1)
+    {}
+
+    /**
+     * @brief Set the index set of the selection.
+     *
+     * The arrays are built on the next access.
+     * @param indexset The index set to use.
+     */
+    void setIndexSet(const ParallelIndexSet& indexset)
+    {
+      indexSet_ = &indexset;
+      seqNo_ = -1;
+    }
+
+    /**
+     * @brief Rebuild the arrays if the index set changed since they were built.
+     */
+    void update() const;
+
+    /**
+     * @brief Whether the arrays are up to date with the index set.
+     */
+    bool isSynced() const
+    {
+      return indexSet_ && seqNo_ == indexSet_->seqNo();
+    }
+
+    /**
+     * @brief Get the local indices with an attribute.
+     * @return The contiguous range of the indices sorted by local index.
+     */
+    Range indices(const Attribute& attribute) const;
+
+    /**
+     * @brief Get the number of indices with an attribute in a set.
+     * @tparam TS The set of attributes, e.g. EnumItem, EnumRange or Combine.
+     */
+    template<typename TS>
+    std::size_t size() const;
+
+    /**
+     * @brief Call a function for all local indices with an attribute in a set.
+     *
+     * The indices of each attribute are passed in ascending order.
+     * @tparam TS The set of attributes, e.g. EnumItem, EnumRange or Combine.
+     * @param f The function, called with the local index.
+     */
+    template<typename TS, typename F>
+    void forEach(F&& f) const;
+
+  private:
+    const ParallelIndexSet* indexSet_;
+    /** @brief The sequence number of the index set the arrays were built for. */
+    mutable int seqNo_;
+    /** @brief The indices of attribute a are stored at positions [offsets_[a], offsets_[a+1]). */
+    mutable std::vector<std::size_t> offsets_;
+    mutable std::vector<uint32_t> selected_;
+  };
+
+  template<typename TG, typename TL, int N>
+  void AttributeSelection<TG,TL,N>::update() const
+  {
+    if(isSynced())
+      return;
+
+    // Count the indices per attribute
+    typedef typename ParallelIndexSet::const_iterator const_iterator;
+    const const_iterator end = indexSet_->end();
+    std::vector<std::size_t> counts;
+    for(const_iterator index = indexSet_->begin(); index != end; ++index) {
+      const std::size_t attribute = static_cast<std::size_t>(index->local().attribute());
+      if(attribute >= counts.size())
+        counts.resize(attribute+1, 0);
+      ++counts[attribute];
+    }
+
+    offsets_.assign(counts.size()+1, 0);
+    for(std::size_t a=0; a<counts.size(); ++a)
+      offsets_[a+1] = offsets_[a] + counts[a];
+
+    // Fill the array of each attribute
+    selected_.resize(offsets_.back());
+    std::vector<std::size_t> position(offsets_.begin(), offsets_.end()-1);
+    for(const_iterator index = indexSet_->begin(); index != end; ++index)
+      selected_[position[static_cast<std::size_t>(index->local().attribute())]++] = index->local().local();
+
+    for(std::size_t a=0; a<counts.size(); ++a)
+      std::sort(selected_.begin()+offsets_[a], selected_.begin()+offsets_[a+1]);
+
+    seqNo_ = indexSet_->seqNo();
+  }
+
+  template<typename TG, typename TL, int N>
+  typename AttributeSelection<TG,TL,N>::Range
+  AttributeSelection<TG,TL,N>::indices(const Attribute& attribute) const
+  {
+    update();
+    const std::size_t a = static_cast<std::size_t>(attribute);
+    if(a+1 >= offsets_.size())
+      return Range(nullptr, nullptr);
+    return Range(selected_.data()+offsets_[a], selected_.data()+offsets_[a+1]);
+  }
+
+  template<typename TG, typename TL, int N>
+  template<typename TS>
+  std::size_t AttributeSelection<TG,TL,N>::size() const
+  {
+    update();
+    std::size_t size = 0;
+    for(std::size_t a=0; a+1<offsets_.size(); ++a)
+      if(TS::contains(static_cast<Attribute>(a)))
+        size += offsets_[a+1] - offsets_[a];
+    return size;
+  }
+
+  template<typename TG, typename TL, int N>
+  template<typename TS, typename F>
+  void AttributeSelection<TG,TL,N>::forEach(F&& f) const
+  {
+    update();
+    for(std::size_t a=0; a+1<offsets_.size(); ++a)
+      if(TS::contains(static_cast<Attribute>(a))) {
+        const uint32_t* const end = selected_.data()+offsets_[a+1];
+        for(const uint32_t* index = selected_.data()+offsets_[a]; index != end; ++index)
+          f(*index);
+      }
+  }
+
   /** @} */
 
 
@@ -0,0 +1,136 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifndef DUNE_COMMON_PARALLEL_SPARSEEXCHANGE_HH
+#define DUNE_COMMON_PARALLEL_SPARSEEXCHANGE_HH
+
+/*!
+   \file
+   \brief The exchange of messages between processes that do not know
+   whom they receive from.
+
+   \ingroup ParallelCommunication
+ */
+
+#if HAVE_MPI
+
+#include <map>
+
+#include <mpi.h>
+
+#include <dune/common/parallel/communicationprofiler.hh>
+#include <dune/common/visibility.hh>
+
+namespace Dune
+{
+
+  namespace Impl
+  {
+
+    /* An exchange of messages in which the processes only know whom they
+       send to. All processes of the communicator construct one for each
+       exchange, in the same order, and send their messages with tag().
+
+       Consecutive exchanges with the same tags alternate between the two
+       tags. A process that finished an exchange and starts the next one
+       already while another process is still receiving thus sends with
+       the other tag, so its messages are never received by the wrong
+       exchange. */
+    class SparseExchange
+    {
+    public:
+      SparseExchange (MPI_Comm comm, int tag, int otherTag)
+        : comm_(comm)
+      {
+        tag_ = (round(comm, tag)++ % 2 == 0) ? tag : otherTag;
+      }
+
+      // The tag to send the messages of this exchange with
+      int tag () const
+      {
+        return tag_;
+      }
+
+#if MPI_VERSION >= 3
+      /* Receive the messages of this exchange, after the synchronous sends
+         of this process were started. Calls receive(source, bytes, message),
+         which has to receive the message with MPI_Mrecv.
+
+         The synchronous sends complete once they were received, then the
+         process enters a nonblocking barrier, which completes when all
+         processes did, i.e. when all messages were received. */
+      template<class Receive>
+      void receive (int count, MPI_Request* sends, Receive&& receive,
+                    CommunicationProfiler::Scope& profile) const
+      {
+        MPI_Request barrier = MPI_REQUEST_NULL;
+        bool barrierActive = false;
+        while(true) {
+          if(barrierActive) {
+            int done;
+            MPI_Test(&barrier, &done, MPI_STATUS_IGNORE);
+            if(done)
+              break;
+          }
+          int flag;
+          MPI_Message message;
+          MPI_Status status;
+          MPI_Improbe(MPI_ANY_SOURCE, tag_, comm_, &flag, &message, &status);
+          if(flag) {
+            int bytes;
+            MPI_Get_count(&status, MPI_BYTE, &bytes);
+            profile.receive(status.MPI_SOURCE, bytes);
+            receive(status.MPI_SOURCE, bytes, message);
+          }else if(!barrierActive) {
+            int sent;
+            MPI_Testall(count, sends, &sent, MPI_STATUSES_IGNORE);
+            if(sent) {
+              MPI_Ibarrier(comm_, &barrier);
+              barrierActive = true;
+            }
+          }
+        }
+      }
+#endif
+
+    private:
+      // The number of exchanges with a tag on a communicator
+      static unsigned& round (MPI_Comm comm, int tag)
+      {
+        int& key = keyval();
+        if(key == MPI_KEYVAL_INVALID)
+          MPI_Comm_create_keyval(MPI_COMM_NULL_COPY_FN, &deleteRounds, &key, nullptr);
+        Rounds* rounds;
+        int found;
+        MPI_Comm_get_attr(comm, key, &rounds, &found);
+        if(!found) {
+          rounds = new Rounds;
+          MPI_Comm_set_attr(comm, key, rounds);
+        }
+        return (*rounds)[tag];
+      }
+
+      typedef std::map<int,unsigned> Rounds;
+
+      static int deleteRounds (MPI_Comm, int, void* rounds, void*)
+      {
+        delete static_cast<Rounds*>(rounds);
+        return MPI_SUCCESS;
+      }
+
+      DUNE_EXPORT static int& keyval ()
+      {
+        static int keyval = MPI_KEYVAL_INVALID;
+        return keyval;
+      }
+
+      MPI_Comm comm_;
+      int tag_;
+    };
+
+  } // namespace Impl
+
+} // namespace Dune
+
+#endif // HAVE_MPI
+
+#endif
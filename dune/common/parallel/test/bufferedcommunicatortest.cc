@@ -0,0 +1,472 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#include "config.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <mpi.h>
+
+#include <dune/common/enumset.hh>
+#include <dune/common/exceptions.hh>
+#include <dune/common/timer.hh>
+#include <dune/common/parallel/communicator.hh>
+#include <dune/common/parallel/indexset.hh>
+#include <dune/common/parallel/interface.hh>
+#include <dune/common/parallel/plocalindex.hh>
+#include <dune/common/parallel/remoteindices.hh>
+
+enum GridFlags {
+  owner, overlap
+};
+
+typedef Dune::ParallelLocalIndex<GridFlags> LocalIndex;
+typedef Dune::ParallelIndexSet<int,LocalIndex> IndexSet;
+
+template<typename T>
+struct AddGatherScatter
+{
+  typedef typename T::value_type IndexedType;
+
+  static const IndexedType& gather(const T& v, std::size_t i)
+  {
+    return v[i];
+  }
+
+  static void scatter(T& v, const IndexedType& item, std::size_t i)
+  {
+    v[i]+=item;
+  }
+};
+
+// Fails to gather the values of owner indices on the process with rank failingRank
+struct ThrowingGather : AddGatherScatter<std::vector<double> >
+{
+  static const double& gather(const std::vector<double>& v, std::size_t i)
+  {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    if(rank == failingRank)
+      DUNE_THROW(Dune::Exception, "gather failed");
+    return v[i];
+  }
+
+  static int failingRank;
+};
+
+int ThrowingGather::failingRank = 0;
+
+// Fails to scatter the values received for overlap indices
+struct ThrowingScatter : AddGatherScatter<std::vector<double> >
+{
+  static void scatter(std::vector<double>&, double, std::size_t)
+  {
+    DUNE_THROW(Dune::Exception, "scatter failed");
+  }
+};
+
+/**
+ * @brief Block-structured decomposition of an nx*ny*nz grid into slabs
+ * along y with an overlap of w rows.
+ *
+ * The local indices run fastest in x, then y, then z. Therefore the
+ * interface to each neighbour consists of nz runs of w*nx consecutive
+ * local indices. If yFastest is set, the local indices run fastest in y
+ * instead, while the global ones still run fastest in x.
+ */
+struct Slab
+{
+  Slab(int rank, int procs, int nx_, int nyOwned, int nz_, int w, bool yFastest_=false)
+    : nx(nx_), nz(nz_), yFastest(yFastest_)
+  {
+    ny = nyOwned*procs;
+    ownedBegin = rank*nyOwned;
+    ownedEnd = ownedBegin+nyOwned;
+    begin = std::max(ownedBegin-w, 0);
+    end = std::min(ownedEnd+w, ny);
+  }
+
+  std::size_t size() const
+  {
+    return std::size_t(nx)*(end-begin)*nz;
+  }
+
+  void build(IndexSet& indexSet) const
+  {
+    indexSet.beginResize();
+    for(int z=0; z<nz; ++z)
+      for(int y=begin; y<end; ++y)
+        for(int x=0; x<nx; ++x)
+          indexSet.add(global(x,y,z),
+                       LocalIndex(local(x,y,z), (y<ownedBegin || y>=ownedEnd) ? overlap : owner, true));
+    indexSet.endResize();
+  }
+
+  int global(int x, int y, int z) const
+  {
+    return x+nx*(y+ny*z);
+  }
+
+  int local(int x, int y, int z) const
+  {
+    if(yFastest)
+      return y-begin+(end-begin)*(x+nx*z);
+    return x+nx*(y-begin+(end-begin)*z);
+  }
+
+  int nx, ny, nz, ownedBegin, ownedEnd, begin, end;
+  bool yFastest;
+};
+
+template<class F>
+int check(const IndexSet& indexSet, const std::vector<double>& v, F expected)
+{
+  int ret=0;
+  for(IndexSet::const_iterator index=indexSet.begin(); index!=indexSet.end(); ++index)
+    if(v[index->local()]!=expected(*index)) {
+      std::cerr<<"Wrong value "<<v[index->local()]<<" at global index "<<index->global()
+               <<" expected "<<expected(*index)<<std::endl;
+      ret=1;
+    }
+  return ret;
+}
+
+void initialize(const IndexSet& indexSet, std::vector<double>& v)
+{
+  for(IndexSet::const_iterator index=indexSet.begin(); index!=indexSet.end(); ++index)
+    v[index->local()] = index->local().attribute()==owner ? index->global() : 0;
+}
+
+int testSlab(int rank, int procs, int nx, int ny, int nz, int w, int reps)
+{
+  typedef std::vector<double> Vector;
+
+  Slab slab(rank, procs, nx, ny, nz, w);
+  IndexSet indexSet;
+  slab.build(indexSet);
+
+  Dune::RemoteIndices<IndexSet> remoteIndices(indexSet, indexSet, MPI_COMM_WORLD);
+  remoteIndices.rebuild<false>();
+
+  Dune::EnumItem<GridFlags,owner> ownerFlags;
+  Dune::EnumItem<GridFlags,overlap> overlapFlags;
+  Dune::Interface interface;
+  interface.build(remoteIndices, ownerFlags, overlapFlags);
+
+  Vector v(slab.size()), w2(slab.size());
+  int ret=0;
+
+  auto global = [](const IndexSet::IndexPair& pair) -> double {
+                  return pair.global();
+                };
+  // After the backward communication the owner rows next to a neighbour
+  // hold the doubled values of its overlap rows.
+  auto doubledBorder = [&](const IndexSet::IndexPair& pair) -> double {
+                         int y = (pair.global()/slab.nx)%slab.ny;
+                         bool border = pair.local().attribute()==overlap
+                                       || (rank>0 && y<slab.ownedBegin+w)
+                                       || (rank<procs-1 && y>=slab.ownedEnd-w);
+                         return border ? 2*pair.global() : pair.global();
+                       };
+
+  for(int packed=0; packed<2; ++packed) {
+    Dune::BufferedCommunicator communicator;
+    if(packed)
+      communicator.setMinDirectRunLength(0);
+    communicator.build<Vector>(interface);
+
+    // copy with source and target being the same
+    initialize(indexSet, v);
+    communicator.forward<Dune::CopyGatherScatter<Vector> >(v);
+    ret |= check(indexSet, v, global);
+
+    // copy with separate source and target
+    initialize(indexSet, w2);
+    communicator.forward<Dune::CopyGatherScatter<Vector> >(v, w2);
+    for(IndexSet::const_iterator index=indexSet.begin(); index!=indexSet.end(); ++index)
+      if(index->local().attribute()==owner)
+        w2[index->local()]=index->global();
+    ret |= check(indexSet, w2, global);
+
+    // backward copy of the doubled overlap values
+    for(IndexSet::const_iterator index=indexSet.begin(); index!=indexSet.end(); ++index)
+      if(index->local().attribute()==overlap)
+        v[index->local()]*=2;
+    communicator.backward<Dune::CopyGatherScatter<Vector> >(v);
+    ret |= check(indexSet, v, doubledBorder);
+
+    // no plain copy, always packed
+    initialize(indexSet, v);
+    communicator.forward<AddGatherScatter<Vector> >(v);
+    ret |= check(indexSet, v, global);
+
+    // measure the exchange
+    MPI_Barrier(MPI_COMM_WORLD);
+    Dune::Timer timer;
+    for(int i=0; i<reps; ++i)
+      communicator.forward<Dune::CopyGatherScatter<Vector> >(v);
+    double elapsed=timer.elapsed(), maxElapsed;
+    MPI_Reduce(&elapsed, &maxElapsed, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    if(rank==0)
+      std::cout<<(packed ? "packed" : "direct")<<" exchange of "<<nz<<" runs of "
+               <<w*nx<<" values: "<<maxElapsed/reps<<" s"<<std::endl;
+  }
+  return ret;
+}
+
+// The local indices of the interface are not in the order of the global
+// ones. With an overlap of one row they are equally spaced after sorting.
+int testCompress(int rank, int procs, int nx, int nz, int w, int reps)
+{
+  typedef std::vector<double> Vector;
+
+  Slab slab(rank, procs, nx, 8, nz, w, true);
+  IndexSet indexSet;
+  slab.build(indexSet);
+
+  Dune::RemoteIndices<IndexSet> remoteIndices(indexSet, indexSet, MPI_COMM_WORLD);
+  remoteIndices.rebuild<false>();
+
+  Dune::EnumItem<GridFlags,owner> ownerFlags;
+  Dune::EnumItem<GridFlags,overlap> overlapFlags;
+  Dune::Interface interfaces[2];
+  // a communicator built before the compression uses the reordered interface
+  Dune::BufferedCommunicator early;
+  for(int compressed=0; compressed<2; ++compressed) {
+    interfaces[compressed].build(remoteIndices, ownerFlags, overlapFlags);
+    if(compressed) {
+      early.build<Vector>(interfaces[compressed]);
+      interfaces[compressed].compress();
+    }
+  }
+
+  int ret=0;
+  typedef Dune::Interface::InformationMap::const_iterator const_iterator;
+  const Dune::Interface::InformationMap& compressedInfo = static_cast<const Dune::Interface&>(interfaces[1]).interfaces();
+  for(const_iterator info = compressedInfo.begin(); info != compressedInfo.end(); ++info)
+    for(const Dune::InterfaceInformation* list : { &info->second.first, &info->second.second }) {
+      for(std::size_t i=1; i<list->size(); ++i)
+        if((*list)[i] <= (*list)[i-1]) {
+          std::cerr<<rank<<": the compressed interface to "<<info->first<<" is not sorted"<<std::endl;
+          ret=1;
+          break;
+        }
+      if(w==1 && list->size()>2 && list->runs().size()!=1) {
+        std::cerr<<rank<<": the compressed interface to "<<info->first<<" has "
+                 <<list->runs().size()<<" instead of one strided run"<<std::endl;
+        ret=1;
+      }
+    }
+
+  Vector v(slab.size());
+  auto global = [](const IndexSet::IndexPair& pair) -> double {
+                  return pair.global();
+                };
+  initialize(indexSet, v);
+  early.forward<Dune::CopyGatherScatter<Vector> >(v);
+  ret |= check(indexSet, v, global);
+
+  for(int compressed=0; compressed<2; ++compressed)
+    for(int packed=0; packed<2; ++packed) {
+      Dune::BufferedCommunicator communicator;
+      if(packed)
+        communicator.setMinDirectRunLength(0);
+      communicator.build<Vector>(interfaces[compressed]);
+
+      initialize(indexSet, v);
+      communicator.forward<Dune::CopyGatherScatter<Vector> >(v);
+      ret |= check(indexSet, v, global);
+      initialize(indexSet, v);
+      communicator.forward<AddGatherScatter<Vector> >(v);
+      ret |= check(indexSet, v, global);
+
+      MPI_Barrier(MPI_COMM_WORLD);
+      Dune::Timer timer;
+      for(int i=0; i<reps; ++i)
+        communicator.forward<Dune::CopyGatherScatter<Vector> >(v);
+      double elapsed=timer.elapsed(), maxElapsed;
+      MPI_Reduce(&elapsed, &maxElapsed, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+      if(rank==0)
+        std::cout<<(packed ? "packed" : "direct")<<" exchange of "<<(compressed ? "compressed" : "unsorted")
+                 <<" interface with overlap "<<w<<": "<<maxElapsed/reps<<" s"<<std::endl;
+    }
+  return ret;
+}
+
+int testThreads(int rank, int procs, int nx, int nz, int reps)
+{
+  typedef std::vector<double> Vector;
+
+  Slab slab(rank, procs, nx, 8, nz, 2);
+  IndexSet indexSet;
+  slab.build(indexSet);
+
+  Dune::RemoteIndices<IndexSet> remoteIndices(indexSet, indexSet, MPI_COMM_WORLD);
+  remoteIndices.rebuild<false>();
+
+  Dune::EnumItem<GridFlags,owner> ownerFlags;
+  Dune::EnumItem<GridFlags,overlap> overlapFlags;
+  Dune::Interface interface;
+  interface.build(remoteIndices, ownerFlags, overlapFlags);
+
+  const Dune::Interface& constInterface = interface;
+  std::size_t bytes=0;
+  for(Dune::Interface::InformationMap::const_iterator i=constInterface.interfaces().begin();
+      i!=constInterface.interfaces().end(); ++i)
+    bytes += i->second.first.size()*sizeof(double);
+
+  Vector v(slab.size());
+  int ret=0;
+  auto global = [](const IndexSet::IndexPair& pair) -> double {
+                  return pair.global();
+                };
+
+  for(std::size_t threads=1; threads<=4; threads*=2) {
+    Dune::BufferedCommunicator communicator;
+    communicator.setThreads(threads);
+    communicator.build<Vector>(interface);
+
+    initialize(indexSet, v);
+    communicator.forward<AddGatherScatter<Vector> >(v);
+    ret |= check(indexSet, v, global);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    Dune::Timer timer;
+    for(int i=0; i<reps; ++i)
+      communicator.forward<AddGatherScatter<Vector> >(v);
+    double elapsed=timer.elapsed(), maxElapsed;
+    MPI_Reduce(&elapsed, &maxElapsed, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    if(rank==0)
+      std::cout<<"packed exchange with "<<threads<<" threads: "
+               <<bytes*reps/maxElapsed/1e6<<" MB/s per process"<<std::endl;
+  }
+
+  // an exception in gathering or scattering reaches the caller, and the
+  // communicator still works for the next exchange
+  for(std::size_t threads=1; threads<=4; threads*=4) {
+    Dune::BufferedCommunicator communicator;
+    communicator.setThreads(threads);
+    communicator.build<Vector>(interface);
+    for(int phase=0; phase<2; ++phase) {
+      bool thrown=false;
+      try{
+        if(phase==0)
+          communicator.forward<ThrowingScatter>(v);
+        else
+          communicator.forward<ThrowingGather>(v);
+      }catch(const Dune::Exception&) {
+        thrown=true;
+      }
+      if(thrown != (procs>1 && (phase==0 || rank==ThrowingGather::failingRank))) {
+        std::cerr<<rank<<": the exception of the "<<(phase==0 ? "scatter" : "gather")
+                 <<" was not rethrown"<<std::endl;
+        ret=1;
+      }
+
+      initialize(indexSet, v);
+      communicator.forward<AddGatherScatter<Vector> >(v);
+      ret |= check(indexSet, v, global);
+    }
+  }
+  return ret;
+}
+
+int testMultiData(int rank, int procs, int nx, int nz, int reps)
+{
+  typedef std::vector<double> Vector;
+  typedef std::vector<int> IntVector;
+
+  Slab slab(rank, procs, nx, 8, nz, 2);
+  IndexSet indexSet;
+  slab.build(indexSet);
+
+  Dune::RemoteIndices<IndexSet> remoteIndices(indexSet, indexSet, MPI_COMM_WORLD);
+  remoteIndices.rebuild<false>();
+
+  Dune::EnumItem<GridFlags,owner> ownerFlags;
+  Dune::EnumItem<GridFlags,overlap> overlapFlags;
+  Dune::Interface interface;
+  interface.build(remoteIndices, ownerFlags, overlapFlags);
+
+  Vector u(slab.size()), v(slab.size());
+  IntVector flags(slab.size());
+  auto fields = Dune::makeMultiData(u, flags, v);
+  typedef Dune::MultiGatherScatter<Dune::CopyGatherScatter<Vector>, AddGatherScatter<IntVector>,
+      Dune::CopyGatherScatter<Vector> > GatherScatter;
+
+  Dune::BufferedCommunicator communicator;
+  communicator.build<decltype(fields)>(interface);
+
+  initialize(indexSet, u);
+  initialize(indexSet, v);
+  for(IndexSet::const_iterator index=indexSet.begin(); index!=indexSet.end(); ++index)
+    flags[index->local()] = index->local().attribute()==owner ? 1 : 2;
+  communicator.forward<GatherScatter>(fields);
+
+  int ret = check(indexSet, u, [](const IndexSet::IndexPair& pair) -> double {
+                                 return pair.global();
+                               });
+  ret |= check(indexSet, v, [](const IndexSet::IndexPair& pair) -> double {
+                              return pair.global();
+                            });
+  for(IndexSet::const_iterator index=indexSet.begin(); index!=indexSet.end(); ++index)
+    if(flags[index->local()] != (index->local().attribute()==owner ? 1 : 3)) {
+      std::cerr<<"Wrong flag "<<flags[index->local()]<<" at global index "<<index->global()<<std::endl;
+      ret=1;
+    }
+
+  // compare with one exchange per field
+  Dune::BufferedCommunicator single, singleInt;
+  single.build<Vector>(interface);
+  singleInt.build<IntVector>(interface);
+  double elapsed[2], maxElapsed[2];
+  MPI_Barrier(MPI_COMM_WORLD);
+  Dune::Timer timer;
+  for(int i=0; i<reps; ++i)
+    communicator.forward<GatherScatter>(fields);
+  elapsed[0]=timer.elapsed();
+  MPI_Barrier(MPI_COMM_WORLD);
+  timer.reset();
+  for(int i=0; i<reps; ++i) {
+    single.forward<Dune::CopyGatherScatter<Vector> >(u);
+    singleInt.forward<AddGatherScatter<IntVector> >(flags);
+    single.forward<Dune::CopyGatherScatter<Vector> >(v);
+  }
+  elapsed[1]=timer.elapsed();
+  MPI_Reduce(elapsed, maxElapsed, 2, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+  if(rank==0)
+    std::cout<<"exchange of three fields: "<<maxElapsed[0]/reps<<" s aggregated, "
+             <<maxElapsed[1]/reps<<" s separately"<<std::endl;
+  return ret;
+}
+
+int main(int argc, char** argv)
+{
+  // The threads packing the messages do not call MPI
+  int provided;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+  int procs, rank;
+  MPI_Comm_size(MPI_COMM_WORLD, &procs);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  // Usage: bufferedcommunicatortest [nx [nz [reps]]]
+  int nx = argc>1 ? std::atoi(argv[1]) : 64;
+  int nz = argc>2 ? std::atoi(argv[2]) : 16;
+  int reps = argc>3 ? std::atoi(argv[3]) : 10;
+
+  int ret = testSlab(rank, procs, nx, 8, nz, 2, reps);
+  // runs of length one are always packed
+  ret |= testSlab(rank, procs, 1, 8, nz, 1, reps);
+  // messages of several chunks
+  ret |= testThreads(rank, procs, 4*nx, 4*nz, reps);
+  ret |= testMultiData(rank, procs, nx, nz, reps);
+  ret |= testCompress(rank, procs, nx, nz, 1, reps);
+  ret |= testCompress(rank, procs, nx, nz, 2, reps);
+
+  int globalRet;
+  MPI_Allreduce(&ret, &globalRet, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+  MPI_Finalize();
+  return globalRet;
+}
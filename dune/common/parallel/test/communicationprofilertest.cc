@@ -0,0 +1,142 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#include "config.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+
+#include <dune/common/enumset.hh>
+#include <dune/common/exceptions.hh>
+#include <dune/common/parallel/communicationprofiler.hh>
+#include <dune/common/parallel/communicator.hh>
+#include <dune/common/parallel/indexset.hh>
+#include <dune/common/parallel/interface.hh>
+#include <dune/common/parallel/mpihelper.hh>
+#include <dune/common/parallel/plocalindex.hh>
+#include <dune/common/parallel/remoteindices.hh>
+#include <dune/common/test/testsuite.hh>
+
+enum GridFlags {
+  owner, overlap
+};
+
+typedef Dune::ParallelLocalIndex<GridFlags> LocalIndex;
+typedef Dune::ParallelIndexSet<int,LocalIndex> IndexSet;
+typedef Dune::RemoteIndices<IndexSet> RemoteIndices;
+typedef std::vector<double> Vector;
+typedef Dune::CommunicationProfiler Profiler;
+
+// A strip of n owned indices per process with an overlap of w indices on
+// each side
+void build(IndexSet& indexSet, int rank, int procs, int n, int w)
+{
+  const int start = std::max(rank*n-w, 0);
+  const int end = std::min((rank+1)*n+w, procs*n);
+  indexSet.beginResize();
+  for(int i=start; i<end; ++i) {
+    const bool isOverlap = i<rank*n || i>=(rank+1)*n;
+    indexSet.add(i, LocalIndex(i-start, isOverlap ? overlap : owner, true));
+  }
+  indexSet.endResize();
+}
+
+const Dune::CommunicationRecord* find(const std::string& name)
+{
+  auto record = Profiler::records().find(name);
+  return record == Profiler::records().end() ? nullptr : &record->second;
+}
+
+int main(int argc, char** argv)
+{
+  Dune::MPIHelper& mpi = Dune::MPIHelper::instance(argc, argv);
+  Dune::CollectiveCommunication<MPI_Comm> comm(mpi.getCommunicator());
+  const int rank = comm.rank(), procs = comm.size();
+  const int n = 100, w = 3;
+  const std::size_t neighbours = (rank>0) + (rank<procs-1);
+  Dune::TestSuite t;
+
+  IndexSet indexSet;
+  build(indexSet, rank, procs, n, w);
+  RemoteIndices remoteIndices(indexSet, indexSet, MPI_COMM_WORLD);
+  remoteIndices.rebuild<false>();
+
+  Dune::EnumItem<GridFlags,owner> ownerFlags;
+  Dune::EnumItem<GridFlags,overlap> overlapFlags;
+  Dune::Interface interface;
+  interface.build(remoteIndices, ownerFlags, overlapFlags);
+  Dune::BufferedCommunicator communicator;
+  communicator.build<Vector>(interface);
+  Vector v(indexSet.size(), rank);
+
+  // nothing is recorded by default
+  communicator.forward<Dune::CopyGatherScatter<Vector> >(v);
+  comm.sum(1.0);
+  t.check(!Profiler::enabled() && Profiler::records().empty()) << "disabled profiler recorded";
+
+  Profiler::enable();
+  communicator.forward<Dune::CopyGatherScatter<Vector> >(v);
+  communicator.forward<Dune::CopyGatherScatter<Vector> >(v);
+  const Dune::CommunicationRecord* forward = find("BufferedCommunicator::forward");
+  t.require(forward) << "no record of the forward communication";
+  t.check(forward->calls == 2) << "wrong number of calls " << forward->calls;
+  t.check(forward->messagesSent == 2*neighbours && forward->messagesReceived == 2*neighbours)
+    << "wrong number of messages";
+  t.check(forward->bytesSent == 2*neighbours*w*sizeof(double)
+          && forward->bytesReceived == 2*neighbours*w*sizeof(double)) << "wrong number of bytes";
+  t.check(forward->neighbours.size() == neighbours) << "wrong number of neighbours";
+  for(const auto& neighbour : forward->neighbours)
+    t.check(std::abs(neighbour.first-rank) == 1 && neighbour.second.messagesSent == 2
+            && neighbour.second.bytesReceived == 2*w*sizeof(double))
+      << "wrong messages for neighbour " << neighbour.first;
+  t.check(forward->time >= forward->waitTime && forward->waitTime >= 0.0) << "wrong times";
+
+  // named instances are recorded separately
+  Profiler::setName(&communicator, "strip");
+  communicator.backward<Dune::CopyGatherScatter<Vector> >(v);
+  t.check(!find("BufferedCommunicator::backward")) << "named instance recorded without name";
+  const Dune::CommunicationRecord* backward = find("BufferedCommunicator::backward[strip]");
+  t.require(backward) << "no record of the named instance";
+  t.check(backward->calls == 1 && backward->messagesSent == neighbours) << "wrong record of the named instance";
+  Profiler::setName(&communicator, "");
+
+  t.check(comm.sum(1.0) == procs);
+  const Dune::CommunicationRecord* allreduce = find("CollectiveCommunication::allreduce");
+  t.require(allreduce) << "no record of the collective";
+  t.check(allreduce->calls == 1 && allreduce->bytesSent == sizeof(double) && allreduce->neighbours.empty())
+    << "wrong record of the collective";
+
+  RemoteIndices rebuilt(indexSet, indexSet, MPI_COMM_WORLD);
+  rebuilt.rebuild<false>();
+  t.check(find("RemoteIndices::rebuild")) << "no record of the rebuild";
+
+  std::ostringstream json;
+  Profiler::write(json, MPI_COMM_WORLD);
+  if(rank == 0) {
+    std::ostringstream processes;
+    processes << "\"processes\": " << procs;
+    t.check(json.str().find(processes.str()) != std::string::npos) << "no number of processes";
+    for(const auto& record : Profiler::records())
+      t.check(json.str().find("\"" + record.first + "\"") != std::string::npos)
+        << "no record " << record.first << " in\n" << json.str();
+  }else
+    t.check(json.str().empty()) << "only the first process writes";
+
+  try {
+    Profiler::write("/nonexistent/profile.json", MPI_COMM_WORLD);
+    t.check(false) << "writing to an invalid file did not throw";
+  }
+  catch(const Dune::IOError&) {}
+
+  Profiler::clear();
+  Profiler::enable(false);
+  comm.barrier();
+  t.check(Profiler::records().empty()) << "records after clear";
+
+  return t.exit();
+}
@@ -0,0 +1,228 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#include "config.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <mpi.h>
+
+#include <dune/common/enumset.hh>
+#include <dune/common/timer.hh>
+#include <dune/common/parallel/compactremoteindices.hh>
+#include <dune/common/parallel/indexset.hh>
+#include <dune/common/parallel/interface.hh>
+#include <dune/common/parallel/plocalindex.hh>
+#include <dune/common/parallel/remoteindices.hh>
+
+enum GridFlags {
+  owner, overlap
+};
+
+typedef Dune::ParallelLocalIndex<GridFlags> LocalIndex;
+typedef Dune::ParallelIndexSet<int,LocalIndex> IndexSet;
+typedef Dune::RemoteIndices<IndexSet> RemoteIndices;
+typedef Dune::CompactRemoteIndices<IndexSet> CompactRemoteIndices;
+
+// A strip of n owned indices per process with an overlap of w indices on
+// each side
+void build(IndexSet& indexSet, int rank, int procs, int n, int w)
+{
+  const int start = std::max(rank*n-w, 0);
+  const int end = std::min((rank+1)*n+w, procs*n);
+  indexSet.beginResize();
+  for(int i=start; i<end; ++i) {
+    const bool isOverlap = i<rank*n || i>=(rank+1)*n;
+    indexSet.add(i, LocalIndex(i-start, isOverlap ? overlap : owner, true));
+  }
+  indexSet.endResize();
+}
+
+// Compare a list of the compact remote indices with the original one
+template<class L, class C>
+int compareLists(int rank, int process, const L& list, const C& compact)
+{
+  if(std::size_t(list.size()) != compact.size()) {
+    std::cerr<<rank<<": list for process "<<process<<" has "<<compact.size()
+             <<" instead of "<<list.size()<<" entries"<<std::endl;
+    return 1;
+  }
+  typename C::const_iterator c = compact.begin();
+  for(typename L::const_iterator remote = list.begin(); remote != list.end(); ++remote, ++c)
+    if(remote->attribute() != c->attribute()
+       || &remote->localIndexPair() != &c->localIndexPair()
+       || remote->localIndexPair().local().local() != c->localIndex()
+       || remote->localIndexPair().local().attribute() != c->localAttribute()) {
+      std::cerr<<rank<<": wrong remote index "<<remote->localIndexPair().global()
+               <<" for process "<<process<<std::endl;
+      return 1;
+    }
+  return 0;
+}
+
+int compare(int rank, const RemoteIndices& remoteIndices, const CompactRemoteIndices& compact)
+{
+  int ret = 0;
+  if(remoteIndices.neighbours() != compact.neighbours()) {
+    std::cerr<<rank<<": wrong number of neighbours"<<std::endl;
+    return 1;
+  }
+  for(RemoteIndices::const_iterator process = remoteIndices.begin(); process != remoteIndices.end(); ++process) {
+    CompactRemoteIndices::const_iterator found = compact.find(process->first);
+    if(found == compact.end()) {
+      std::cerr<<rank<<": no lists for process "<<process->first<<std::endl;
+      ret = 1;
+      continue;
+    }
+    ret |= compareLists(rank, process->first, *process->second.first, *found->second.first);
+    ret |= compareLists(rank, process->first, *process->second.second, *found->second.second);
+  }
+  if(!compact.isSynced()) {
+    std::cerr<<rank<<": compact remote indices are not synced"<<std::endl;
+    ret = 1;
+  }
+  return ret;
+}
+
+int compare(int rank, const Dune::InterfaceInformation& info, const Dune::InterfaceInformation& compact)
+{
+  if(info.size() != compact.size()) {
+    std::cerr<<rank<<": interface has "<<compact.size()<<" instead of "<<info.size()<<" entries"<<std::endl;
+    return 1;
+  }
+  for(std::size_t i=0; i<info.size(); ++i)
+    if(info[i] != compact[i]) {
+      std::cerr<<rank<<": wrong interface entry "<<compact[i]<<" instead of "<<info[i]<<std::endl;
+      return 1;
+    }
+  return 0;
+}
+
+int compare(int rank, const Dune::Interface& interface, const Dune::Interface& compact)
+{
+  int ret = 0;
+  if(interface.interfaces().size() != compact.interfaces().size()) {
+    std::cerr<<rank<<": wrong number of interfaces"<<std::endl;
+    return 1;
+  }
+  for(const auto& info : interface.interfaces()) {
+    auto found = compact.interfaces().find(info.first);
+    if(found == compact.interfaces().end()) {
+      std::cerr<<rank<<": no interface for process "<<info.first<<std::endl;
+      ret = 1;
+      continue;
+    }
+    ret |= compare(rank, info.second.first, found->second.first);
+    ret |= compare(rank, info.second.second, found->second.second);
+  }
+  return ret;
+}
+
+int testCompact(int rank, int procs, int n, int w, int reps)
+{
+  IndexSet indexSet;
+  build(indexSet, rank, procs, n, w);
+  std::vector<int> neighbours;
+  if(rank>0)
+    neighbours.push_back(rank-1);
+  if(rank<procs-1)
+    neighbours.push_back(rank+1);
+
+  RemoteIndices remoteIndices(indexSet, indexSet, MPI_COMM_WORLD, neighbours);
+  remoteIndices.rebuild<false>();
+
+  Dune::Timer timer;
+  CompactRemoteIndices compact(remoteIndices);
+  const double copyTime = timer.elapsed();
+  int ret = compare(rank, remoteIndices, compact);
+
+  Dune::EnumItem<GridFlags,owner> ownerFlags;
+  Dune::EnumItem<GridFlags,overlap> overlapFlags;
+  double elapsed[2];
+  for(int c=0; c<2; ++c) {
+    timer.reset();
+    for(int i=0; i<reps; ++i) {
+      Dune::Interface interface;
+      if(c)
+        interface.build(compact, ownerFlags, overlapFlags);
+      else
+        interface.build(remoteIndices, ownerFlags, overlapFlags);
+    }
+    elapsed[c] = timer.elapsed()/reps;
+  }
+  Dune::Interface interface, compactInterface;
+  interface.build(remoteIndices, ownerFlags, overlapFlags);
+  compactInterface.build(compact, ownerFlags, overlapFlags);
+  ret |= compare(rank, interface, compactInterface);
+
+  // a list entry takes at least a remote index and a pointer to the next one
+  const std::size_t listMemory = compact.size()*(sizeof(RemoteIndices::RemoteIndex)+sizeof(void*));
+  if(rank==0)
+    std::cout<<compact.size()<<" remote indices: lists "<<listMemory<<" bytes, compact "
+             <<compact.memory()<<" bytes, copied in "<<copyTime<<" s"<<std::endl
+             <<"Interface::build: "<<elapsed[0]<<" s from lists, "<<elapsed[1]<<" s compact"<<std::endl;
+
+  // the copy becomes invalid with the index set
+  indexSet.beginResize();
+  indexSet.endResize();
+  if(compact.isSynced()) {
+    std::cerr<<rank<<": compact remote indices are synced after resize"<<std::endl;
+    ret = 1;
+  }
+  try {
+    Dune::Interface invalid;
+    invalid.build(compact, ownerFlags, overlapFlags);
+    std::cerr<<rank<<": built an interface from invalid remote indices"<<std::endl;
+    ret = 1;
+  }
+  catch(const Dune::InterfaceBuilder::RemoteIndicesStateError&) {}
+  return ret;
+}
+
+// Different index sets for sending and receiving have separate lists
+int testSeparateIndexSets(int rank, int procs, int n, int w)
+{
+  IndexSet source, target;
+  build(source, rank, procs, n, w);
+  build(target, rank, procs, n, w);
+
+  RemoteIndices remoteIndices(source, target, MPI_COMM_WORLD);
+  remoteIndices.rebuild<false>();
+  CompactRemoteIndices compact(remoteIndices);
+  int ret = compare(rank, remoteIndices, compact);
+
+  Dune::EnumItem<GridFlags,owner> ownerFlags;
+  Dune::EnumItem<GridFlags,overlap> overlapFlags;
+  Dune::Interface interface, compactInterface;
+  interface.build(remoteIndices, ownerFlags, overlapFlags);
+  compactInterface.build(compact, ownerFlags, overlapFlags);
+  ret |= compare(rank, interface, compactInterface);
+
+  CompactRemoteIndices moved(std::move(compact));
+  ret |= compare(rank, remoteIndices, moved);
+  return ret;
+}
+
+int main(int argc, char** argv)
+{
+  MPI_Init(&argc, &argv);
+  int procs, rank;
+  MPI_Comm_size(MPI_COMM_WORLD, &procs);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  // Usage: compactremoteindicestest [n [w [reps]]]
+  int n = argc>1 ? std::atoi(argv[1]) : 100000;
+  int w = argc>2 ? std::atoi(argv[2]) : n/4;
+  int reps = argc>3 ? std::atoi(argv[3]) : 10;
+
+  int ret = testCompact(rank, procs, n, w, reps);
+  ret |= testSeparateIndexSets(rank, procs, 100, 3);
+
+  int globalRet;
+  MPI_Allreduce(&ret, &globalRet, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+  MPI_Finalize();
+  return globalRet;
+}
@@ -5,12 +5,17 @@
 #include "config.h"
 #endif
 
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
 #include <ostream>
+#include <random>
+#include <utility>
+#include <vector>
 
 #include <dune/common/parallel/indexset.hh>
 #include <dune/common/parallel/localindex.hh>
+#include <dune/common/timer.hh>
 
 int testDeleteIndices()
 {
@@ -77,7 +82,170 @@ int testDeleteIndices()
   return ret;
 }
 
-int main(int, char **)
+template<class IndexSet>
+int checkLookup(const IndexSet& indexSet, long n)
 {
-  std::exit(testDeleteIndices());
+  int ret=0;
+  for(long i=0; i<n; ++i) {
+    if(indexSet[3*i+1].global() != 3*i+1 || indexSet.at(3*i+1).local() != std::size_t(i)) {
+      std::cerr<<"Lookup of "<<3*i+1<<" failed!"<<std::endl;
+      return ++ret;
+    }
+    try {
+      indexSet.at(3*i);
+      std::cerr<<"Found "<<3*i<<" which is not in the index set!"<<std::endl;
+      return ++ret;
+    }
+    catch(const Dune::RangeError&) {}
+  }
+  return ret;
+}
+
+int testHashLookup(long n)
+{
+  typedef Dune::ParallelIndexSet<long,Dune::LocalIndex,100> IndexSet;
+  IndexSet indexSet, hashedIndexSet;
+  hashedIndexSet.setHashLookup(true);
+
+  std::vector<long> order(n);
+  for(long i=0; i<n; ++i)
+    order[i]=i;
+  std::shuffle(order.begin(), order.end(), std::mt19937(1));
+
+  indexSet.beginResize();
+  hashedIndexSet.beginResize();
+  for(long i : order) {
+    indexSet.add(3*i+1, Dune::LocalIndex(i));
+    hashedIndexSet.add(3*i+1, Dune::LocalIndex(i));
+  }
+  indexSet.endResize();
+  hashedIndexSet.endResize();
+
+  int ret = checkLookup(hashedIndexSet, n);
+  if(!(indexSet == hashedIndexSet)) {
+    std::cerr<<"Hash index changed the index set!"<<std::endl;
+    ++ret;
+  }
+
+  // delete the last index and add it again
+  hashedIndexSet.beginResize();
+  IndexSet::iterator last = hashedIndexSet.begin();
+  for(long i=0; i<n-1; ++i)
+    ++last;
+  hashedIndexSet.markAsDeleted(last);
+  hashedIndexSet.endResize();
+  if(hashedIndexSet.size() != std::size_t(n-1) || (n > 1 && hashedIndexSet.at(1).local() != 0)) {
+    std::cerr<<"Wrong index set after deleting an index!"<<std::endl;
+    ++ret;
+  }
+  try {
+    hashedIndexSet.at(3*(n-1)+1);
+    std::cerr<<"Found deleted index!"<<std::endl;
+    ++ret;
+  }
+  catch(const Dune::RangeError&) {}
+  hashedIndexSet.beginResize();
+  hashedIndexSet.add(3*(n-1)+1, Dune::LocalIndex(n-1));
+  hashedIndexSet.endResize();
+  ret += checkLookup(hashedIndexSet, n);
+
+  // compare the lookup times
+  std::shuffle(order.begin(), order.end(), std::mt19937(2));
+  std::size_t sum[2] = {0, 0};
+  double elapsed[2];
+  const IndexSet* indexSets[2] = {&indexSet, &hashedIndexSet};
+  for(int i=0; i<2; ++i) {
+    Dune::Timer timer;
+    for(long j : order)
+      sum[i] += (*indexSets[i])[3*j+1].local();
+    elapsed[i] = timer.elapsed();
+  }
+  if(sum[0] != sum[1]) {
+    std::cerr<<"Lookups differ!"<<std::endl;
+    ++ret;
+  }
+  std::cout<<n<<" lookups: "<<elapsed[0]<<" s binary search, "<<elapsed[1]<<" s hash index"<<std::endl;
+
+  // global indices without std::hash cannot use the hash index
+  Dune::ParallelIndexSet<std::pair<int,int>,Dune::LocalIndex> pairIndexSet;
+  try {
+    pairIndexSet.setHashLookup(true);
+    std::cerr<<"Enabled hash index without std::hash!"<<std::endl;
+    ++ret;
+  }
+  catch(const Dune::NotImplemented&) {}
+
+  return ret;
+}
+
+int testAssign(long n)
+{
+  typedef Dune::ParallelIndexSet<long,Dune::LocalIndex,100> IndexSet;
+  typedef IndexSet::IndexPair IndexPair;
+  std::vector<IndexPair> pairs;
+  for(long i=0; i<n; ++i)
+    pairs.push_back(IndexPair(2*i, Dune::LocalIndex(i)));
+  std::vector<IndexPair> shuffled(pairs);
+  std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937(3));
+
+  double elapsed[3];
+  Dune::Timer timer;
+  IndexSet added;
+  added.beginResize();
+  for(const IndexPair& pair : shuffled)
+    added.add(pair.global(), pair.local());
+  added.endResize();
+  elapsed[0] = timer.elapsed();
+
+  int ret=0;
+  IndexSet sorted, unsorted;
+  unsorted.setHashLookup(true);
+  timer.reset();
+  sorted.assign(pairs);
+  elapsed[1] = timer.elapsed();
+  timer.reset();
+  unsorted.assign(shuffled.begin(), shuffled.end(), 4);
+  elapsed[2] = timer.elapsed();
+
+  if(!(added == sorted) || !(added == unsorted)) {
+    std::cerr<<"Assigned index set differs!"<<std::endl;
+    ++ret;
+  }
+  if(sorted.seqNo() != 1 || sorted.size() != std::size_t(n)) {
+    std::cerr<<"Wrong sequence number or size after assign!"<<std::endl;
+    ++ret;
+  }
+  for(long i=0; i<n; ++i)
+    if(unsorted.at(2*i).local() != std::size_t(i)) {
+      std::cerr<<"Wrong lookup after assign!"<<std::endl;
+      ++ret;
+      break;
+    }
+
+  // assigning again replaces all indices
+  sorted.assign(std::vector<IndexPair>(1, IndexPair(1, Dune::LocalIndex(0))));
+  if(sorted.size() != 1 || sorted.begin()->global() != 1) {
+    std::cerr<<"Assign did not replace the indices!"<<std::endl;
+    ++ret;
+  }
+
+  std::cout<<"building an index set of "<<n<<" indices: "<<elapsed[0]<<" s with add, "
+           <<elapsed[1]<<" s assigning sorted, "<<elapsed[2]<<" s assigning unsorted"<<std::endl;
+  return ret;
+}
+
+int main(int argc, char ** argv)
+{
+  int ret = testDeleteIndices();
+  if(argc > 1)
+    for(int i=1; i<argc; ++i) {
+      ret += testHashLookup(std::atol(argv[i]));
+      ret += testAssign(std::atol(argv[i]));
+    }
+  else
+    for(long n : {1, 2, 100000}) {
+      ret += testHashLookup(n);
+      ret += testAssign(n);
+    }
+  std::exit(ret);
 }
@@ -0,0 +1,158 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#include "config.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include <mpi.h>
+
+#include <dune/common/enumset.hh>
+#include <dune/common/parallel/communicator.hh>
+#include <dune/common/parallel/indexset.hh>
+#include <dune/common/parallel/interface.hh>
+#include <dune/common/parallel/mpidatatyperegistry.hh>
+#include <dune/common/parallel/mpihelper.hh>
+#include <dune/common/parallel/mpitraits.hh>
+#include <dune/common/parallel/plocalindex.hh>
+#include <dune/common/parallel/remoteindices.hh>
+#include <dune/common/test/testsuite.hh>
+#include <dune/common/timer.hh>
+
+enum GridFlags {
+  owner, overlap
+};
+
+typedef Dune::ParallelLocalIndex<GridFlags> LocalIndex;
+typedef Dune::ParallelIndexSet<int,LocalIndex> IndexSet;
+typedef Dune::RemoteIndices<IndexSet> RemoteIndices;
+typedef std::vector<double> Vector;
+typedef Dune::MPIDatatypeRegistry Registry;
+
+// A strip of n owned indices per process with an overlap of w indices on
+// each side. The values are stored at every second position.
+void build(IndexSet& indexSet, int rank, int procs, int n, int w)
+{
+  const int start = std::max(rank*n-w, 0);
+  const int end = std::min((rank+1)*n+w, procs*n);
+  indexSet.beginResize();
+  for(int i=start; i<end; ++i) {
+    const bool isOverlap = i<rank*n || i>=(rank+1)*n;
+    indexSet.add(i, LocalIndex(2*(i-start), isOverlap ? overlap : owner, true));
+  }
+  indexSet.endResize();
+}
+
+// The overlap holds the global indices of its owners afterwards
+void fill(const IndexSet& indexSet, Vector& v)
+{
+  std::fill(v.begin(), v.end(), -1.0);
+  for(const auto& pair : indexSet)
+    if(pair.local().attribute() == owner)
+      v[pair.local()] = pair.global();
+}
+
+bool check(const IndexSet& indexSet, const Vector& v)
+{
+  for(const auto& pair : indexSet)
+    if(v[pair.local()] != pair.global())
+      return false;
+  return true;
+}
+
+void testRegistry(Dune::TestSuite& t)
+{
+  const std::size_t created = Registry::created();
+  MPI_Datatype first = Registry::contiguous(3, MPI_DOUBLE);
+  MPI_Datatype second = Registry::contiguous(3, MPI_DOUBLE);
+  t.check(first == second) << "the same structure gave different types";
+  t.check(Registry::contiguous(4, MPI_DOUBLE) != first) << "different structures gave the same type";
+  t.check(Registry::created() == created+2) << "wrong number of created types";
+
+  int size;
+  MPI_Type_size(first, &size);
+  t.check(size == 3*sizeof(double)) << "wrong size of the type";
+
+  // the composite types of the traits are registered
+  typedef std::pair<int,double> Pair;
+  int lengths[2] = {1, 1};
+  MPI_Aint displacements[2] = {offsetof(Pair, first), offsetof(Pair, second)};
+  MPI_Datatype types[2] = {MPI_INT, MPI_DOUBLE};
+  t.check(Registry::structure(2, lengths, displacements, types, sizeof(Pair))
+          == Dune::MPITraits<Pair>::getType()) << "the traits of std::pair are not registered";
+
+  // unused types are kept until there are too many of them
+  const std::size_t cached = Registry::size();
+  Registry::release(first);
+  Registry::release(second);
+  Registry::release(MPI_DOUBLE);
+  t.check(Registry::size() == cached) << "a type was freed too early";
+  t.check(Registry::contiguous(3, MPI_DOUBLE) == first) << "the unused type was not reused";
+  Registry::release(first);
+  Registry::setMaxUnused(0);
+  t.check(Registry::size() == cached-1) << "the unused type was not freed";
+  Registry::setMaxUnused(256);
+}
+
+int main(int argc, char** argv)
+{
+  Dune::MPIHelper& mpi = Dune::MPIHelper::instance(argc, argv);
+  Dune::CollectiveCommunication<MPI_Comm> comm(mpi.getCommunicator());
+  const int rank = comm.rank(), procs = comm.size();
+  const int n = argc>1 ? std::atoi(argv[1]) : 1000, w = 3;
+  Dune::TestSuite t;
+
+  testRegistry(t);
+
+  IndexSet indexSet;
+  build(indexSet, rank, procs, n, w);
+  RemoteIndices remoteIndices(indexSet, indexSet, MPI_COMM_WORLD);
+  remoteIndices.rebuild<false>();
+  Dune::EnumItem<GridFlags,owner> ownerFlags;
+  Dune::EnumItem<GridFlags,overlap> overlapFlags;
+  Vector v(2*indexSet.size());
+
+  // rebuilding a communicator reuses the types
+  Dune::DatatypeCommunicator<IndexSet> datatypeCommunicator;
+  datatypeCommunicator.build(remoteIndices, ownerFlags, v, overlapFlags, v);
+  std::size_t created = Registry::created();
+  datatypeCommunicator.build(remoteIndices, ownerFlags, v, overlapFlags, v);
+  t.check(Registry::created() == created) << "the rebuild created new types";
+  fill(indexSet, v);
+  datatypeCommunicator.forward();
+  t.check(check(indexSet, v)) << "wrong values after the forward communication";
+
+  // the direct messages of strided runs reuse their types
+  Dune::Interface interface;
+  interface.build(remoteIndices, ownerFlags, overlapFlags);
+  interface.compress();
+  Dune::BufferedCommunicator bufferedCommunicator;
+  bufferedCommunicator.build<Vector>(interface);
+  fill(indexSet, v);
+  created = Registry::created();
+  bufferedCommunicator.forward<Dune::CopyGatherScatter<Vector> >(v);
+  t.check(check(indexSet, v)) << "wrong values after the buffered communication";
+  t.check(procs == 1 || Registry::created() > created) << "the strided runs were not sent directly";
+  created = Registry::created();
+  bufferedCommunicator.forward<Dune::CopyGatherScatter<Vector> >(v);
+  t.check(Registry::created() == created) << "the communication created new types";
+
+  // the setup time with and without reuse
+  const int reps = 100;
+  for(std::size_t maxUnused : {std::size_t(0), std::size_t(256)}) {
+    Registry::setMaxUnused(maxUnused);
+    Dune::Timer timer;
+    for(int i=0; i<reps; ++i)
+      datatypeCommunicator.build(remoteIndices, ownerFlags, v, overlapFlags, v);
+    const double elapsed = comm.max(timer.elapsed());
+    if(rank == 0)
+      std::cout << "build of a DatatypeCommunicator " << (maxUnused ? "with" : "without")
+                << " reuse of the types: " << elapsed/reps << " s" << std::endl;
+  }
+
+  return t.exit();
+}
@@ -0,0 +1,187 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#include "config.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <mpi.h>
+
+#include <dune/common/parallel/indexset.hh>
+#include <dune/common/parallel/mpihelper.hh>
+#include <dune/common/parallel/plocalindex.hh>
+#include <dune/common/parallel/redistribution.hh>
+#include <dune/common/test/testsuite.hh>
+#include <dune/common/timer.hh>
+
+enum GridFlags {
+  owner, overlap
+};
+
+typedef Dune::ParallelLocalIndex<GridFlags> LocalIndex;
+typedef Dune::ParallelIndexSet<int,LocalIndex> IndexSet;
+
+// A strip of n owned indices per process with an overlap of w indices on
+// each side, numbered backwards
+void build(IndexSet& indexSet, int rank, int procs, int n, int w)
+{
+  const int start = std::max(rank*n-w, 0);
+  const int end = std::min((rank+1)*n+w, procs*n);
+  indexSet.beginResize();
+  for(int i=start; i<end; ++i) {
+    const bool isOverlap = i<rank*n || i>=(rank+1)*n;
+    indexSet.add(i, LocalIndex(end-1-i, isOverlap ? overlap : owner, i%2 == 0));
+  }
+  indexSet.endResize();
+}
+
+// One value per index
+struct FixedSizeHandle
+{
+  typedef double DataType;
+
+  bool fixedsize()
+  {
+    return true;
+  }
+
+  std::size_t size(std::size_t)
+  {
+    return 1;
+  }
+
+  template<class Buffer>
+  void gather(Buffer& buffer, std::size_t i)
+  {
+    buffer.write(oldData[i]);
+  }
+
+  template<class Buffer>
+  void scatter(Buffer& buffer, std::size_t i, std::size_t n)
+  {
+    if(n == 1)
+      buffer.read(newData[i]);
+  }
+
+  std::vector<double> oldData, newData;
+};
+
+// Global index g has g%4 values g, g+1, ...
+struct VariableSizeHandle
+{
+  typedef int DataType;
+
+  bool fixedsize()
+  {
+    return false;
+  }
+
+  std::size_t size(std::size_t i)
+  {
+    return oldData[i].size();
+  }
+
+  template<class Buffer>
+  void gather(Buffer& buffer, std::size_t i)
+  {
+    for(int value : oldData[i])
+      buffer.write(value);
+  }
+
+  template<class Buffer>
+  void scatter(Buffer& buffer, std::size_t i, std::size_t n)
+  {
+    newData[i].resize(n);
+    for(int& value : newData[i])
+      buffer.read(value);
+  }
+
+  std::vector<std::vector<int> > oldData, newData;
+};
+
+int main(int argc, char** argv)
+{
+  Dune::MPIHelper& mpi = Dune::MPIHelper::instance(argc, argv);
+  Dune::CollectiveCommunication<MPI_Comm> comm(mpi.getCommunicator());
+  const int rank = comm.rank(), procs = comm.size();
+  const int n = argc>1 ? std::atoi(argv[1]) : 1000, w = 3;
+  Dune::TestSuite t;
+
+  IndexSet oldSet;
+  build(oldSet, rank, procs, n, w);
+
+  // deal the owned indices out cyclically, the overlap is dropped
+  std::vector<int> targets(oldSet.size());
+  FixedSizeHandle fixedSize;
+  VariableSizeHandle variableSize;
+  fixedSize.oldData.resize(oldSet.size());
+  variableSize.oldData.resize(oldSet.size());
+  for(const auto& pair : oldSet) {
+    const int g = pair.global();
+    targets[pair.local()] = pair.local().attribute() == owner ? g%procs : -1;
+    fixedSize.oldData[pair.local()] = 0.5*g;
+    for(int k=0; k<g%4; ++k)
+      variableSize.oldData[pair.local()].push_back(g+k);
+  }
+
+  Dune::Timer timer;
+  Dune::Redistribution<IndexSet> redistribution(MPI_COMM_WORLD);
+  IndexSet newSet;
+  redistribution.build(oldSet, targets, newSet);
+  const double buildTime = comm.max(timer.elapsed());
+
+  t.check(newSet.size() == std::size_t(n)) << "wrong number of indices " << newSet.size();
+  std::size_t local = 0;
+  for(const auto& pair : newSet) {
+    const int g = pair.global();
+    t.check(g%procs == rank) << "index " << g << " on the wrong process";
+    t.check(pair.local() == local++) << "indices not numbered by global index";
+    t.check(pair.local().attribute() == owner && pair.local().isPublic() == (g%2 == 0))
+      << "wrong attribute or public flag of " << g;
+  }
+  std::size_t sent = 0;
+  for(const auto& size : redistribution.sendSizes())
+    sent += size.second;
+  t.check(sent == std::size_t(n)) << "not all owned indices were sent";
+
+  timer.reset();
+  fixedSize.newData.assign(newSet.size(), -1.0);
+  redistribution.redistribute(fixedSize);
+  variableSize.newData.resize(newSet.size());
+  redistribution.redistribute(variableSize);
+  const double redistributeTime = comm.max(timer.elapsed());
+
+  for(const auto& pair : newSet) {
+    const int g = pair.global();
+    t.check(fixedSize.newData[pair.local()] == 0.5*g) << "wrong value of " << g;
+    const std::vector<int>& values = variableSize.newData[pair.local()];
+    bool correct = values.size() == std::size_t(g%4);
+    for(std::size_t k=0; k<values.size(); ++k)
+      correct = correct && values[k] == g+int(k);
+    t.check(correct) << "wrong values of " << g;
+  }
+
+  // builds right after each other must not receive each other's plans
+  std::vector<int> shifted(targets.size());
+  for(const auto& pair : oldSet)
+    shifted[pair.local()] = targets[pair.local()] < 0 ? -1 : (pair.global()+1)%procs;
+  Dune::Redistribution<IndexSet> first(MPI_COMM_WORLD), second(MPI_COMM_WORLD);
+  IndexSet firstSet, secondSet;
+  first.build(oldSet, targets, firstSet);
+  second.build(oldSet, shifted, secondSet);
+  t.check(firstSet.size() == std::size_t(n) && secondSet.size() == std::size_t(n))
+    << "wrong number of indices after consecutive builds";
+  for(const auto& pair : firstSet)
+    t.check(pair.global()%procs == rank) << "index " << pair.global() << " in the wrong build";
+  for(const auto& pair : secondSet)
+    t.check((pair.global()+1)%procs == rank) << "index " << pair.global() << " in the wrong build";
+
+  if(rank == 0)
+    std::cout << "redistribution of " << n << " indices per process: build " << buildTime
+              << " s, data " << redistributeTime << " s" << std::endl;
+
+  return t.exit();
+}
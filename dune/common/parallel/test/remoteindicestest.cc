@@ -4,7 +4,9 @@
 #include <config.h>
 
 #include <algorithm>
+#include <cstdlib>
 #include <iostream>
+#include <limits>
 #include <ostream>
 #include <string>
 #include <vector>
@@ -12,7 +14,9 @@
 #include <mpi.h>
 
 #include <dune/common/enumset.hh>
+#include <dune/common/parallel/communicationprofiler.hh>
 #include <dune/common/parallel/communicator.hh>
+#include <dune/common/parallel/indexencoding.hh>
 #include <dune/common/parallel/indexset.hh>
 #include <dune/common/parallel/interface.hh>
 #include <dune/common/parallel/plocalindex.hh>
@@ -232,6 +236,192 @@ void testIndices(MPI_Comm comm)
 }
 
 
+// Change some indices of a strip decomposition and compare the updated remote indices with rebuilt ones
+int testIncrementalUpdate(MPI_Comm comm)
+{
+  typedef Dune::ParallelLocalIndex<GridFlags> LocalIndex;
+  typedef Dune::ParallelIndexSet<int,LocalIndex,45> ParallelIndexSet;
+  typedef Dune::RemoteIndices<ParallelIndexSet> RemoteIndices;
+
+  int procs, rank;
+  MPI_Comm_size(comm, &procs);
+  MPI_Comm_rank(comm, &rank);
+  const int nx = 10, Nx = nx*procs;
+  // overlap of two indices, the last one is not public
+  const int start = std::max(rank*nx-2, 0);
+  const int end = std::min((rank+1)*nx+2, Nx);
+
+  ParallelIndexSet indexSet;
+  indexSet.beginResize();
+  for(int i=start; i<end; ++i) {
+    const bool isOverlap = i<rank*nx || i>=(rank+1)*nx;
+    indexSet.add(i, LocalIndex(i-start, isOverlap ? overlap : owner, i!=start && i!=end-1));
+  }
+  indexSet.endResize();
+
+  std::vector<int> neighbours;
+  if(rank>0)
+    neighbours.push_back(rank-1);
+  if(rank<procs-1)
+    neighbours.push_back(rank+1);
+  RemoteIndices remoteIndices(indexSet, indexSet, comm, neighbours);
+  remoteIndices.rebuild<false>();
+
+  remoteIndices.beginUpdate();
+  std::vector<int> changed;
+  indexSet.beginResize();
+  for(ParallelIndexSet::iterator index = indexSet.begin(); index != indexSet.end(); ++index) {
+    const int i = index->global();
+    if(i == start && rank>0) {
+      // remove the outermost overlap index on the left, it was not public
+      indexSet.markAsDeleted(index);
+      changed.push_back(i);
+    }
+    if(i == end-2 && rank<procs-1) {
+      // remove the public outer overlap index on the right
+      indexSet.markAsDeleted(index);
+      changed.push_back(i);
+    }
+    if(i == rank*nx+1) {
+      // change the attribute of a shared owner index
+      index->local().setAttribute(border);
+      changed.push_back(i);
+    }
+    if(i == end-1 && rank<procs-1) {
+      // make an index public by replacing it
+      indexSet.markAsDeleted(index);
+      changed.push_back(i);
+    }
+  }
+  if(rank<procs-1) {
+    indexSet.add(end-1, LocalIndex(end-1-start, overlap, true));
+    // add a new index that is shared with the right neighbour
+    indexSet.add(end, LocalIndex(end-start, overlap, true));
+    changed.push_back(end);
+  }
+  indexSet.endResize();
+  remoteIndices.endUpdate(changed);
+
+  RemoteIndices rebuilt(indexSet, indexSet, comm, neighbours);
+  rebuilt.rebuild<false>();
+
+  int ret = 0;
+  if(!(remoteIndices == rebuilt)) {
+    std::cerr<<rank<<": updated remote indices differ from the rebuilt ones"<<std::endl;
+    ++ret;
+  }
+  if(!remoteIndices.isSynced()) {
+    std::cerr<<rank<<": updated remote indices are not synced"<<std::endl;
+    ++ret;
+  }
+  if(procs>1 && remoteIndices.updatedProcesses().empty()) {
+    std::cerr<<rank<<": no process was updated"<<std::endl;
+    ++ret;
+  }
+  return ret;
+}
+
+// Encode and decode unsorted indices, negative ones and the extreme values
+template<typename G>
+int testIndexEncoding()
+{
+  const G values[] = {0, 1, 127, 128, 3, std::numeric_limits<G>::max(),
+                      std::numeric_limits<G>::min(), 0, G(-1), 300};
+  const int n = sizeof(values)/sizeof(G);
+  typedef Dune::Impl::IndexEncoder<G> Encoder;
+  std::vector<char> buffer(n*(Encoder::maxGlobalSize()+Encoder::maxIntSize()+1));
+  Encoder encoder(buffer.data());
+  for(int i=0; i<n; ++i) {
+    encoder.writeGlobal(values[i]);
+    encoder.writeInt(i*1000);
+    encoder.writeByte(char(i));
+  }
+  Dune::Impl::IndexDecoder<G> decoder(buffer.data(), encoder.size());
+  for(int i=0; i<n; ++i)
+    if(decoder.readGlobal() != values[i] || decoder.readInt() != i*1000 || decoder.readByte() != char(i)) {
+      std::cerr<<"index "<<i<<" was not decoded correctly"<<std::endl;
+      return 1;
+    }
+  return 0;
+}
+
+// Build the remote indices of a strip decomposition with and without
+// compression and compare the lists and the size of the messages
+template<typename G>
+int testCompressedIndices(MPI_Comm comm, int nx, bool useNeighbours, bool twoSets)
+{
+  typedef Dune::ParallelLocalIndex<GridFlags> LocalIndex;
+  typedef Dune::ParallelIndexSet<G,LocalIndex> ParallelIndexSet;
+  typedef Dune::RemoteIndices<ParallelIndexSet> RemoteIndices;
+  typedef Dune::CommunicationProfiler Profiler;
+
+  int procs, rank;
+  MPI_Comm_size(comm, &procs);
+  MPI_Comm_rank(comm, &rank);
+  const int Nx = nx*procs;
+  const int start = std::max(rank*nx-2, 0);
+  const int end = std::min((rank+1)*nx+2, Nx);
+
+  // the destination set only knows the owned indices and every
+  // third index is not public
+  ParallelIndexSet source, dest;
+  source.beginResize();
+  dest.beginResize();
+  for(int i=start; i<end; ++i) {
+    const bool isOverlap = i<rank*nx || i>=(rank+1)*nx;
+    source.add(G(i), LocalIndex(i-start, isOverlap ? overlap : owner, i%3 != 0));
+    if(!isOverlap)
+      dest.add(G(i), LocalIndex(i-rank*nx, owner, true));
+  }
+  source.endResize();
+  dest.endResize();
+
+  std::vector<int> neighbours;
+  if(useNeighbours) {
+    if(rank>0)
+      neighbours.push_back(rank-1);
+    if(rank<procs-1)
+      neighbours.push_back(rank+1);
+  }
+  const ParallelIndexSet& destination = twoSets ? dest : source;
+  RemoteIndices packed(source, destination, comm, neighbours);
+  RemoteIndices compressed(source, destination, comm, neighbours);
+  compressed.setCompressIndices(true);
+  if(!compressed.compressIndices()) {
+    std::cerr<<rank<<": the indices are not compressed"<<std::endl;
+    return 1;
+  }
+
+  Profiler::clear();
+  Profiler::enable();
+  Profiler::setName(&packed, "packed");
+  Profiler::setName(&compressed, "compressed");
+  packed.template rebuild<false>();
+  compressed.template rebuild<false>();
+  Profiler::enable(false);
+  Profiler::setName(&packed, "");
+  Profiler::setName(&compressed, "");
+  const std::size_t packedBytes = Profiler::records().at("RemoteIndices::rebuild[packed]").bytesSent;
+  const std::size_t compressedBytes = Profiler::records().at("RemoteIndices::rebuild[compressed]").bytesSent;
+  Profiler::clear();
+
+  int ret = 0;
+  if(!(packed == compressed)) {
+    std::cerr<<rank<<": the compressed remote indices differ"<<std::endl;
+    ++ret;
+  }
+  if(compressedBytes >= packedBytes && procs>1) {
+    std::cerr<<rank<<": the compressed messages are not smaller"<<std::endl;
+    ++ret;
+  }
+  if(rank==0)
+    std::cout<<"remote indices of "<<nx<<" indices of size "<<sizeof(G)
+             <<(useNeighbours ? " with neighbours" : " in a ring")
+             <<(twoSets ? ", two index sets" : "")<<": "<<packedBytes<<" bytes sent, "
+             <<compressedBytes<<" compressed"<<std::endl;
+  return ret;
+}
+
 template<int NX, int NY, typename TG, typename TA>
 void setupDistributed(Array& distArray, Dune::ParallelIndexSet<TG,Dune::ParallelLocalIndex<TA> >& distIndexSet,
                       int rank, int procs)
@@ -716,8 +906,17 @@ int main(int argc, char **argv)
 
   //  testRedistributeIndices(comm);
   testRedistributeIndicesBuffered(comm);
+  int ret = testIncrementalUpdate(comm);
+  ret += testIndexEncoding<int>() + testIndexEncoding<long long>()
+         + testIndexEncoding<unsigned short>();
+  const int nx = argc>1 ? std::atoi(argv[1]) : 1000;
+  for(bool useNeighbours : {false, true})
+    for(bool twoSets : {false, true}) {
+      ret += testCompressedIndices<int>(comm, nx, useNeighbours, twoSets);
+      ret += testCompressedIndices<long long>(comm, nx, useNeighbours, twoSets);
+    }
   MPI_Comm_free(&comm);
   MPI_Finalize();
 
-  return 0;
+  return ret;
 }
@@ -2,7 +2,10 @@
 // vi: set et ts=4 sw=2 sts=2:
 #include "config.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
+#include <vector>
 
 #include <dune/common/enumset.hh>
 #include <dune/common/parallel/indexset.hh>
@@ -89,7 +92,77 @@ void test()
   std::cout<<count<<std::endl;
 }
 
+template<int SIZE>
+int testAttributeSelection()
+{
+  const int ALSIZE=55;
+  typedef Dune::ParallelLocalIndex<GridFlags> LocalIndex;
+  typedef Dune::ParallelIndexSet<int,LocalIndex,ALSIZE> IndexSet;
+
+  // the local indices run backwards to check the sorting
+  IndexSet indexSet;
+  indexSet.beginResize();
+  for(int i=0; i<SIZE; i++)
+    indexSet.add(i, LocalIndex(SIZE-1-i, GridFlags(i%3), true));
+  indexSet.endResize();
+
+  Dune::AttributeSelection<int,LocalIndex,ALSIZE> selection(indexSet);
+  Dune::Selection<Dune::EnumItem<GridFlags,owner>,int,LocalIndex,ALSIZE> ownerCached(indexSet);
+
+  int ret=0;
+  std::vector<std::uint32_t> expected(ownerCached.begin(), ownerCached.end());
+  std::sort(expected.begin(), expected.end());
+  auto owners = selection.indices(owner);
+  if(!std::equal(expected.begin(), expected.end(), owners.begin())
+     || std::size_t(owners.end()-owners.begin()) != expected.size()) {
+    std::cerr<<"Owner indices differ from the cached selection"<<std::endl;
+    ret=1;
+  }
+
+  typedef Dune::Combine<Dune::EnumItem<GridFlags,owner>,Dune::EnumItem<GridFlags,border>,GridFlags> OwnerBorder;
+  std::size_t count=0;
+  selection.forEach<OwnerBorder>([&](std::size_t i) {
+                                   if((SIZE-1-i)%3 == overlap)
+                                     ret=1;
+                                   ++count;
+                                 });
+  if(count != selection.size<OwnerBorder>() || count != SIZE - std::size_t((SIZE+1)/3)) {
+    std::cerr<<"Wrong number of owner and border indices "<<count<<std::endl;
+    ret=1;
+  }
+
+  // the selection is rebuilt lazily after the index set changed
+  indexSet.beginResize();
+  indexSet.add(SIZE, LocalIndex(SIZE, border, true));
+  indexSet.endResize();
+  if(selection.isSynced()) {
+    std::cerr<<"Selection is synced after the index set changed"<<std::endl;
+    ret=1;
+  }
+  auto borders = selection.indices(border);
+  if(borders.begin()==borders.end() || *(borders.end()-1) != SIZE) {
+    std::cerr<<"The new index was not selected"<<std::endl;
+    ret=1;
+  }
+  if(!selection.isSynced()) {
+    std::cerr<<"Selection is not synced after the access"<<std::endl;
+    ret=1;
+  }
+
+  // tight loop over the owner indices
+  std::vector<double> x(SIZE+1, 1.0);
+  Dune::Timer timer;
+  for(int i=0; i<10; i++)
+    selection.forEach<Dune::EnumItem<GridFlags,owner> >([&](std::size_t j) { x[j] += 1.0; });
+  std::cout<<" Owner attribute selection took "<< timer.elapsed()<<" seconds"<<std::endl;
+
+  return ret;
+}
+
 int main()
 {
   test<1000>();
+  int ret = testAttributeSelection<1>();
+  ret |= testAttributeSelection<1000000>();
+  return ret;
 }
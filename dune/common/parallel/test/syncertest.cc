@@ -4,6 +4,9 @@
 
 #include <dune/common/parallel/indicessyncer.hh>
 #include <dune/common/sllist.hh>
+#include <dune/common/timer.hh>
+#include <algorithm>
+#include <cstdlib>
 #include <string>
 #include <tuple>
 #include <iostream>
@@ -14,7 +17,8 @@ enum GridFlags {
 
 template<typename T>
 void deleteOverlapEntries(T& indices,
-                          Dune::RemoteIndices<T>& remoteIndices)
+                          Dune::RemoteIndices<T>& remoteIndices,
+                          bool verbose=true)
 {
   typedef typename T::iterator IndexIterator;
   typedef typename T::GlobalIndex GlobalIndex;
@@ -49,7 +53,8 @@ void deleteOverlapEntries(T& indices,
                                      index->localIndexPair().local().attribute()));
 
     assert(gList.size()==remote->second.first->size());
-    std::cout << "Size of remote indices is "<<gList.size()<<std::endl;
+    if(verbose)
+      std::cout << "Size of remote indices is "<<gList.size()<<std::endl;
 
     iterators.insert(std::make_pair(remote->first,
                                     IteratorTuple(remote->second.first->beginModify(),
@@ -65,7 +70,8 @@ void deleteOverlapEntries(T& indices,
   const IndexIterator endIndex = indices.end();
   for(IndexIterator index = indices.begin(); index != endIndex; ++index) {
     if(index->local().attribute()==overlap) {
-      std::cout << rank<<": Deleting "<<*index<<std::endl;
+      if(verbose)
+        std::cout << rank<<": Deleting "<<*index<<std::endl;
 
       indices.markAsDeleted(index);
 
@@ -91,10 +97,11 @@ void deleteOverlapEntries(T& indices,
 
           if(*(std::get<1>(remote->second)) == *index) {
 
-            std::cout<<rank<<": Deleting remote "<<
-            std::get<1>(remote->second)->first<<", "<<
-            std::get<1>(remote->second)->second<<" of process "
-            << remote->first<<std::endl;
+            if(verbose)
+              std::cout<<rank<<": Deleting remote "<<
+              std::get<1>(remote->second)->first<<", "<<
+              std::get<1>(remote->second)->second<<" of process "
+              << remote->first<<std::endl;
 
             // Delete entries
             std::get<0>(remote->second).remove();
@@ -319,6 +326,131 @@ bool testIndicesSyncer()
 
 }
 
+typedef Dune::ParallelIndexSet<int,Dune::ParallelLocalIndex<GridFlags> > ParallelIndexSet3D;
+
+/**
+ * @brief Set up the indices of a 3D decomposition into n^3 owned indices per
+ * process with an overlap of one layer in each direction.
+ *
+ * The overlap also contains indices shared with diagonal neighbours.
+ */
+void setupIndexSet3D(int n, ParallelIndexSet3D& indexSet)
+{
+  int procs, rank;
+  MPI_Comm_size(MPI_COMM_WORLD, &procs);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  int dims[3] = {0, 0, 0};
+  MPI_Dims_create(procs, 3, dims);
+  int coords[3] = {rank%dims[0], (rank/dims[0])%dims[1], rank/(dims[0]*dims[1])};
+  int N[3], begin[3], end[3], obegin[3], oend[3];
+  for(int d=0; d<3; ++d) {
+    N[d] = n*dims[d];
+    begin[d] = coords[d]*n;
+    end[d] = begin[d]+n;
+    obegin[d] = std::max(begin[d]-1, 0);
+    oend[d] = std::min(end[d]+1, N[d]);
+  }
+
+  indexSet.beginResize();
+  int localIndex=0;
+  for(int z=obegin[2]; z<oend[2]; ++z)
+    for(int y=obegin[1]; y<oend[1]; ++y)
+      for(int x=obegin[0]; x<oend[0]; ++x, ++localIndex) {
+        bool owned = x>=begin[0] && x<end[0] && y>=begin[1] && y<end[1]
+                     && z>=begin[2] && z<end[2];
+        // Only indices near the boundary may be known by other processes
+        bool isPublic = x<begin[0]+1 || x>=end[0]-1 || y<begin[1]+1 || y>=end[1]-1
+                        || z<begin[2]+1 || z>=end[2]-1;
+        int global = x+N[0]*(y+N[1]*z);
+        GridFlags flag = owned ? owner : overlap;
+        indexSet.add(global, Dune::ParallelLocalIndex<GridFlags>(localIndex, flag, isPublic));
+      }
+  indexSet.endResize();
+}
+
+/**
+ * @brief Restore the overlap of a 3D decomposition into n^3 owned indices per
+ * process and measure the time needed by the syncer.
+ *
+ * If compress is true the indices are sent compressed.
+ */
+bool testIndicesSyncer3D(int n, bool compress)
+{
+  int procs, rank;
+  MPI_Comm_size(MPI_COMM_WORLD, &procs);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  int dims[3] = {0, 0, 0};
+  MPI_Dims_create(procs, 3, dims);
+
+  typedef ParallelIndexSet3D ParallelIndexSet;
+  ParallelIndexSet indexSet, changedIndexSet;
+  setupIndexSet3D(n, indexSet);
+  setupIndexSet3D(n, changedIndexSet);
+
+  Dune::RemoteIndices<ParallelIndexSet> remoteIndices(indexSet, indexSet, MPI_COMM_WORLD);
+  Dune::RemoteIndices<ParallelIndexSet> changedRemoteIndices(changedIndexSet, changedIndexSet, MPI_COMM_WORLD);
+  changedRemoteIndices.setCompressIndices(compress);
+  remoteIndices.rebuild<false>();
+  changedRemoteIndices.rebuild<false>();
+
+  deleteOverlapEntries(changedIndexSet, changedRemoteIndices, false);
+
+  Dune::IndicesSyncer<ParallelIndexSet> syncer(changedIndexSet, changedRemoteIndices);
+  MPI_Barrier(MPI_COMM_WORLD);
+  Dune::Timer timer;
+  syncer.sync();
+  double elapsed=timer.elapsed(), maxElapsed;
+  MPI_Reduce(&elapsed, &maxElapsed, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+  if(rank==0)
+    std::cout<<"Restoring the overlap of "<<n<<"^3 indices per process on "<<dims[0]<<"x"
+             <<dims[1]<<"x"<<dims[2]<<" processes "<<(compress ? "with" : "without")
+             <<" compression took "<<maxElapsed<<" s"<<std::endl;
+
+  if(areEqual(indexSet, remoteIndices,changedIndexSet, changedRemoteIndices))
+    return true;
+  std::cerr<<"Output not equal!"<<std::endl;
+  return false;
+}
+
+/**
+ * @brief Restore the overlap of two 3D decompositions with two syncs right
+ * after each other.
+ *
+ * Processes that finished the first sync already send the messages of the
+ * second one while others still receive those of the first one.
+ */
+bool testIndicesSyncerTwice(int n)
+{
+  typedef ParallelIndexSet3D ParallelIndexSet;
+  ParallelIndexSet indexSet, changedIndexSet[2];
+  setupIndexSet3D(n, indexSet);
+  Dune::RemoteIndices<ParallelIndexSet> remoteIndices(indexSet, indexSet, MPI_COMM_WORLD);
+  remoteIndices.rebuild<false>();
+
+  Dune::RemoteIndices<ParallelIndexSet> changedRemoteIndices[2];
+  for(int i=0; i<2; ++i) {
+    setupIndexSet3D(n, changedIndexSet[i]);
+    changedRemoteIndices[i].setIndexSets(changedIndexSet[i], changedIndexSet[i], MPI_COMM_WORLD);
+    changedRemoteIndices[i].rebuild<false>();
+    deleteOverlapEntries(changedIndexSet[i], changedRemoteIndices[i], false);
+  }
+
+  Dune::IndicesSyncer<ParallelIndexSet> first(changedIndexSet[0], changedRemoteIndices[0]);
+  Dune::IndicesSyncer<ParallelIndexSet> second(changedIndexSet[1], changedRemoteIndices[1]);
+  first.sync();
+  second.sync();
+
+  bool ret = true;
+  for(int i=0; i<2; ++i)
+    if(!areEqual(indexSet, remoteIndices, changedIndexSet[i], changedRemoteIndices[i])) {
+      std::cerr<<"Output of sync "<<i<<" not equal!"<<std::endl;
+      ret = false;
+    }
+  return ret;
+}
+
 /**
  * @brief MPI Error.
  * Thrown when an mpi error occurs.
@@ -353,6 +485,10 @@ int main(int argc, char** argv){
   MPI_Comm_size(MPI_COMM_WORLD, &procs);
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
   bool ret=testIndicesSyncer();
+  // Usage: syncertest [n]
+  for(bool compress : {false, true})
+    ret = testIndicesSyncer3D(argc>1 ? std::atoi(argv[1]) : 8, compress) && ret;
+  ret = testIndicesSyncerTwice(4) && ret;
   MPI_Barrier(MPI_COMM_WORLD);
   std::cout<<rank<<": ENd="<<ret<<std::endl;
   if(!ret)
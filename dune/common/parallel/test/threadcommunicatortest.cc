@@ -0,0 +1,255 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <array>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <numeric>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <dune/common/binaryfunctions.hh>
+#include <dune/common/exactsum.hh>
+#include <dune/common/exceptions.hh>
+#include <dune/common/parallel/threadcommunicator.hh>
+#include <dune/common/test/testsuite.hh>
+#include <dune/common/timer.hh>
+
+typedef Dune::ThreadCommunicator Communicator;
+typedef Dune::CollectiveCommunication<Communicator> Comm;
+
+void testReductions(Comm comm, Dune::TestSuite& t)
+{
+  const int rank = comm.rank(), size = comm.size();
+  t.check(comm.sum(rank) == size*(size-1)/2) << "wrong sum";
+  t.check(comm.prod(2) == (1<<size)) << "wrong product";
+  t.check(comm.min(rank) == 0 && comm.max(rank) == size-1) << "wrong minimum or maximum";
+
+  std::vector<double> values(5);
+  for(int i=0; i<5; ++i)
+    values[i] = rank+i;
+  comm.sum(values.data(), 5);
+  for(int i=0; i<5; ++i)
+    t.check(values[i] == size*(size-1)/2 + size*i) << "wrong sum at " << i;
+
+  // arrays are reduced element-wise
+  std::array<int,2> pair = {{rank, -rank}};
+  comm.max(&pair, 1);
+  t.check(pair[0] == size-1 && pair[1] == 0) << "wrong element-wise maximum";
+
+  auto result = comm.allreduce(std::make_tuple(std::make_pair(1, std::plus<int>()),
+                                               std::make_pair(rank, Dune::Max<int>())));
+  t.check(std::get<0>(result) == size && std::get<1>(result) == size-1) << "wrong tuple reduction";
+
+  auto future = comm.isum(rank);
+  t.check(future.ready() && future.get() == size*(size-1)/2) << "wrong nonblocking sum";
+
+  // reproducible sums do not depend on the number of ranks
+  comm.setReproducibleSums(true);
+  Dune::ExactSum exact;
+  for(int p=0; p<size; ++p)
+    exact += 0.1*p;
+  t.check(comm.sum(0.1*rank) == exact.value()) << "wrong reproducible sum";
+  comm.setReproducibleSums(false);
+}
+
+void testCollectives(Comm comm, Dune::TestSuite& t)
+{
+  const int rank = comm.rank(), size = comm.size();
+  for(int root=0; root<size; ++root) {
+    std::vector<int> values(3, rank);
+    comm.broadcast(values.data(), 3, root);
+    t.check(values == std::vector<int>(3, root)) << "wrong broadcast from " << root;
+  }
+
+  // rank p contributes p+1 values p
+  std::vector<int> lengths(size), displacements(size);
+  for(int p=0; p<size; ++p) {
+    lengths[p] = p+1;
+    displacements[p] = p*(p+1)/2;
+  }
+  const int total = size*(size+1)/2;
+  std::vector<int> expected;
+  for(int p=0; p<size; ++p)
+    expected.insert(expected.end(), p+1, p);
+  std::vector<int> mine(rank+1, rank), all(total, -1);
+  comm.allgatherv(mine.data(), rank+1, all.data(), lengths.data(), displacements.data());
+  t.check(all == expected) << "wrong allgatherv";
+
+  const int root = size-1;
+  std::vector<int> gathered(rank == root ? total : 0, -1);
+  comm.gatherv(mine.data(), rank+1, gathered.data(), lengths.data(), displacements.data(), root);
+  if(rank == root)
+    t.check(gathered == expected) << "wrong gatherv";
+
+  std::vector<int> scattered(rank+1, -1);
+  comm.scatterv(expected.data(), lengths.data(), displacements.data(), scattered.data(), rank+1, 0);
+  t.check(scattered == mine) << "wrong scatterv";
+
+  std::vector<int> ranks(size, -1);
+  comm.allgather(&rank, 1, ranks.data());
+  std::vector<int> identity(size);
+  std::iota(identity.begin(), identity.end(), 0);
+  t.check(ranks == identity) << "wrong allgather";
+
+  int received = -1;
+  comm.scatter(identity.data(), &received, 1, 0);
+  t.check(received == rank) << "wrong scatter";
+  std::vector<int> collected(size, -1);
+  comm.gather(&rank, collected.data(), 1, 0);
+  if(rank == 0)
+    t.check(collected == identity) << "wrong gather";
+  comm.barrier();
+}
+
+void testPointToPoint(Communicator c, Dune::TestSuite& t)
+{
+  const int rank = c.rank(), size = c.size();
+  const int next = (rank+1)%size, previous = (rank+size-1)%size;
+
+  // messages with the same tag arrive in the order they were sent
+  for(int i=0; i<3; ++i)
+    c.send(&i, 1, next, 1);
+  double value = rank;
+  c.send(&value, 1, next, 2);
+  double other;
+  t.check(c.recv(&other, 1, previous, 2) == previous && other == previous) << "wrong message with tag 2";
+  for(int i=0; i<3; ++i) {
+    int j;
+    c.recv(&j, 1, previous, Communicator::anyTag);
+    t.check(i == j) << "message " << j << " overtook message " << i;
+  }
+
+  // messages of any length from any rank
+  if(rank > 0) {
+    std::vector<int> data(rank, rank);
+    c.send(data.data(), rank, 0, 3);
+  }else{
+    std::vector<bool> seen(size, false);
+    for(int p=1; p<size; ++p) {
+      std::vector<int> data;
+      const int source = c.recv(data, Communicator::anySource, 3);
+      seen[source] = data == std::vector<int>(source, source);
+    }
+    for(int p=1; p<size; ++p)
+      t.check(seen[p]) << "wrong message of variable length from " << p;
+  }
+
+  // longer messages than the buffer are an error
+  c.send(&value, 1, rank, 4);
+  try {
+    c.recv(&value, 0, rank, 4);
+    t.check(false) << "receiving into a too small buffer did not throw";
+  }
+  catch(const Dune::ParallelError&) {}
+  c.barrier();
+}
+
+void testNonblocking(Communicator c, Dune::TestSuite& t)
+{
+  const int rank = c.rank(), size = c.size();
+  const int next = (rank+1)%size, previous = (rank+size-1)%size;
+
+  // exchange with both neighbours, receives started before the sends
+  std::vector<Communicator::Request> requests;
+  int fromPrevious = -1, fromNext = -1;
+  requests.push_back(c.irecv(&fromPrevious, 1, previous, 5));
+  requests.push_back(c.irecv(&fromNext, 1, next, 6));
+  requests.push_back(c.isend(&rank, 1, next, 5));
+  requests.push_back(c.isend(&rank, 1, previous, 6));
+  c.waitall(requests);
+  t.check(fromPrevious == previous && fromNext == next) << "wrong nonblocking exchange";
+
+  // messages of unknown length from unknown ranks are probed first
+  std::vector<int> data(rank+1, rank);
+  Communicator::Request sent = c.isend(data.data(), rank+1, next, 7);
+  t.check(sent.test()) << "buffered send did not complete";
+  const Communicator::Status status = c.probe(Communicator::anySource, 7);
+  std::vector<int> received(status.count<int>());
+  Communicator::Request receive = c.irecv(received.data(), received.size(), status.source, 7);
+  t.check(receive.wait().source == previous && received == std::vector<int>(previous+1, previous))
+    << "wrong probed message";
+  sent.wait();
+
+  // nonblocking receives take the messages in the order they were started
+  Communicator::Request first = c.irecv(&fromPrevious, 1, Communicator::anySource, 8);
+  Communicator::Request second = c.irecv(&fromNext, 1, previous, 8);
+  c.barrier();
+  t.check(!first.test() && !second.test()) << "receive completed without a message";
+  c.barrier();
+  for(int i=0; i<2; ++i)
+    c.send(&i, 1, next, 8);
+  t.check(first.wait().tag == 8 && fromPrevious == 0 && second.wait().bytes == sizeof(int) && fromNext == 1)
+    << "nonblocking receives matched in the wrong order";
+
+  // longer messages than the buffer are an error
+  c.send(data.data(), rank+1, rank, 9);
+  Communicator::Request truncated = c.irecv(data.data(), rank, rank, 9);
+  try {
+    truncated.wait();
+    t.check(false) << "receiving into a too small buffer did not throw";
+  }
+  catch(const Dune::ParallelError&) {}
+  c.barrier();
+}
+
+void benchmark(int size, int reps)
+{
+  Communicator::run(size, [&](Communicator c)
+  {
+    Comm comm(c);
+    for(int len : {1, 1024, 65536}) {
+      std::vector<double> values(len, 1.0);
+      comm.barrier();
+      Dune::Timer timer;
+      for(int i=0; i<reps; ++i)
+        comm.sum(values.data(), len);
+      const double elapsed = comm.max(timer.elapsed());
+      if(comm.rank() == 0)
+        std::cout<<size<<" threads, allreduce of "<<len<<" doubles: "<<elapsed/reps<<" s"<<std::endl;
+    }
+  });
+}
+
+int main(int argc, char** argv)
+{
+  int reps = argc>1 ? std::atoi(argv[1]) : 10;
+  Dune::TestSuite t;
+  std::mutex mutex;
+
+  for(int size : {1, 2, 3, 4, 7}) {
+    Communicator::run(size, [&](Communicator c)
+    {
+      Dune::TestSuite local;
+      testReductions(Comm(c), local);
+      testCollectives(Comm(c), local);
+      testPointToPoint(c, local);
+      testNonblocking(c, local);
+      std::lock_guard<std::mutex> guard(mutex);
+      t.subTest(local);
+    });
+  }
+
+  // the failure of one rank releases the others
+  try {
+    Communicator::run(3, [](Communicator c)
+    {
+      if(c.rank() == 1)
+        DUNE_THROW(Dune::RangeError, "failure of rank 1");
+      Comm(c).barrier();
+    });
+    t.check(false) << "the failure of a rank was not rethrown";
+  }
+  catch(const Dune::RangeError&) {}
+
+  for(int size : {2, 4})
+    benchmark(size, reps);
+
+  return t.exit();
+}
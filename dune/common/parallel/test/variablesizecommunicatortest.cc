@@ -91,12 +91,67 @@ struct VarDataHandle
 
 };
 
+/**
+ * @brief Sends (i+2)%3 copies of the index i and counts the wrong values received.
+ */
+struct CheckDataHandle
+{
+    CheckDataHandle()
+    : errors(0)
+    {}
+    int errors;
+    typedef int DataType;
+    bool fixedsize()
+    {
+        return false;
+    }
+    template<class B>
+    void gather(B& buffer, int i)
+    {
+        for(int j=0; j<(i+2)%3; j++)
+            buffer.write(i);
+    }
+    template<class B>
+    void scatter(B& buffer, int i, int size)
+    {
+        if(size!=(i+2)%3)
+            ++errors;
+        for(;size>0;--size)
+        {
+            int index;
+            buffer.read(index);
+            if(index!=i)
+                ++errors;
+        }
+    }
+    std::size_t size(int i)
+    {
+        return (i+2)%3;
+    }
+};
+
+/**
+ * @brief A CheckDataHandle that may declare the sizes unchanged.
+ */
+struct CachedCheckDataHandle : public CheckDataHandle
+{
+    CachedCheckDataHandle()
+    : unchanged(false)
+    {}
+    bool unchanged;
+    bool sizesUnchanged()
+    {
+        return unchanged;
+    }
+};
+
 int main(int argc, char** argv)
 {
     MPI_Init(&argc, &argv);
     int procs, rank;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &procs);
+    int ret=0;
     if(procs==1)
     {
         typedef Dune::VariableSizeCommunicator<>::InterfaceMap Interface;
@@ -120,6 +175,15 @@ int main(int argc, char** argv)
         comm.forward(vhandle);
         std::cout<<"===================== backward ========================="<<std::endl;
         comm.backward(vhandle);
+        std::cout<<"=================== multiple handles ====================="<<std::endl;
+        Dune::VariableSizeCommunicator<> multiComm(MPI_COMM_SELF, inf, 256);
+        Dune::MultiDataHandle<MyDataHandle,MyDataHandle> fixedMulti(handle, handle);
+        multiComm.forward(fixedMulti);
+        Dune::MultiDataHandle<MyDataHandle,VarDataHandle> varMulti(handle, vhandle);
+        multiComm.forward(varMulti);
+        std::cout<<"============= without size negotiation ================="<<std::endl;
+        comm.setNegotiateSizes(false);
+        comm.forward(vhandle);
     }
     else
     {
@@ -192,9 +256,50 @@ int main(int argc, char** argv)
         if(rank==0)
             std::cout<<"===================== backward ========================="<<std::endl;
         comm.backward(vhandle);
+        MPI_Barrier(MPI_COMM_WORLD);
+        if(rank==0)
+            std::cout<<"=================== multiple handles ====================="<<std::endl;
+        MPI_Barrier(MPI_COMM_WORLD);
+
+        // The buffer size is counted in bytes for the combined handle.
+        Dune::VariableSizeCommunicator<> multiComm(MPI_COMM_WORLD, inf, 256);
+        CheckDataHandle check1, check2;
+        Dune::MultiDataHandle<MyDataHandle,CheckDataHandle,VarDataHandle,CheckDataHandle>
+            multi(handle, check1, vhandle, check2);
+        multiComm.forward(multi);
+        multiComm.backward(multi);
+        // entries with (i+2)%3==0 do not send any data
+        Dune::MultiDataHandle<CheckDataHandle,CheckDataHandle> checkMulti(check1, check2);
+        multiComm.forward(checkMulti);
+        int errors=check1.errors+check2.errors;
+
+        // Send the sizes along with the data
+        Dune::VariableSizeCommunicator<> probeComm(MPI_COMM_WORLD, inf);
+        probeComm.setNegotiateSizes(false);
+        CachedCheckDataHandle cachedCheck;
+        probeComm.forward(cachedCheck);
+        probeComm.backward(cachedCheck);
+        // Reuse the sizes of the previous communication
+        cachedCheck.unchanged=true;
+        for(int i=0; i<3; ++i)
+        {
+            probeComm.forward(cachedCheck);
+            probeComm.backward(cachedCheck);
+        }
+        // Processes may disagree on reusing the sizes
+        cachedCheck.unchanged=rank%2==0;
+        probeComm.forward(cachedCheck);
+        probeComm.backward(cachedCheck);
+        probeComm.forward(checkMulti);
+        errors+=cachedCheck.errors+check1.errors+check2.errors;
+        if(errors)
+            std::cerr<<rank<<": "<<errors<<" wrong values received with multiple handles"<<std::endl;
+        MPI_Allreduce(MPI_IN_PLACE, &errors, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+        if(errors)
+            ret=1;
     }
 
     MPI_Finalize();
 
-    return 0;
+    return ret;
 }
@@ -0,0 +1,879 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifndef DUNE_COMMON_PARALLEL_THREADCOMMUNICATOR_HH
+#define DUNE_COMMON_PARALLEL_THREADCOMMUNICATOR_HH
+
+/*!
+   \file
+   \brief A communicator whose processes are threads of one program, and
+   the collective communication on it.
+
+   \ingroup ParallelCommunication
+ */
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <dune/common/binaryfunctions.hh>
+#include <dune/common/exactsum.hh>
+#include <dune/common/exceptions.hh>
+#include <dune/common/parallel/collectivecommunication.hh>
+#include <dune/common/parallel/future.hh>
+#include <dune/common/typetraits.hh>
+#include <dune/common/unused.hh>
+
+namespace Dune
+{
+
+  namespace Impl
+  {
+    //! The values and the binary function a ThreadCommunicator reduces
+    template<typename Type, typename BinaryFunction, typename = void>
+    struct ThreadReduction
+    {
+      typedef Type Value;
+      typedef BinaryFunction Function;
+
+      static int count (int len)
+      {
+        return len;
+      }
+    };
+
+    //! Types described by ElementwiseReductionTraits are reduced as arrays of scalars
+    template<typename Type, typename BinaryFunction>
+    struct ThreadReduction<Type, BinaryFunction,
+                           void_t<std::enable_if_t<(ElementwiseReductionTraits<Type>::size > 1)
+                                                   && sizeof(Type) == ElementwiseReductionTraits<Type>::size
+                                                   * sizeof(typename ElementwiseReductionTraits<Type>::scalar_type)>,
+                                  typename ScalarBinaryFunction<BinaryFunction,
+                                                                typename ElementwiseReductionTraits<Type>::scalar_type>::type> >
+    {
+      typedef typename ElementwiseReductionTraits<Type>::scalar_type Value;
+      typedef typename ScalarBinaryFunction<BinaryFunction, Value>::type Function;
+
+      static int count (int len)
+      {
+        return len*ElementwiseReductionTraits<Type>::size;
+      }
+    };
+  }
+
+  /*! @brief A communicator whose processes are threads of one program.
+
+     run() starts a number of threads, the ranks, and passes each its
+     communicator. The threads exchange messages through queues in shared
+     memory, so parallel algorithms can be tested and timed with any
+     number of ranks without MPI or mpirun:
+     \code
+     ThreadCommunicator::run(4, [](ThreadCommunicator c)
+     {
+       CollectiveCommunication<ThreadCommunicator> comm(c);
+       double sum = comm.sum(1.0);
+       if(c.rank() > 0)
+         c.send(&sum, 1, 0, 0);
+     });
+     \endcode
+
+     Sends are buffered and never block. Messages from one rank to another
+     with the same tag are received in the order they were sent, like in
+     MPI. Besides the blocking operations there are the nonblocking ones
+     BufferedCommunicator and RemoteIndices are built on, isend(), irecv(),
+     probe() and waitall(), so their communication patterns can be
+     reproduced with threads. The classes themselves still call MPI
+     directly and cannot run on this communicator. The collective
+     operations are those of CollectiveCommunication<ThreadCommunicator>.
+     The data has to be trivially copyable.
+
+     If a rank throws, all ranks blocked in or entering a communication
+     throw a ParallelError, and run() rethrows the first exception.
+     The communicator is a handle, copies refer to the same rank.
+     \ingroup ParallelCommunication
+   */
+  class ThreadCommunicator
+  {
+    struct Message
+    {
+      int source;
+      int tag;
+      std::vector<char> data;
+    };
+
+    struct Receive;
+
+    struct State
+    {
+      explicit State (int size)
+        : size(size), queues(size), posted(size), slots(size), arrived(0), generation(0), aborted(false)
+      {}
+
+      const int size;
+      std::mutex mutex;
+      std::condition_variable changed;
+      // the messages waiting to be received by each rank
+      std::vector<std::deque<Message> > queues;
+      // the nonblocking receives of each rank waiting for a message
+      std::vector<std::deque<std::shared_ptr<Receive> > > posted;
+      // the data each rank contributes to the current collective operation
+      std::vector<const void*> slots;
+      int arrived;
+      std::size_t generation;
+      bool aborted;
+    };
+
+  public:
+    //! Matches messages from any rank in recv()
+    static constexpr int anySource = -1;
+    //! Matches messages with any tag in recv()
+    static constexpr int anyTag = -1;
+
+    //! The sender, tag and size of a message
+    struct Status
+    {
+      int source;
+      int tag;
+      //! The size of the message in bytes
+      std::size_t bytes;
+
+      //! The number of values of type T in the message
+      template<class T>
+      int count () const
+      {
+        return bytes/sizeof(T);
+      }
+    };
+
+    /*! @brief The handle of a nonblocking operation.
+
+       Copies refer to the same operation.
+     */
+    class Request
+    {
+    public:
+      //! Whether the operation completed
+      bool test () const;
+
+      /*! @brief Wait until the operation completed.
+
+         @returns The status of the received or sent message.
+         @throws ParallelError if the message was longer than the buffer
+         of the receive, or another rank failed.
+       */
+      Status wait () const;
+
+    private:
+      friend class ThreadCommunicator;
+
+      Request (std::shared_ptr<State> state, std::shared_ptr<Receive> receive)
+        : state_(std::move(state)), receive_(std::move(receive))
+      {}
+
+      std::shared_ptr<State> state_;
+      std::shared_ptr<Receive> receive_;
+    };
+
+    /*! @brief Call f(communicator) on size threads and wait for them.
+
+       @throws The first exception thrown by one of the threads.
+     */
+    template<class F>
+    static void run (int size, F&& f);
+
+    //! The rank of this thread, between 0 and size()-1
+    int rank () const
+    {
+      return rank_;
+    }
+
+    //! The number of threads communicating
+    int size () const
+    {
+      return state_->size;
+    }
+
+    //! Send len values to rank dest, returns immediately
+    template<class T>
+    void send (const T* data, int len, int dest, int tag) const;
+
+    /*! @brief Send len values to rank dest.
+
+       As sends are buffered, the returned request is already completed
+       and data may be reused immediately.
+     */
+    template<class T>
+    Request isend (const T* data, int len, int dest, int tag) const;
+
+    /*! @brief Start receiving at most len values from rank source.
+
+       Nonblocking receives are matched with the messages in the order they
+       were started, before the blocking ones. The buffer has to stay valid
+       until the request completed.
+       @param source The rank of the sender or anySource.
+       @param tag The tag of the message or anyTag.
+     */
+    template<class T>
+    Request irecv (T* data, int len, int source, int tag) const;
+
+    /*! @brief Wait for a matching message without receiving it.
+
+       The message is received by the next receive matching it, unless a
+       nonblocking receive started later takes it before.
+     */
+    Status probe (int source, int tag) const;
+
+    //! Wait until all requests completed
+    static void waitall (const std::vector<Request>& requests);
+
+    /*! @brief Receive at most len values from rank source.
+
+       Blocks until a matching message arrived.
+       @param source The rank of the sender or anySource.
+       @param tag The tag of the message or anyTag.
+       @returns The rank of the sender.
+       @throws ParallelError if the message is longer than len values.
+     */
+    template<class T>
+    int recv (T* data, int len, int source, int tag) const;
+
+    /*! @brief Receive a message of any length from rank source.
+
+       The vector is resized to the length of the message.
+       @returns The rank of the sender.
+     */
+    template<class T>
+    int recv (std::vector<T>& data, int source, int tag) const;
+
+    //! Wait until all ranks arrived
+    void barrier () const;
+
+    /*! @brief The building block of the collective operations.
+
+       Each rank passes a pointer to its data. Once all ranks arrived,
+       f is called on each rank with the pointers of all ranks, indexed by
+       rank. The data has to stay unchanged until all ranks returned from
+       f, which is the case when exchange returns.
+     */
+    template<class F>
+    void exchange (const void* data, F&& f) const;
+
+  private:
+    ThreadCommunicator (std::shared_ptr<State> state, int rank)
+      : state_(std::move(state)), rank_(rank)
+    {}
+
+    // A nonblocking receive and, once completed, its message
+    struct Receive
+    {
+      char* data;
+      std::size_t capacity;
+      Status status;
+      bool done;
+    };
+
+    // Whether the message with source and tag matches the receive
+    static bool matches (int source, int tag, int messageSource, int messageTag)
+    {
+      return (source == anySource || messageSource == source) && (tag == anyTag || messageTag == tag);
+    }
+
+    // Copy the message into the buffer of the receive and complete it
+    static void complete (Receive& receive, int source, int tag, const char* data, std::size_t bytes);
+
+    // Wait for the condition with the lock held, throws if a rank failed
+    template<class Condition>
+    static void wait (State& state, std::unique_lock<std::mutex>& lock, Condition condition);
+
+    std::shared_ptr<State> state_;
+    int rank_;
+  };
+
+  /*! @brief Collective communication between the threads of a ThreadCommunicator.
+
+     The ranks reduce the contributions of all ranks in the order of their
+     ranks, so results are identical on all ranks and between runs.
+     Sums, products, minima and maxima of FieldVector and std::array are
+     computed element-wise. The nonblocking operations complete before
+     they return.
+
+     \ingroup ParallelCommunication
+   */
+  template<>
+  class CollectiveCommunication<ThreadCommunicator>
+  {
+  public:
+    //! Instantiation using a thread communicator
+    CollectiveCommunication (const ThreadCommunicator& c)
+      : communicator_(c), reproducibleSums_(false)
+    {}
+
+    //! @copydoc CollectiveCommunication::rank
+    int rank () const
+    {
+      return communicator_.rank();
+    }
+
+    //! @copydoc CollectiveCommunication::size
+    int size () const
+    {
+      return communicator_.size();
+    }
+
+    //! @copydoc CollectiveCommunication::setReproducibleSums
+    void setReproducibleSums (bool reproducible)
+    {
+      reproducibleSums_ = reproducible;
+    }
+
+    //! @copydoc CollectiveCommunication::reproducibleSums
+    bool reproducibleSums () const
+    {
+      return reproducibleSums_;
+    }
+
+    //! @copydoc CollectiveCommunication::sum
+    template<typename T>
+    T sum (const T& in) const
+    {
+      T out;
+      sum(&in, &out, 1, HasExactSum<T>());
+      return out;
+    }
+
+    //! @copydoc CollectiveCommunication::sum
+    template<typename T>
+    int sum (T* inout, int len) const
+    {
+      return sum(inout, inout, len, HasExactSum<T>());
+    }
+
+    //! @copydoc CollectiveCommunication::prod
+    template<typename T>
+    T prod (const T& in) const
+    {
+      T out;
+      allreduce<std::multiplies<T> >(&in, &out, 1);
+      return out;
+    }
+
+    //! @copydoc CollectiveCommunication::prod
+    template<typename T>
+    int prod (T* inout, int len) const
+    {
+      return allreduce<std::multiplies<T> >(inout, len);
+    }
+
+    //! @copydoc CollectiveCommunication::min
+    template<typename T>
+    T min (const T& in) const
+    {
+      T out;
+      allreduce<Min<T> >(&in, &out, 1);
+      return out;
+    }
+
+    //! @copydoc CollectiveCommunication::min
+    template<typename T>
+    int min (T* inout, int len) const
+    {
+      return allreduce<Min<T> >(inout, len);
+    }
+
+    //! @copydoc CollectiveCommunication::max
+    template<typename T>
+    T max (const T& in) const
+    {
+      T out;
+      allreduce<Max<T> >(&in, &out, 1);
+      return out;
+    }
+
+    //! @copydoc CollectiveCommunication::max
+    template<typename T>
+    int max (T* inout, int len) const
+    {
+      return allreduce<Max<T> >(inout, len);
+    }
+
+    //! @copydoc CollectiveCommunication::barrier
+    int barrier () const
+    {
+      communicator_.barrier();
+      return 0;
+    }
+
+    //! @copydoc CollectiveCommunication::broadcast
+    template<typename T>
+    int broadcast (T* inout, int len, int root) const
+    {
+      communicator_.exchange(inout, [&](const std::vector<const void*>& data)
+      {
+        if(rank() != root)
+          std::copy_n(static_cast<const T*>(data[root]), len, inout);
+      });
+      return 0;
+    }
+
+    //! @copydoc CollectiveCommunication::gather()
+    template<typename T>
+    int gather (const T* in, T* out, int len, int root) const
+    {
+      communicator_.exchange(in, [&](const std::vector<const void*>& data)
+      {
+        if(rank() == root)
+          for(int p=0; p<size(); ++p)
+            std::copy_n(static_cast<const T*>(data[p]), len, out+p*len);
+      });
+      return 0;
+    }
+
+    //! @copydoc CollectiveCommunication::gatherv()
+    template<typename T>
+    int gatherv (const T* in, int sendlen, T* out, int* recvlen, int* displ, int root) const
+    {
+      DUNE_UNUSED_PARAMETER(sendlen);
+      communicator_.exchange(in, [&](const std::vector<const void*>& data)
+      {
+        if(rank() == root)
+          for(int p=0; p<size(); ++p)
+            std::copy_n(static_cast<const T*>(data[p]), recvlen[p], out+displ[p]);
+      });
+      return 0;
+    }
+
+    //! @copydoc CollectiveCommunication::scatter()
+    template<typename T>
+    int scatter (const T* send, T* recv, int len, int root) const
+    {
+      communicator_.exchange(send, [&](const std::vector<const void*>& data)
+      {
+        std::copy_n(static_cast<const T*>(data[root])+rank()*len, len, recv);
+      });
+      return 0;
+    }
+
+    //! @copydoc CollectiveCommunication::scatterv()
+    template<typename T>
+    int scatterv (const T* send, int* sendlen, int* displ, T* recv, int recvlen, int root) const
+    {
+      DUNE_UNUSED_PARAMETER(recvlen);
+      // only the arguments of the root are used
+      const std::tuple<const T*, int*, int*> arguments(send, sendlen, displ);
+      communicator_.exchange(&arguments, [&](const std::vector<const void*>& data)
+      {
+        const auto& a = *static_cast<const std::tuple<const T*, int*, int*>*>(data[root]);
+        std::copy_n(std::get<0>(a)+std::get<2>(a)[rank()], std::get<1>(a)[rank()], recv);
+      });
+      return 0;
+    }
+
+    //! @copydoc CollectiveCommunication::allgather()
+    template<typename T, typename T1>
+    int allgather (const T* sbuf, int count, T1* rbuf) const
+    {
+      communicator_.exchange(sbuf, [&](const std::vector<const void*>& data)
+      {
+        for(int p=0; p<size(); ++p)
+          std::copy_n(static_cast<const T*>(data[p]), count, rbuf+p*count);
+      });
+      return 0;
+    }
+
+    //! @copydoc CollectiveCommunication::allgatherv()
+    template<typename T>
+    int allgatherv (const T* in, int sendlen, T* out, int* recvlen, int* displ) const
+    {
+      DUNE_UNUSED_PARAMETER(sendlen);
+      communicator_.exchange(in, [&](const std::vector<const void*>& data)
+      {
+        for(int p=0; p<size(); ++p)
+          std::copy_n(static_cast<const T*>(data[p]), recvlen[p], out+displ[p]);
+      });
+      return 0;
+    }
+
+    //! @copydoc CollectiveCommunication::allreduce(Type* inout, int len) const
+    template<typename BinaryFunction, typename Type>
+    int allreduce (Type* inout, int len) const
+    {
+      return allreduce<BinaryFunction>(inout, inout, len);
+    }
+
+    //! @copydoc CollectiveCommunication::allreduce(const Type* in, Type* out, int len) const
+    template<typename BinaryFunction, typename Type>
+    int allreduce (const Type* in, Type* out, int len) const
+    {
+      typedef Impl::ThreadReduction<Type, BinaryFunction> Reduction;
+      typedef typename Reduction::Value Value;
+      const int count = Reduction::count(len);
+      typename Reduction::Function reduce;
+      std::vector<Value> result;
+      communicator_.exchange(in, [&](const std::vector<const void*>& data)
+      {
+        const Value* first = static_cast<const Value*>(data[0]);
+        result.assign(first, first+count);
+        for(int p=1; p<size(); ++p) {
+          const Value* contribution = static_cast<const Value*>(data[p]);
+          for(int i=0; i<count; ++i)
+            result[i] = reduce(result[i], contribution[i]);
+        }
+      });
+      // in and out may be the same, so copy after all ranks read in
+      std::copy(result.begin(), result.end(), reinterpret_cast<Value*>(out));
+      return 0;
+    }
+
+    //! @copydoc CollectiveCommunication::allreduce(const std::tuple<std::pair<Type,BinaryFunction>...>&) const
+    template<typename... Type, typename... BinaryFunction>
+    std::tuple<Type...> allreduce (const std::tuple<std::pair<Type,BinaryFunction>...>& values) const
+    {
+      std::tuple<Type...> in = Impl::reductionValues(values, std::index_sequence_for<Type...>());
+      std::tuple<Type...> out;
+      allreduce<TupleBinaryFunction<BinaryFunction...> >(&in, &out, 1);
+      return out;
+    }
+
+    //! @copydoc CollectiveCommunication::iallreduce(const Type&) const
+    template<typename BinaryFunction, typename Type>
+    PseudoFuture<Type> iallreduce (const Type& in) const
+    {
+      Type out;
+      allreduce<BinaryFunction>(&in, &out, 1);
+      return PseudoFuture<Type>(out);
+    }
+
+    //! @copydoc CollectiveCommunication::iallreduce(const Type*, Type*, int) const
+    template<typename BinaryFunction, typename Type>
+    PseudoFuture<void> iallreduce (const Type* in, Type* out, int len) const
+    {
+      allreduce<BinaryFunction>(in, out, len);
+      return PseudoFuture<void>();
+    }
+
+    //! @copydoc CollectiveCommunication::iallreduce(const std::tuple<std::pair<Type,BinaryFunction>...>&) const
+    template<typename... Type, typename... BinaryFunction>
+    PseudoFuture<std::tuple<Type...> >
+    iallreduce (const std::tuple<std::pair<Type,BinaryFunction>...>& values) const
+    {
+      return PseudoFuture<std::tuple<Type...> >(allreduce(values));
+    }
+
+    //! @copydoc CollectiveCommunication::isum
+    template<typename T>
+    PseudoFuture<T> isum (const T& in) const
+    {
+      return PseudoFuture<T>(sum(in));
+    }
+
+    //! @copydoc CollectiveCommunication::iprod
+    template<typename T>
+    PseudoFuture<T> iprod (const T& in) const
+    {
+      return PseudoFuture<T>(prod(in));
+    }
+
+    //! @copydoc CollectiveCommunication::imin
+    template<typename T>
+    PseudoFuture<T> imin (const T& in) const
+    {
+      return PseudoFuture<T>(min(in));
+    }
+
+    //! @copydoc CollectiveCommunication::imax
+    template<typename T>
+    PseudoFuture<T> imax (const T& in) const
+    {
+      return PseudoFuture<T>(max(in));
+    }
+
+    //! @copydoc CollectiveCommunication::ibarrier
+    PseudoFuture<void> ibarrier () const
+    {
+      barrier();
+      return PseudoFuture<void>();
+    }
+
+    //! @copydoc CollectiveCommunication::ibroadcast
+    template<typename T>
+    PseudoFuture<void> ibroadcast (T* inout, int len, int root) const
+    {
+      broadcast(inout, len, root);
+      return PseudoFuture<void>();
+    }
+
+    //! @copydoc CollectiveCommunication::iallgather
+    template<typename T>
+    PseudoFuture<void> iallgather (const T* sbuf, int count, T* rbuf) const
+    {
+      allgather(sbuf, count, rbuf);
+      return PseudoFuture<void>();
+    }
+
+    //! The thread communicator
+    operator ThreadCommunicator () const
+    {
+      return communicator_;
+    }
+
+  private:
+    //! Whether sums of T can be made reproducible with ExactSum
+    template<typename T>
+    using HasExactSum = std::integral_constant<bool, std::is_same<T,double>::value
+                                                     || std::is_same<T,float>::value>;
+
+    template<typename T>
+    int sum (const T* in, T* out, int len, std::false_type) const
+    {
+      return allreduce<std::plus<T> >(in, out, len);
+    }
+
+    template<typename T>
+    int sum (const T* in, T* out, int len, std::true_type) const
+    {
+      if(!reproducibleSums_)
+        return sum(in, out, len, std::false_type());
+      std::vector<ExactSum> sums(in, in+len);
+      int ret = allreduce<std::plus<ExactSum> >(sums.data(), len);
+      for(int i=0; i<len; ++i)
+        out[i] = T(sums[i].value());
+      return ret;
+    }
+
+    ThreadCommunicator communicator_;
+    bool reproducibleSums_;
+  };
+
+#ifndef DOXYGEN
+
+  template<class F>
+  void ThreadCommunicator::run (int size, F&& f)
+  {
+    if(size < 1)
+      DUNE_THROW(RangeError, "A thread communicator needs at least one rank");
+    std::shared_ptr<State> state = std::make_shared<State>(size);
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    auto rank = [&](int r)
+    {
+      try {
+        f(ThreadCommunicator(state, r));
+      }
+      catch(...) {
+        {
+          std::lock_guard<std::mutex> guard(errorMutex);
+          if(!error)
+            error = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->aborted = true;
+        state->changed.notify_all();
+      }
+    };
+
+    // the calling thread is rank 0
+    std::vector<std::thread> threads;
+    threads.reserve(size-1);
+    for(int r=1; r<size; ++r)
+      threads.emplace_back(rank, r);
+    rank(0);
+    for(std::thread& thread : threads)
+      thread.join();
+    if(error)
+      std::rethrow_exception(error);
+  }
+
+  template<class Condition>
+  void ThreadCommunicator::wait (State& state, std::unique_lock<std::mutex>& lock, Condition condition)
+  {
+    state.changed.wait(lock, [&] { return state.aborted || condition(); });
+    if(state.aborted)
+      DUNE_THROW(ParallelError, "Another rank of the thread communicator failed");
+  }
+
+  template<class T>
+  void ThreadCommunicator::send (const T* data, int len, int dest, int tag) const
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable data can be sent");
+    if(dest < 0 || dest >= size())
+      DUNE_THROW(RangeError, "Invalid destination rank " << dest);
+    const std::size_t bytes = len*sizeof(T);
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    // the oldest matching nonblocking receive takes the message directly
+    std::deque<std::shared_ptr<Receive> >& posted = state_->posted[dest];
+    auto receive = std::find_if(posted.begin(), posted.end(), [&](const std::shared_ptr<Receive>& r)
+    {
+      return matches(r->status.source, r->status.tag, rank_, tag);
+    });
+    if(receive != posted.end()) {
+      complete(**receive, rank_, tag, reinterpret_cast<const char*>(data), bytes);
+      posted.erase(receive);
+    }else{
+      Message message{rank_, tag, std::vector<char>(bytes)};
+      if(len > 0)
+        std::memcpy(message.data.data(), data, bytes);
+      state_->queues[dest].push_back(std::move(message));
+    }
+    state_->changed.notify_all();
+  }
+
+  template<class T>
+  ThreadCommunicator::Request ThreadCommunicator::isend (const T* data, int len, int dest, int tag) const
+  {
+    send(data, len, dest, tag);
+    std::shared_ptr<Receive> sent = std::make_shared<Receive>();
+    sent->capacity = len*sizeof(T);
+    sent->status = Status{rank_, tag, sent->capacity};
+    sent->done = true;
+    return Request(state_, std::move(sent));
+  }
+
+  template<class T>
+  ThreadCommunicator::Request ThreadCommunicator::irecv (T* data, int len, int source, int tag) const
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable data can be received");
+    std::shared_ptr<Receive> receive = std::make_shared<Receive>();
+    receive->data = reinterpret_cast<char*>(data);
+    receive->capacity = len*sizeof(T);
+    receive->status = Status{source, tag, 0};
+    receive->done = false;
+
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    std::deque<Message>& queue = state_->queues[rank_];
+    auto message = std::find_if(queue.begin(), queue.end(), [&](const Message& m)
+    {
+      return matches(source, tag, m.source, m.tag);
+    });
+    if(message != queue.end()) {
+      complete(*receive, message->source, message->tag, message->data.data(), message->data.size());
+      queue.erase(message);
+    }else
+      state_->posted[rank_].push_back(receive);
+    return Request(state_, std::move(receive));
+  }
+
+  inline ThreadCommunicator::Status ThreadCommunicator::probe (int source, int tag) const
+  {
+    std::deque<Message>& queue = state_->queues[rank_];
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    std::deque<Message>::iterator message;
+    wait(*state_, lock, [&]
+    {
+      message = std::find_if(queue.begin(), queue.end(), [&](const Message& m)
+      {
+        return matches(source, tag, m.source, m.tag);
+      });
+      return message != queue.end();
+    });
+    return Status{message->source, message->tag, message->data.size()};
+  }
+
+  inline void ThreadCommunicator::waitall (const std::vector<Request>& requests)
+  {
+    for(const Request& request : requests)
+      request.wait();
+  }
+
+  inline void ThreadCommunicator::complete (Receive& receive, int source, int tag,
+                                            const char* data, std::size_t bytes)
+  {
+    // a truncated message is reported when waiting for the receive
+    if(bytes > 0 && receive.capacity > 0)
+      std::memcpy(receive.data, data, std::min(bytes, receive.capacity));
+    receive.status = Status{source, tag, bytes};
+    receive.done = true;
+  }
+
+  inline bool ThreadCommunicator::Request::test () const
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return receive_->done;
+  }
+
+  inline ThreadCommunicator::Status ThreadCommunicator::Request::wait () const
+  {
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    ThreadCommunicator::wait(*state_, lock, [&] { return receive_->done; });
+    if(receive_->status.bytes > receive_->capacity)
+      DUNE_THROW(ParallelError, "Received " << receive_->status.bytes << " bytes from rank "
+                 << receive_->status.source << " into a buffer for " << receive_->capacity);
+    return receive_->status;
+  }
+
+  template<class T>
+  int ThreadCommunicator::recv (std::vector<T>& data, int source, int tag) const
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable data can be received");
+    std::deque<Message>& queue = state_->queues[rank_];
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    typename std::deque<Message>::iterator message;
+    wait(*state_, lock, [&]
+    {
+      message = std::find_if(queue.begin(), queue.end(), [&](const Message& m)
+      {
+        return matches(source, tag, m.source, m.tag);
+      });
+      return message != queue.end();
+    });
+    Message received = std::move(*message);
+    queue.erase(message);
+    lock.unlock();
+
+    data.resize(received.data.size()/sizeof(T));
+    if(!data.empty())
+      std::memcpy(data.data(), received.data.data(), data.size()*sizeof(T));
+    return received.source;
+  }
+
+  template<class T>
+  int ThreadCommunicator::recv (T* data, int len, int source, int tag) const
+  {
+    std::vector<T> message;
+    const int sender = recv(message, source, tag);
+    if(message.size() > std::size_t(len))
+      DUNE_THROW(ParallelError, "Received " << message.size() << " values from rank " << sender
+                 << " into a buffer for " << len);
+    std::copy(message.begin(), message.end(), data);
+    return sender;
+  }
+
+  inline void ThreadCommunicator::barrier () const
+  {
+    State& state = *state_;
+    std::unique_lock<std::mutex> lock(state.mutex);
+    if(state.aborted)
+      DUNE_THROW(ParallelError, "Another rank of the thread communicator failed");
+    const std::size_t generation = state.generation;
+    if(++state.arrived == state.size) {
+      state.arrived = 0;
+      ++state.generation;
+      state.changed.notify_all();
+    }else
+      wait(state, lock, [&] { return state.generation != generation; });
+  }
+
+  template<class F>
+  void ThreadCommunicator::exchange (const void* data, F&& f) const
+  {
+    // each rank only writes its own slot before the barrier
+    state_->slots[rank_] = data;
+    barrier();
+    f(state_->slots);
+    barrier();
+  }
+
+#endif // DOXYGEN
+
+} // namespace Dune
+
+#endif
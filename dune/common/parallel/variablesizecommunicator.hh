@@ -11,11 +11,16 @@
 #include <functional>
 #include <map>
 #include <memory>
+#include <tuple>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
 #include <mpi.h>
 
+#include <dune/common/exceptions.hh>
+#include <dune/common/hybridutilities.hh>
+#include <dune/common/parallel/communicationprofiler.hh>
 #include <dune/common/parallel/interface.hh>
 #include <dune/common/parallel/mpitraits.hh>
 #include <dune/common/unused.hh>
@@ -83,6 +88,30 @@ public:
     data=buffer_[position_++];
   }
 
+  /**
+   * @brief Write several items to the buffer.
+   * @param data The first of the data items to write.
+   * @param n The number of items to write.
+   */
+  void write(const T* data, std::size_t n)
+  {
+    assert(position_+n<=size_);
+    std::copy_n(data, n, buffer_+position_);
+    position_+=n;
+  }
+
+  /**
+   * @brief Reads several data items from the buffer.
+   * @param[out] data Where to store the first of the items read.
+   * @param n The number of items to read.
+   */
+  void read(T* data, std::size_t n)
+  {
+    assert(position_+n<=size_);
+    std::copy_n(buffer_+position_, n, data);
+    position_+=n;
+  }
+
   /**
    * @brief Reset the buffer.
    *
@@ -385,6 +414,12 @@ public:
    * template<class MessageBuffer>
    * void scatter(MessageBuffer& buf, std::size_t i, std::size_t n);
    * \endcode
+   * Optionally the handle may provide
+   * \code{.cpp}
+   * // returns whether no size changed since the last communication
+   * bool sizesUnchanged();
+   * \endcode
+   * to allow for reusing the sizes of variable sized data, see setNegotiateSizes().
    * @param handle A handle responsible for describing the data, gathering, and scattering it.
    */
   template<class DataHandle>
@@ -410,6 +445,12 @@ public:
    * template<class MessageBuffer>
    * void scatter(MessageBuffer& buf, std::size_t i, std::size_t n);
    * \endcode
+   * Optionally the handle may provide
+   * \code{.cpp}
+   * // returns whether no size changed since the last communication
+   * bool sizesUnchanged();
+   * \endcode
+   * to allow for reusing the sizes of variable sized data, see setNegotiateSizes().
    * @param handle A handle responsible for describing the data, gathering, and scattering it.
    */
   template<class DataHandle>
@@ -418,6 +459,31 @@ public:
     communicate<false>(handle);
   }
 
+  /**
+   * @brief Set whether the sizes of variable sized data are negotiated before sending it.
+   *
+   * By default the number of data items per index is communicated first and
+   * afterwards the data is sent in chunks of at most the maximum buffer size.
+   * This needs two rounds of messages.
+   *
+   * Without size negotiation all data for a process is packed into one message
+   * that is sent along with the sizes. The receiver probes for the message
+   * (using MPI_Improbe and MPI_Mrecv if MPI-3 is available) to allocate a
+   * buffer large enough. Thus the maximum buffer size is not obeyed.
+   *
+   * If the data handle has a method sizesUnchanged() returning true, the sizes
+   * of the previous communication in the same direction are not sent again.
+   * Instead an empty size message tells the receiver to reuse the sizes it
+   * received before. Processes may decide this differently, but the
+   * interface must not change in between.
+   *
+   * @param negotiate Whether to negotiate the sizes (default true).
+   */
+  void setNegotiateSizes(bool negotiate)
+  {
+    negotiateSizes_ = negotiate;
+  }
+
 private:
   template<bool FORWARD, class DataHandle>
   void communicateSizes(DataHandle& handle,
@@ -462,6 +528,29 @@ private:
    */
   template<bool FORWARD, class DataHandle>
   void communicateVariableSize(DataHandle& handle);
+  /**
+   * @brief Communicate data with a variable amount of data per entry in one message
+   * per process without negotiating the sizes first.
+   * @tparam FORWARD If true we send in the forward direction.
+   * @tparam DataHandle DataHandle The type of the data handle.
+   * @param handle The handle describing the data and responsible for gather
+   * and scatter operations.
+   */
+  template<bool FORWARD, class DataHandle>
+  void communicateVariableSizeProbe(DataHandle& handle);
+  /**
+   * @brief The number of data items per index of the last communication without
+   * size negotiation.
+   */
+  struct SizeCache
+  {
+    /** @brief Whether the sizes are set. */
+    bool valid = false;
+    /** @brief The sizes of the sending side for each neighbour. */
+    std::vector<std::vector<std::size_t> > send;
+    /** @brief The sizes of the receiving side for each neighbour. */
+    std::vector<std::vector<std::size_t> > recv;
+  };
   /**
    * @brief The maximum size if the buffers used for gather and scatter.
    *
@@ -477,6 +566,14 @@ private:
    * indices to scatter received data to during forward.
    */
   const InterfaceMap* interface_;
+  /**
+   * @brief Whether the sizes of variable sized data are negotiated before sending.
+   */
+  bool negotiateSizes_ = true;
+  /**
+   * @brief The sizes of the backward (0) and forward (1) communication.
+   */
+  SizeCache sizeCache_[2];
   /**
    * @brief The communicator.
    *
@@ -485,6 +582,134 @@ private:
   MPI_Comm communicator_;
 };
 
+/**
+ * @brief A data handle communicating the data of several data handles at once.
+ *
+ * Communicating it with a VariableSizeCommunicator sends the data of all
+ * handles in one message per process instead of one message per process and
+ * handle:
+ * \code
+ * MultiDataHandle<VelocityHandle,PressureHandle> handle(velocity, pressure);
+ * communicator.forward(handle);
+ * \endcode
+ * The handles may use different data types, which need to be trivially
+ * copyable, as the data is packed bytewise. If not all of the handles have a
+ * fixed size, the number of data items of each handle is sent along with
+ * each entry. Note that the maximum buffer size of the communicator is
+ * counted in bytes for this handle.
+ *
+ * @tparam DataHandles The types of the handles, see VariableSizeCommunicator::forward
+ * for the interface they have to adhere to.
+ */
+template<class... DataHandles>
+class MultiDataHandle
+{
+  template<std::size_t k>
+  using HandleDataType = typename std::tuple_element<k, std::tuple<DataHandles...> >::type::DataType;
+
+  /**
+   * @brief Message buffer adapter writing and reading items of one handle as bytes.
+   */
+  template<class T, class B>
+  class ItemBuffer
+  {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "MultiDataHandle can only combine handles of trivially copyable data");
+
+  public:
+    ItemBuffer(B& buffer)
+      : buffer_(buffer)
+    {}
+
+    void write(const T& data)
+    {
+      buffer_.write(reinterpret_cast<const unsigned char*>(&data), sizeof(T));
+    }
+
+    void read(T& data)
+    {
+      buffer_.read(reinterpret_cast<unsigned char*>(&data), sizeof(T));
+    }
+
+  private:
+    B& buffer_;
+  };
+
+public:
+  typedef unsigned char DataType;
+
+  /**
+   * @brief Constructor.
+   * @param handles The data handles. They are stored by reference.
+   */
+  MultiDataHandle(DataHandles&... handles)
+    : handles_(handles...)
+  {}
+
+  bool fixedsize()
+  {
+    bool fixed=true;
+    Hybrid::forEach(std::index_sequence_for<DataHandles...>(), [&](auto k) {
+        fixed = std::get<decltype(k)::value>(handles_).fixedsize() && fixed;
+      });
+    return fixed;
+  }
+
+  std::size_t size(std::size_t i)
+  {
+    const bool fixed = fixedsize();
+    std::size_t items=0, bytes=0;
+    Hybrid::forEach(std::index_sequence_for<DataHandles...>(), [&](auto k) {
+        std::size_t n = std::get<decltype(k)::value>(handles_).size(i);
+        items += n;
+        bytes += n*sizeof(HandleDataType<decltype(k)::value>);
+        if(!fixed)
+          bytes += sizeof(std::size_t);
+      });
+    // Entries without any data are skipped by the communicator.
+    return items ? bytes : 0;
+  }
+
+  template<class B>
+  void gather(B& buffer, std::size_t i)
+  {
+    const bool fixed = fixedsize();
+    if(!fixed && !size(i))
+      return;
+    Hybrid::forEach(std::index_sequence_for<DataHandles...>(), [&](auto k) {
+        auto& handle = std::get<decltype(k)::value>(handles_);
+        if(!fixed) {
+          ItemBuffer<std::size_t,B> sizeBuffer(buffer);
+          sizeBuffer.write(handle.size(i));
+        }
+        ItemBuffer<HandleDataType<decltype(k)::value>,B> itemBuffer(buffer);
+        handle.gather(itemBuffer, i);
+      });
+  }
+
+  template<class B>
+  void scatter(B& buffer, std::size_t i, std::size_t n)
+  {
+    const bool fixed = fixedsize();
+    Hybrid::forEach(std::index_sequence_for<DataHandles...>(), [&](auto k) {
+        auto& handle = std::get<decltype(k)::value>(handles_);
+        std::size_t items=0;
+        // Nothing, not even the item counts, was sent for entries without data.
+        if(fixed)
+          items = handle.size(i);
+        else if(n){
+          ItemBuffer<std::size_t,B> sizeBuffer(buffer);
+          sizeBuffer.read(items);
+        }
+        ItemBuffer<HandleDataType<decltype(k)::value>,B> itemBuffer(buffer);
+        handle.scatter(itemBuffer, i, items);
+      });
+  }
+
+private:
+  std::tuple<DataHandles&...> handles_;
+};
+
 /** @} */
 namespace
 {
@@ -765,6 +990,11 @@ struct SetupSendRequest{
                   MPI_Comm comm) const
   {
     buffer.reset();
+    // Skip indices of zero size.
+    while(!tracker.finished() &&  !handle.size(tracker.index()))
+      tracker.moveToNextIndex();
+    if(tracker.finished())
+      return;
     int size=PackEntries<DataHandle>()(handle, tracker, buffer);
     // Skip indices of zero size.
     while(!tracker.finished() &&  !handle.size(tracker.index()))
@@ -868,7 +1098,9 @@ std::size_t checkAndContinue(DataHandle& handle,
       comm_func(handle, tracker, buffers[*index], requests2[*index], comm);
       tracker.skipZeroIndices();
       if(valid)
-      no_completed-=!tracker.finished(); // communication not finished, decrement counter for finished ones.
+        // Packing might already have finished the tracker. The communication
+        // is only complete once the request just started finishes, too.
+        no_completed-=requests2[*index]!=MPI_REQUEST_NULL;
     }
   }
   return no_completed;
@@ -971,10 +1203,26 @@ std::size_t setupRequests(DataHandle& handle,
   for(TIter titer=trackers.begin(), end=trackers.end(); titer!=end; ++titer, ++biter, ++riter)
   {
     setupFunctor(handle, *titer, *biter, *riter, communicator);
-    complete+=titer->finished();
+    // Trackers with pending requests are counted when they finish.
+    complete+=*riter==MPI_REQUEST_NULL;
   }
   return complete;
 }
+
+/**
+ * @brief Whether the handle declares the sizes unchanged since the last communication.
+ */
+template<class DataHandle>
+auto sizesUnchanged(DataHandle& handle, int) -> decltype(bool(handle.sizesUnchanged()))
+{
+  return handle.sizesUnchanged();
+}
+
+template<class DataHandle>
+bool sizesUnchanged(DataHandle&, long)
+{
+  return false;
+}
 } // end unnamed namespace
 
 template<class Allocator>
@@ -1073,8 +1321,8 @@ void VariableSizeCommunicator<Allocator>::communicateSizes(DataHandle& handle,
   std::vector<InterfaceTracker> send_trackers;
   std::vector<InterfaceTracker> recv_trackers;
   std::size_t size = interface_->size();
-  std::vector<MPI_Request> send_requests(size);
-  std::vector<MPI_Request> recv_requests(size);
+  std::vector<MPI_Request> send_requests(size, MPI_REQUEST_NULL);
+  std::vector<MPI_Request> recv_requests(size, MPI_REQUEST_NULL);
   std::vector<MessageBuffer<std::size_t> >
     send_buffers(size, MessageBuffer<std::size_t>(maxBufferSize_)),
     recv_buffers(size, MessageBuffer<std::size_t>(maxBufferSize_));
@@ -1133,8 +1381,11 @@ void VariableSizeCommunicator<Allocator>::communicateVariableSize(DataHandle& ha
   // Setup requests for sending and receiving.
   no_to_send -= setupRequests(handle, send_trackers, send_buffers, send_requests,
                 SetupSendRequest<DataHandle>(), communicator_);
-  setupRequests(handle, recv_trackers, recv_buffers, recv_requests,
-                SetupRecvRequest<DataHandle>(), communicator_);
+  // Nothing is sent for interfaces with zero sizes only.
+  for(auto& tracker : recv_trackers)
+    tracker.skipZeroIndices();
+  no_to_recv -= setupRequests(handle, recv_trackers, recv_buffers, recv_requests,
+                              SetupRecvRequest<DataHandle>(), communicator_);
 
   while(no_to_send+no_to_recv)
   {
@@ -1149,6 +1400,136 @@ void VariableSizeCommunicator<Allocator>::communicateVariableSize(DataHandle& ha
   }
 }
 
+template<class Allocator>
+template<bool FORWARD, class DataHandle>
+void VariableSizeCommunicator<Allocator>::communicateVariableSizeProbe(DataHandle& handle)
+{
+  typedef typename DataHandle::DataType DataType;
+  typedef typename InterfaceMap::const_iterator IIter;
+  enum { sizeTag = 933400, dataTag = 933401 };
+
+  std::size_t size = interface_->size();
+  SizeCache& cache = sizeCache_[FORWARD];
+  const bool valid = cache.valid && cache.send.size()==size;
+  // Each process decides for itself whether to send its sizes again. An
+  // empty size message tells the receiver to reuse the previous ones.
+  const bool cached = valid && sizesUnchanged(handle, 0);
+  cache.valid = false;
+  cache.send.resize(size);
+  cache.recv.resize(size);
+
+  std::vector<MPI_Request> size_recv_requests(size, MPI_REQUEST_NULL);
+  std::vector<MPI_Request> send_requests(2*size, MPI_REQUEST_NULL);
+  std::vector<std::unique_ptr<MessageBuffer<DataType> > > send_buffers(size);
+  std::vector<int> pending(size, false);
+  std::size_t no_to_recv=0;
+
+  std::size_t k=0;
+  for(IIter inf=interface_->begin(), end=interface_->end(); inf!=end; ++inf, ++k)
+  {
+    const InterfaceInformation& send = InterfaceInformationChooser<FORWARD>::getSend(inf->second);
+    const InterfaceInformation& recv = InterfaceInformationChooser<FORWARD>::getReceive(inf->second);
+
+    if(recv.size())
+    {
+      // The previous sizes are kept if the message is empty
+      if(!valid)
+        cache.recv[k].assign(recv.size(), 0);
+      MPI_Irecv(&(cache.recv[k][0]), recv.size(), MPITraits<std::size_t>::getType(),
+                inf->first, sizeTag, communicator_, &size_recv_requests[k]);
+      pending[k]=true;
+      ++no_to_recv;
+    }
+
+    if(send.size())
+    {
+      std::vector<std::size_t>& sizes = cache.send[k];
+      if(!cached)
+      {
+        sizes.resize(send.size());
+        for(std::size_t i=0; i<send.size(); ++i)
+          sizes[i]=handle.size(send[i]);
+      }
+      MPI_Isend(&(sizes[0]), cached ? 0 : sizes.size(), MPITraits<std::size_t>::getType(),
+                inf->first, sizeTag, communicator_, &send_requests[2*k+1]);
+      std::size_t items=0;
+      for(std::size_t i=0; i<sizes.size(); ++i)
+        items+=sizes[i];
+      send_buffers[k].reset(new MessageBuffer<DataType>(items));
+      for(std::size_t i=0; i<send.size(); ++i)
+        if(sizes[i])
+          handle.gather(*send_buffers[k], send[i]);
+      MPI_Isend(*send_buffers[k], items, MPITraits<DataType>::getType(),
+                inf->first, dataTag, communicator_, &send_requests[2*k]);
+    }
+  }
+
+  // Receive the messages in the order of their arrival. Probing each
+  // neighbour separately makes sure that we never match a message of
+  // the next communication. If no message arrived during a whole pass,
+  // the next pass blocks until the one of the first pending neighbour
+  // arrives instead of spinning.
+  bool block=false;
+  while(no_to_recv)
+  {
+    bool matched=false;
+    k=0;
+    for(IIter inf=interface_->begin(), end=interface_->end(); inf!=end; ++inf, ++k)
+    {
+      if(!pending[k])
+        continue;
+      int flag=true;
+      MPI_Status status;
+#if MPI_VERSION >= 3
+      MPI_Message message;
+      if(block)
+        MPI_Mprobe(inf->first, dataTag, communicator_, &message, &status);
+      else
+        MPI_Improbe(inf->first, dataTag, communicator_, &flag, &message, &status);
+#else
+      if(block)
+        MPI_Probe(inf->first, dataTag, communicator_, &status);
+      else
+        MPI_Iprobe(inf->first, dataTag, communicator_, &flag, &status);
+#endif
+      block=false;
+      if(!flag)
+        continue;
+      int count;
+      MPI_Get_count(&status, MPITraits<DataType>::getType(), &count);
+      MessageBuffer<DataType> buffer(count);
+#if MPI_VERSION >= 3
+      MPI_Mrecv(buffer, count, MPITraits<DataType>::getType(), &message, MPI_STATUS_IGNORE);
+#else
+      MPI_Recv(buffer, count, MPITraits<DataType>::getType(), inf->first, dataTag,
+               communicator_, MPI_STATUS_IGNORE);
+#endif
+      // The size message precedes the data. If it is empty the sender
+      // reused its sizes, and so do we.
+      MPI_Status sizeStatus;
+      MPI_Wait(&size_recv_requests[k], &sizeStatus);
+      int sizeCount;
+      MPI_Get_count(&sizeStatus, MPITraits<std::size_t>::getType(), &sizeCount);
+      if(sizeCount==0 && !valid)
+        DUNE_THROW(InvalidStateException, "Process " << inf->first
+                   << " reused sizes that were never sent");
+
+      const InterfaceInformation& recv = InterfaceInformationChooser<FORWARD>::getReceive(inf->second);
+      const std::vector<std::size_t>& sizes = cache.recv[k];
+      for(std::size_t i=0; i<recv.size(); ++i)
+        if(sizes[i])
+          handle.scatter(buffer, recv[i], sizes[i]);
+      pending[k]=false;
+      --no_to_recv;
+      matched=true;
+    }
+    block=!matched;
+  }
+
+  MPI_Waitall(send_requests.size(), &(send_requests[0]), MPI_STATUSES_IGNORE);
+  cache.valid = true;
+}
+
 template<class Allocator>
 template<bool FORWARD, class DataHandle>
 void VariableSizeCommunicator<Allocator>::communicate(DataHandle& handle)
@@ -1158,10 +1539,39 @@ void VariableSizeCommunicator<Allocator>::communicate(DataHandle& handle)
     // either for MPI_Wait_all or MPI_Test_some.
     return;
 
+  CommunicationProfiler::Scope profile(FORWARD ? "VariableSizeCommunicator::forward" :
+                                       "VariableSizeCommunicator::backward", this);
+  // The volume is the data of the handle per neighbour, the sizes sent
+  // and the splitting into several messages are not counted.
+  typedef typename InterfaceMap::const_iterator IIter;
+  if(profile.active())
+    for(IIter inf=interface_->begin(), end=interface_->end(); inf!=end; ++inf)
+    {
+      const InterfaceInformation& send = InterfaceInformationChooser<FORWARD>::getSend(inf->second);
+      std::size_t items=0;
+      for(std::size_t i=0; i<send.size(); ++i)
+        items+=handle.size(send[i]);
+      if(items)
+        profile.send(inf->first, items*sizeof(typename DataHandle::DataType));
+    }
+
   if(handle.fixedsize())
     communicateFixedSize<FORWARD>(handle);
-  else
+  else if(negotiateSizes_)
     communicateVariableSize<FORWARD>(handle);
+  else
+    communicateVariableSizeProbe<FORWARD>(handle);
+
+  if(profile.active())
+    for(IIter inf=interface_->begin(), end=interface_->end(); inf!=end; ++inf)
+    {
+      const InterfaceInformation& recv = InterfaceInformationChooser<FORWARD>::getReceive(inf->second);
+      std::size_t items=0;
+      for(std::size_t i=0; i<recv.size(); ++i)
+        items+=handle.size(recv[i]);
+      if(items)
+        profile.receive(inf->first, items*sizeof(typename DataHandle::DataType));
+    }
 }
 } // end namespace Dune
 
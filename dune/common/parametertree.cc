@@ -24,6 +24,67 @@ ParameterTree::ParameterTree()
 
 const Dune::ParameterTree Dune::ParameterTree::empty_;
 
+std::atomic<std::size_t> ParameterTree::Cache::ids(0);
+
+ParameterTree::Cache::Cache()
+  : id(++ids), modifications(std::make_shared<std::atomic<std::size_t> >(0)), valid(0)
+{}
+
+ParameterTree::Cache::Cache(const Cache&)
+  : Cache()
+{}
+
+ParameterTree::Cache& ParameterTree::Cache::operator=(const Cache&)
+{
+  // the entries of the parent trees may point into the assigned tree
+  ++*modifications;
+  std::lock_guard<std::mutex> guard(mutex);
+  entries.clear();
+  id = ++ids;
+  return *this;
+}
+
+void ParameterTree::Cache::update()
+{
+  const std::size_t current = *modifications;
+  if (valid != current)
+  {
+    // keys must not find the cleared entries, even if a subtree counts
+    // the modifications of another tree since then
+    entries.clear();
+    id = ++ids;
+    valid = current;
+  }
+}
+
+Impl::ParameterTreeCacheEntry* ParameterTree::findEntry(const std::string& key) const
+{
+  cache_.update();
+  auto found = cache_.entries.find(key);
+  if (found != cache_.entries.end())
+    return &found->second;
+  if (! hasKey(key))
+    return nullptr;
+  Impl::ParameterTreeCacheEntry& entry = cache_.entries[key];
+  entry.value = &(*this)[key];
+  return &entry;
+}
+
+Impl::ParameterTreeCacheEntry* ParameterTree::findEntry(const ParameterKey& key) const
+{
+  cache_.update();
+  if (key.cache_ == cache_.id && key.modifications_ == cache_.valid)
+    return key.entry_;
+  Impl::ParameterTreeCacheEntry* entry = findEntry(key.str());
+  if (entry)
+  {
+    key.cache_ = cache_.id;
+    key.modifications_ = cache_.valid;
+    key.entry_ = entry;
+  }
+  return entry;
+}
+
 void ParameterTree::report(std::ostream& stream, const std::string& prefix) const
 {
   typedef std::map<std::string, std::string>::const_iterator ValueIt;
@@ -71,6 +132,12 @@ bool ParameterTree::hasKey(const std::string& key) const
 
 }
 
+bool ParameterTree::hasKey(const ParameterKey& key) const
+{
+  std::lock_guard<std::mutex> guard(cache_.mutex);
+  return findEntry(key) != nullptr;
+}
+
 bool ParameterTree::hasSub(const std::string& key) const
 {
   std::string::size_type dot = key.find(".");
@@ -112,9 +179,16 @@ ParameterTree& ParameterTree::sub(const std::string& key)
     if (values_.count(key) > 0)
       DUNE_THROW(RangeError,"key " << key << " occurs as value and as subtree");
     if (subs_.count(key) == 0)
+    {
       subKeys_.push_back(key.substr(0,dot));
-    subs_[key].prefix_ = prefix_ + key + ".";
-    return subs_[key];
+      ++*cache_.modifications;
+    }
+    ParameterTree& s = subs_[key];
+    s.prefix_ = prefix_ + key + ".";
+    // Subtrees are only modified through references returned here, so
+    // this also links the subtrees of a copied tree to the copy
+    s.cache_.modifications = cache_.modifications;
+    return s;
   }
 }
 
@@ -157,7 +231,10 @@ std::string& ParameterTree::operator[] (const std::string& key)
   else
   {
     if (! hasKey(key))
+    {
       valueKeys_.push_back(key);
+      ++*cache_.modifications;
+    }
     return values_[key];
   }
 }
@@ -8,28 +8,117 @@
  */
 
 #include <array>
+#include <atomic>
 #include <cstddef>
 #include <iostream>
 #include <istream>
 #include <iterator>
 #include <locale>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <ostream>
 #include <sstream>
 #include <string>
+#include <type_traits>
 #include <typeinfo>
+#include <unordered_map>
 #include <vector>
 #include <algorithm>
 #include <bitset>
 
+#if __cplusplus >= 201703L
+#include <charconv>
+#endif
+
 #include <dune/common/exceptions.hh>
 #include <dune/common/fvector.hh>
 #include <dune/common/classname.hh>
 
 namespace Dune {
 
+  namespace Impl {
+
+    // Whether the values of type T are converted by std::from_chars
+    template<class T>
+    struct IsFromCharsConvertible
+#ifdef __cpp_lib_to_chars
+      : std::integral_constant<bool, std::is_floating_point<T>::value
+                                     || (std::is_integral<T>::value
+                                         && !std::is_same<T,bool>::value
+                                         && !std::is_same<T,char>::value
+                                         && !std::is_same<T,signed char>::value
+                                         && !std::is_same<T,unsigned char>::value)>
+#else
+      : std::false_type
+#endif
+    {};
+
+    // A value found by ParameterTree::get() and its last parsed value
+    struct ParameterTreeCacheEntry
+    {
+      // the string in the tree
+      const std::string* value;
+      // the string the parsed value was parsed from
+      std::string source;
+      const std::type_info* type;
+      std::shared_ptr<const void> parsed;
+    };
+
+  } // end namespace Impl
+
+  /** \brief A key for repeated lookups in a ParameterTree
+   * \ingroup Common
+   *
+   * The key remembers the value it was last looked up in, so getting
+   * the value again from the same tree takes constant time, as long as
+   * no keys or subtrees were added to any tree and no tree was assigned:
+   * \code
+   * const ParameterKey dt("time.dt");
+   * for(...)
+   *   t += ptree.get<double>(dt);
+   * \endcode
+   *
+   * A key may only be used by one thread at a time.
+   */
+  class ParameterKey
+  {
+  public:
+    //! Create a key from a dotted key name
+    explicit ParameterKey(const std::string& key)
+      : key_(key), cache_(0), modifications_(0), entry_(nullptr)
+    {}
+
+    //! Create a key from a dotted key name
+    explicit ParameterKey(const char* key)
+      : ParameterKey(std::string(key))
+    {}
+
+    //! The dotted key name
+    const std::string& str() const
+    {
+      return key_;
+    }
+
+  private:
+    friend class ParameterTree;
+
+    std::string key_;
+    // where the value was found last
+    mutable std::size_t cache_;
+    mutable std::size_t modifications_;
+    mutable Impl::ParameterTreeCacheEntry* entry_;
+  };
+
   /** \brief Hierarchical structure of string parameters
    * \ingroup Common
+   *
+   * The values found by get() are kept in a hash table by their dotted
+   * keys, together with the last value parsed from them, so getting a
+   * value again neither walks the subtrees nor parses the string again.
+   * A parsed value is reused as long as the string it was parsed from is
+   * unchanged. Adding keys or subtrees to any tree, or assigning a tree,
+   * clears the tables. Use a ParameterKey to avoid hashing the key, too.
    */
   class ParameterTree
   {
@@ -58,6 +147,13 @@ namespace Dune {
      */
     bool hasKey(const std::string& key) const;
 
+    /** \brief test for key
+     *
+     * \param key key
+     * \return true if key exists in structure, otherwise false
+     */
+    bool hasKey(const ParameterKey& key) const;
+
 
     /** \brief test for substructure
      *
@@ -154,8 +250,27 @@ namespace Dune {
      */
     template<typename T>
     T get(const std::string& key, const T& defaultValue) const {
-      if(hasKey(key))
-        return get<T>(key);
+      std::lock_guard<std::mutex> guard(cache_.mutex);
+      Impl::ParameterTreeCacheEntry* entry = findEntry(key);
+      if(entry)
+        return parseEntry<T>(*entry, key);
+      else
+        return defaultValue;
+    }
+
+    /** \brief get value converted to a certain type
+     *
+     * \tparam T type of returned value.
+     * \param key key
+     * \param defaultValue default if key does not exist
+     * \return value converted to T
+     */
+    template<typename T>
+    T get(const ParameterKey& key, const T& defaultValue) const {
+      std::lock_guard<std::mutex> guard(cache_.mutex);
+      Impl::ParameterTreeCacheEntry* entry = findEntry(key);
+      if(entry)
+        return parseEntry<T>(*entry, key.str());
       else
         return defaultValue;
     }
@@ -170,18 +285,30 @@ namespace Dune {
      */
     template <class T>
     T get(const std::string& key) const {
-      if(not hasKey(key))
+      std::lock_guard<std::mutex> guard(cache_.mutex);
+      Impl::ParameterTreeCacheEntry* entry = findEntry(key);
+      if(not entry)
         DUNE_THROW(Dune::RangeError, "Key '" << key
           << "' not found in ParameterTree (prefix " + prefix_ + ")");
-      try {
-        return Parser<T>::parse((*this)[key]);
-      }
-      catch(const RangeError& e) {
-        // rethrow the error and add more information
-        DUNE_THROW(RangeError, "Cannot parse value \"" << (*this)[key]
-          << "\" for key \"" << prefix_ << "." << key << "\""
-          << e.what());
-      }
+      return parseEntry<T>(*entry, key);
+    }
+
+    /** \brief Get value
+     *
+     * \tparam T Type of the value
+     * \param key Key
+     * \throws RangeError if key does not exist
+     * \throws NotImplemented Type is not supported
+     * \return value as T
+     */
+    template <class T>
+    T get(const ParameterKey& key) const {
+      std::lock_guard<std::mutex> guard(cache_.mutex);
+      Impl::ParameterTreeCacheEntry* entry = findEntry(key);
+      if(not entry)
+        DUNE_THROW(Dune::RangeError, "Key '" << key.str()
+          << "' not found in ParameterTree (prefix " + prefix_ + ")");
+      return parseEntry<T>(*entry, key.str());
     }
 
     /** \brief get value keys
@@ -215,16 +342,137 @@ namespace Dune {
     std::map<std::string, std::string> values_;
     std::map<std::string, ParameterTree> subs_;
 
+    // The values found by get(), which are neither copied nor assigned
+    // with the tree. The entries point into the tree and its subtrees,
+    // they are cleared if keys or subtrees were added to the tree or to
+    // one of its subtrees, or one of them was assigned. Therefore a tree
+    // and all its subtrees count their modifications together.
+    struct Cache
+    {
+      Cache();
+      Cache(const Cache&);
+      Cache& operator=(const Cache&);
+
+      // Clear the entries if they may be invalid
+      void update();
+
+      std::unordered_map<std::string, Impl::ParameterTreeCacheEntry> entries;
+      // the identifier of the entries, unique for the whole program
+      std::size_t id;
+      // the modifications of the tree, shared with its subtrees by sub()
+      std::shared_ptr<std::atomic<std::size_t> > modifications;
+      // the number of modifications the entries are valid for
+      std::size_t valid;
+      std::mutex mutex;
+
+      static std::atomic<std::size_t> ids;
+    };
+
+    mutable Cache cache_;
+
+    // Find the entry of a key in the cache, or add it. Returns a null
+    // pointer if there is no such key.
+    Impl::ParameterTreeCacheEntry* findEntry(const std::string& key) const;
+    Impl::ParameterTreeCacheEntry* findEntry(const ParameterKey& key) const;
+
+    // Parse the value of an entry, or reuse the value parsed last
+    template<class T>
+    T parseEntry(Impl::ParameterTreeCacheEntry& entry, const std::string& key) const
+    {
+      if(entry.parsed && *entry.type == typeid(T) && entry.source == *entry.value)
+        return *static_cast<const T*>(entry.parsed.get());
+      try {
+        T value = Parser<T>::parse(*entry.value);
+        entry.parsed = std::make_shared<T>(value);
+        entry.type = &typeid(T);
+        entry.source = *entry.value;
+        return value;
+      }
+      catch(const RangeError& e) {
+        // rethrow the error and add more information
+        DUNE_THROW(RangeError, "Cannot parse value \"" << *entry.value
+          << "\" for key \"" << prefix_ << "." << key << "\""
+          << e.what());
+      }
+    }
+
     static std::string ltrim(const std::string& s);
     static std::string rtrim(const std::string& s);
     static std::vector<std::string> split(const std::string & s);
 
+    static bool isSpace(char c)
+    {
+      return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+    }
+
+    static std::size_t countWords(const std::string& str)
+    {
+      std::size_t n = 0;
+      bool inWord = false;
+      for (char c : str)
+      {
+        n += !inWord && !isSpace(c);
+        inWord = !isSpace(c);
+      }
+      return n;
+    }
+
+    // Convert the whitespace separated numbers of str into a range
+    // without a stream. Returns false if the type is not supported or if
+    // str does not hold exactly as many numbers as the range, then the
+    // stream reports the error. Only numbers accepted by the stream are
+    // accepted, with the same value.
+    template<class Iterator>
+    static bool parseFast(const std::string& str, Iterator it, const Iterator& end)
+    {
+      typedef typename std::iterator_traits<Iterator>::value_type Value;
+      return parseFast(str, it, end, Impl::IsFromCharsConvertible<Value>());
+    }
+
+    template<class Iterator>
+    static bool parseFast(const std::string&, Iterator, const Iterator&, std::false_type)
+    {
+      return false;
+    }
+
+#ifdef __cpp_lib_to_chars
+    template<class Iterator>
+    static bool parseFast(const std::string& str, Iterator it, const Iterator& end, std::true_type)
+    {
+      const char* first = str.data();
+      const char* const last = first + str.size();
+      for (; it != end; ++it)
+      {
+        while (first != last && isSpace(*first))
+          ++first;
+        if (first == last)
+          return false;
+        // the stream accepts a plus but no other sign after it
+        if (*first == '+' && (++first == last || *first == '-'))
+          return false;
+        // nor infinities and NaNs
+        const char* digits = (*first == '-') ? first+1 : first;
+        if (digits != last && *digits != '.' && (*digits < '0' || *digits > '9'))
+          return false;
+        const std::from_chars_result result = std::from_chars(first, last, *it);
+        if (result.ec != std::errc() || (result.ptr != last && !isSpace(*result.ptr)))
+          return false;
+        first = result.ptr;
+      }
+      while (first != last && isSpace(*first))
+        ++first;
+      return first == last;
+    }
+#endif
+
     // parse into a fixed-size range of iterators
     template<class Iterator>
     static void parseRange(const std::string &str,
                            Iterator it, const Iterator &end)
     {
       typedef typename std::iterator_traits<Iterator>::value_type Value;
+      if (parseFast(str, it, end))
+        return;
       std::istringstream s(str);
       // make sure we are in locale "C"
       s.imbue(std::locale::classic());
@@ -250,6 +498,8 @@ namespace Dune {
   struct ParameterTree::Parser {
     static T parse(const std::string& str) {
       T val;
+      if (parseFast(str, &val, &val+1))
+        return val;
       std::istringstream s(str);
       // make sure we are in locale "C"
       s.imbue(std::locale::classic());
@@ -343,8 +593,15 @@ namespace Dune {
   struct ParameterTree::Parser<std::vector<T, A> > {
     static std::vector<T, A>
     parse(const std::string& str) {
-      std::vector<std::string> sub = split(str);
       std::vector<T, A> vec;
+      if (Impl::IsFromCharsConvertible<T>::value)
+      {
+        vec.resize(countWords(str));
+        if (parseFast(str, vec.begin(), vec.end()))
+          return vec;
+        vec.clear();
+      }
+      std::vector<std::string> sub = split(str);
       for (unsigned int i=0; i<sub.size(); ++i) {
         T val = ParameterTree::Parser<T>::parse(sub[i]);
         vec.push_back(val);
@@ -0,0 +1,135 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <array>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <dune/common/parallel/mpihelper.hh>
+#include <dune/common/test/testsuite.hh>
+#include <dune/common/timer.hh>
+
+typedef Dune::CollectiveCommunication<Dune::MPIHelper::MPICommunicator> Comm;
+
+// integral values, so that the sums do not depend on the order
+void testAllreduce(Comm comm, int len, Dune::TestSuite& t)
+{
+  const int size = comm.size();
+  std::vector<double> in(len), out(len), inout(len);
+  for(int i=0; i<len; ++i)
+    in[i] = inout[i] = comm.rank() + i;
+
+  comm.allreduce<std::plus<double> >(in.data(), out.data(), len);
+  comm.sum(inout.data(), len);
+  for(int i=0; i<len; ++i) {
+    const double sum = size*(size-1)/2 + size*i;
+    t.check(out[i] == sum) << "wrong sum of " << len << " values at " << i;
+    t.check(inout[i] == sum) << "wrong in place sum of " << len << " values at " << i;
+  }
+
+  std::vector<int> values(len);
+  for(int i=0; i<len; ++i)
+    values[i] = (comm.rank()+i) % size;
+  comm.max(values.data(), len);
+  for(int i=0; i<len; ++i)
+    t.check(values[i] == size-1) << "wrong maximum of " << len << " values at " << i;
+  t.check(comm.min(comm.rank()) == 0) << "wrong minimum";
+
+  // arrays are reduced element-wise
+  std::vector<std::array<int,2> > pairs(len, {{comm.rank(), -comm.rank()}});
+  comm.max(pairs.data(), len);
+  for(const auto& pair : pairs)
+    t.check(pair[0] == size-1 && pair[1] == 0) << "wrong element-wise maximum";
+}
+
+void testBroadcast(Comm comm, int len, Dune::TestSuite& t)
+{
+  for(int root=0; root<comm.size(); ++root) {
+    std::vector<double> values(len, comm.rank());
+    comm.broadcast(values.data(), len, root);
+    for(double v : values)
+      t.check(v == root) << "wrong broadcast of " << len << " values from " << root;
+  }
+}
+
+void test(Comm comm, Dune::TestSuite& t)
+{
+  comm.setHierarchical(true);
+  t.check(comm.hierarchical());
+  // growing sizes reallocate the shared memory
+  for(int len : {1, 7, 1000, 100})
+    testAllreduce(comm, len, t);
+  for(int len : {1, 3000})
+    testBroadcast(comm, len, t);
+
+  // copies share the setting
+  Comm copy(comm);
+  t.check(copy.hierarchical());
+  t.check(copy.sum(1) == comm.size()) << "wrong sum of a copy";
+
+  // reproducible sums reduce the accumulators in two levels
+  comm.setReproducibleSums(true);
+  const double sum = comm.sum(0.1*comm.rank());
+  comm.setHierarchical(false);
+  t.check(sum == comm.sum(0.1*comm.rank())) << "reproducible sums differ";
+  comm.setReproducibleSums(false);
+  comm.setHierarchical(true);
+
+  // types that are not trivially copyable are reduced flat
+  auto result = comm.allreduce(std::make_tuple(std::make_pair(1, std::plus<int>()),
+                                               std::make_pair(comm.rank(), Dune::Max<int>())));
+  t.check(std::get<0>(result) == comm.size() && std::get<1>(result) == comm.size()-1)
+    << "wrong tuple reduction";
+}
+
+void benchmark(Comm comm, int reps, int len)
+{
+  std::vector<double> values(len, 1.0);
+  double elapsed[2];
+  for(int hierarchical=0; hierarchical<2; ++hierarchical) {
+    comm.setHierarchical(hierarchical);
+    comm.barrier();
+    Dune::Timer timer;
+    for(int i=0; i<reps; ++i)
+      comm.sum(values.data(), len);
+    elapsed[hierarchical] = comm.max(timer.elapsed());
+  }
+  if(comm.rank()==0)
+    std::cout<<"allreduce of "<<len<<" doubles: "<<elapsed[0]/reps<<" s flat, "
+             <<elapsed[1]/reps<<" s hierarchical"<<std::endl;
+}
+
+int main(int argc, char** argv)
+{
+  Dune::MPIHelper& mpi = Dune::MPIHelper::instance(argc, argv);
+  Comm comm(mpi.getCommunicator());
+  int reps = argc>1 ? std::atoi(argv[1]) : 100;
+
+  Dune::TestSuite t;
+  test(comm, t);
+
+#if HAVE_MPI && MPI_VERSION >= 3
+  // nodes of at most two processes, so that the nodes communicate
+  Dune::Impl::HierarchicalCollectives::setMaxNodeSize(2);
+  MPI_Comm reversed;
+  MPI_Comm_split(MPI_COMM_WORLD, 0, comm.size()-comm.rank(), &reversed);
+  test(Comm(reversed), t);
+  t.check(Dune::Impl::HierarchicalCollectives::get(reversed).nodes() == (comm.size()+1)/2)
+    << "wrong number of nodes";
+  // frees the collectives attached to it
+  MPI_Comm_free(&reversed);
+  Dune::Impl::HierarchicalCollectives::setMaxNodeSize(0);
+#endif
+
+  for(int len : {1, 16, 1024, 65536})
+    benchmark(comm, reps, len);
+
+  return t.exit();
+}
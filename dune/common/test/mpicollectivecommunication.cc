@@ -4,11 +4,141 @@
 #include "config.h"
 #endif
 
+#include <dune/common/fvector.hh>
 #include <dune/common/parallel/mpihelper.hh>
 #include <dune/common/parallel/mpicollectivecommunication.hh>
 #include <dune/common/test/testsuite.hh>
 
+#include <array>
+#include <cmath>
+#include <functional>
 #include <iostream>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// The same code runs with the sequential and the MPI communication
+template<class Comm>
+void testFutures(const Comm& comm, Dune::TestSuite& t)
+{
+  auto sum = comm.template iallreduce<std::plus<int> >(comm.rank()+1);
+  auto max = comm.imax(comm.rank());
+  t.check(sum.valid());
+  const int size = comm.size();
+  t.check(sum.get() == size*(size+1)/2) << "wrong sum of a future";
+  t.check(!sum.valid());
+  max.wait();
+  t.check(max.ready());
+  t.check(max.get() == size-1) << "wrong maximum of a future";
+
+  std::vector<double> in(3, 1.0), out(3);
+  auto fsum = comm.template iallreduce<std::plus<double> >(in.data(), out.data(), 3);
+  while(!fsum.ready())
+    ;
+  fsum.get();
+  for(double v : out)
+    t.check(v == size) << "wrong sum of an array";
+
+  int value = comm.rank()==0 ? 42 : 0;
+  comm.ibroadcast(&value, 1, 0).get();
+  t.check(value == 42) << "wrong broadcast value";
+
+  std::vector<int> ranks(size);
+  int rank = comm.rank();
+  auto gathered = comm.iallgather(&rank, 1, ranks.data());
+  comm.ibarrier().wait();
+  gathered.wait();
+  for(int i=0; i<size; ++i)
+    t.check(ranks[i] == i) << "wrong allgather value";
+}
+
+template<class Comm>
+void testFusedAllreduce(const Comm& comm, Dune::TestSuite& t)
+{
+  const int size = comm.size();
+  const int rank = comm.rank();
+  auto values = std::make_tuple(std::make_pair(1.0, std::plus<double>()),
+                                std::make_pair(double(rank), Dune::Max<double>()),
+                                std::make_pair(rank+1, Dune::Min<int>()),
+                                std::make_pair(char(rank==0), std::plus<char>()));
+  auto r = comm.allreduce(values);
+  t.check(std::get<0>(r) == size) << "wrong sum of fused allreduce";
+  t.check(std::get<1>(r) == size-1) << "wrong maximum of fused allreduce";
+  t.check(std::get<2>(r) == 1) << "wrong minimum of fused allreduce";
+  t.check(std::get<3>(r) == 1) << "wrong sum of chars of fused allreduce";
+
+  auto future = comm.iallreduce(values);
+  t.check(future.get() == r) << "wrong result of nonblocking fused allreduce";
+}
+
+struct AbsMax
+{
+  double operator()(double a, double b) const
+  {
+    return std::max(std::abs(a), std::abs(b));
+  }
+};
+
+// A scalar without a builtin MPI operation
+struct Level
+{
+  int value;
+
+  bool operator<(const Level& other) const
+  {
+    return value < other.value;
+  }
+
+  bool operator==(const Level& other) const
+  {
+    return value == other.value;
+  }
+};
+
+template<class Comm>
+void testElementwiseReduction(const Comm& comm, Dune::TestSuite& t)
+{
+  typedef Dune::FieldVector<double,3> Vector;
+#if HAVE_MPI
+  t.check(Dune::Impl::MPIReduction<Vector, std::plus<Vector> >::count(2) == 6)
+    << "FieldVector sums are not mapped to MPI_SUM on the field type";
+#endif
+
+  const int size = comm.size();
+  const int rank = comm.rank();
+  std::vector<Vector> v(5, Vector{1.0, double(rank), -double(rank)});
+  comm.sum(v.data(), v.size());
+  for(const Vector& x : v)
+    t.check(x == Vector{double(size), size*(size-1)/2.0, -size*(size-1)/2.0})
+      << "wrong sum of FieldVectors";
+
+  Vector w{double(rank), -double(rank), 1.0};
+  t.check(comm.max(w) == Vector{double(size-1), 0.0, 1.0}) << "wrong maximum of a FieldVector";
+  t.check(comm.min(w) == Vector{0.0, -double(size-1), 1.0}) << "wrong minimum of a FieldVector";
+
+  std::array<int,4> a{{rank, 1, 2*rank, -rank}};
+  std::array<int,4> expected{{size*(size-1)/2, size, size*(size-1), -size*(size-1)/2}};
+  t.check(comm.sum(a) == expected) << "wrong sum of an array";
+
+  // the maximum of arrays of other scalars is element-wise, too
+  std::array<Level,2> levels{{Level{rank}, Level{-rank}}};
+  std::array<Level,2> maxLevels{{Level{size-1}, Level{0}}};
+  t.check(comm.max(levels) == maxLevels) << "wrong maximum of an array of custom scalars";
+
+  Dune::FieldVector<Dune::FieldVector<double,2>,2> m = Dune::FieldVector<double,2>(rank);
+  m = comm.isum(m).get();
+  for(const auto& row : m)
+    for(double x : row)
+      t.check(x == size*(size-1)/2.0) << "wrong sum of nested FieldVectors";
+
+  std::vector<double> d(100);
+  for(std::size_t i=0; i<d.size(); ++i)
+    d[i] = rank%2 ? -double(rank+i) : double(rank+i);
+  comm.template allreduce<AbsMax>(d.data(), d.size());
+  for(std::size_t i=0; i<d.size(); ++i)
+    t.check(d[i] == size-1+i) << "wrong result of a custom reduction";
+}
+
 int main(int argc, char** argv)
 {
   Dune::TestSuite t;
@@ -59,6 +189,12 @@ int main(int argc, char** argv)
     }
   }
 
+  testFutures(Dune::CollectiveCommunication<Helper::MPICommunicator>(mpi.getCommunicator()), t);
+  testFutures(Dune::CollectiveCommunication<Dune::No_Comm>(), t);
+  testFusedAllreduce(Dune::CollectiveCommunication<Helper::MPICommunicator>(mpi.getCommunicator()), t);
+  testFusedAllreduce(Dune::CollectiveCommunication<Dune::No_Comm>(), t);
+  testElementwiseReduction(Dune::CollectiveCommunication<Helper::MPICommunicator>(mpi.getCommunicator()), t);
+
   std::cout << "We are at the end!"<<std::endl;
 
   return t.exit();
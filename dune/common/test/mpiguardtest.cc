@@ -87,7 +87,102 @@ int main(int argc, char** argv)
               << e.what() << std::endl;
   }
 
+  // the last process fails, the others have to throw an MPIGuardError
+  const bool failing = mpihelper.rank() == mpihelper.size()-1;
+  int wrong = 0;
+
+  mpihelper.getCollectiveCommunication().barrier();
+  if (mpihelper.rank() == 0)
+    std::cout << "---- nested guards" << std::endl;
+  try
+  {
+    Dune::MPIGuard guard;
+    for (int phase = 0; phase < 3; ++phase)
+    {
+      try
+      {
+        // errors of the phases are reported by the enclosing guard
+        Dune::MPIGuard phaseGuard(guard);
+        if (phase == 1 && failing)
+          DUNE_THROW(Dune::Exception, "Fakeproblem on process " << mpihelper.rank());
+        phaseGuard.finalize();
+      }
+      catch (Dune::MPIGuardError & e)
+      {
+        std::cout << "Error (rank " << mpihelper.rank() << "): nested guard communicated" << std::endl;
+        ++wrong;
+      }
+      catch (Dune::Exception & e) {}
+    }
+    guard.finalize();
+    std::cout << "Error (rank " << mpihelper.rank() << "): no error detected" << std::endl;
+    ++wrong;
+  }
+  catch (Dune::MPIGuardError & e)
+  {
+    std::cout << "Error (rank " << mpihelper.rank() << "): "
+              << e.what() << std::endl;
+  }
+
+  mpihelper.getCollectiveCommunication().barrier();
+  if (mpihelper.rank() == 0)
+    std::cout << "---- nonblocking guard" << std::endl;
+  {
+    // without errors nothing is thrown
+    Dune::MPIGuard guard(mpihelper, false);
+    guard.setNonblocking();
+    for (int phase = 0; phase < 3; ++phase)
+    {
+      guard.reactivate();
+      guard.finalize();
+    }
+    guard.wait();
+    Dune::CollectiveCommunication<Dune::No_Comm> sequential;
+    Dune::MPIGuard sequentialGuard(sequential);
+    sequentialGuard.setNonblocking();
+    sequentialGuard.finalize();
+    sequentialGuard.wait();
+    if (guard.pending() || sequentialGuard.pending())
+    {
+      std::cout << "Error (rank " << mpihelper.rank() << "): check still pending" << std::endl;
+      ++wrong;
+    }
+  }
+  int detected = -1;
+  int phase = 0;
+  try
+  {
+    Dune::MPIGuard guard(mpihelper, false);
+    guard.setNonblocking();
+    for (; phase < 4; ++phase)
+    {
+      guard.reactivate();
+      if (phase == 1 && failing)
+        DUNE_THROW(Dune::Exception, "Fakeproblem on process " << mpihelper.rank());
+      guard.finalize();
+    }
+    guard.wait();
+  }
+  catch (Dune::MPIGuardError & e)
+  {
+    std::cout << "Error (rank " << mpihelper.rank() << "): "
+              << e.what() << std::endl;
+    detected = phase;
+  }
+  catch (Dune::Exception & e)
+  {
+    detected = failing ? phase : -1;
+  }
+  // the error of a phase is detected by the check in the next phase
+  if (detected != (failing ? 1 : 2))
+  {
+    std::cout << "Error (rank " << mpihelper.rank() << "): error detected in phase "
+              << detected << std::endl;
+    ++wrong;
+  }
+
   mpihelper.getCollectiveCommunication().barrier();
   if (mpihelper.rank() == 0)
     std::cout << "---- done" << std::endl;
+  return wrong;
 }
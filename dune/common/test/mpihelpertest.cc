@@ -19,12 +19,55 @@ int main(int argc, char** argv)
 #endif
 
   typedef Dune::MPIHelper Helper;
+  int ret = 0;
 
   {
-    Helper& mpi = Helper::instance(argc, argv);
+    Helper& mpi = Helper::instance(argc, argv, Helper::threadFunneled);
 
     Helper::MPICommunicator comm DUNE_UNUSED = mpi.getCommunicator();
     comm= mpi.getCommunicator();
+
+    if(mpi.threadLevel() < Helper::threadSingle || mpi.threadLevel() > Helper::threadMultiple) {
+      std::cerr << "Invalid thread level " << mpi.threadLevel() << std::endl;
+      ret = 1;
+    }
+#if HAVE_MPI
+    int provided;
+    MPI_Query_thread(&provided);
+    if(provided != mpi.threadLevel()) {
+      std::cerr << "Wrong thread level " << mpi.threadLevel() << " instead of " << provided << std::endl;
+      ret = 1;
+    }
+#ifndef MPIHELPER_PREINITIALIZE
+    if(mpi.threadLevel() < Helper::threadFunneled)
+      std::cout << "MPI does not provide the requested thread level" << std::endl;
+#endif
+
+    // The processes with rank zero on their node form the communicator
+    // between the nodes
+    Helper::MPICommunicator node = mpi.nodeCommunicator();
+    Helper::MPICommunicator interNode = mpi.interNodeCommunicator();
+    int nodeRank, nodeSize, interNodeSize, leader, nodes, processes;
+    MPI_Comm_rank(node, &nodeRank);
+    MPI_Comm_size(node, &nodeSize);
+    MPI_Comm_size(interNode, &interNodeSize);
+    leader = nodeRank==0;
+    MPI_Allreduce(&leader, &nodes, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(&leader, &processes, 1, MPI_INT, MPI_SUM, node);
+    if(processes != 1) {
+      std::cerr << "The node has " << processes << " processes with rank zero" << std::endl;
+      ret = 1;
+    }
+    if(leader && interNodeSize != nodes) {
+      std::cerr << "The communicator between " << nodes << " nodes has "
+                << interNodeSize << " processes" << std::endl;
+      ret = 1;
+    }
+    if(node != mpi.nodeCommunicator()) {
+      std::cerr << "The node communicator was created twice" << std::endl;
+      ret = 1;
+    }
+#endif
   }
 
   {
@@ -41,4 +84,5 @@ int main(int argc, char** argv)
   }
   std::cout << "We are at the end!"<<std::endl;
 
+  return ret;
 }
@@ -7,12 +7,15 @@
 #include <array>
 #include <cstdlib>
 #include <iostream>
+#include <limits>
 #include <ostream>
 #include <sstream>
+#include <vector>
 
 #include <dune/common/exceptions.hh>
 #include <dune/common/parametertree.hh>
 #include <dune/common/parametertreeparser.hh>
+#include <dune/common/timer.hh>
 
 // This assert macro does not depend on the value of NDEBUG
 #define check_assert(expr)                                          \
@@ -281,6 +284,117 @@ void testReport()
   check_recursiveTreeCompare(ptree, ptree2);
 }
 
+// test the reuse of looked up and parsed values
+void testCache()
+{
+  Dune::ParameterTree ptree;
+  ptree["a"] = "1";
+  ptree["time.dt"] = "0.5";
+  const Dune::ParameterKey a("a"), dt("time.dt"), missing("time.missing");
+
+  check_assert(ptree.get<int>(a) == 1);
+  check_assert(ptree.get<double>(a) == 1.0);
+  check_assert(ptree.get<double>(dt) == 0.5);
+  check_assert(ptree.get<double>(dt) == ptree.get<double>("time.dt"));
+  check_assert(ptree.hasKey(dt) && !ptree.hasKey(missing));
+  check_assert(ptree.get<int>(missing, 3) == 3);
+  check_throw(ptree.get<int>(missing), Dune::RangeError);
+
+  // writing a value invalidates the parsed one
+  ptree["a"] = "2";
+  check_assert(ptree.get<int>(a) == 2 && ptree.get<int>("a") == 2);
+  std::string& value = ptree["a"];
+  check_assert(ptree.get<int>(a) == 2);
+  value = "3";
+  check_assert(ptree.get<int>(a) == 3 && ptree.get<int>("a") == 3);
+  value = "x";
+  check_throw(ptree.get<int>(a), Dune::RangeError);
+
+  // adding keys and assigning subtrees
+  ptree["time.end"] = "10";
+  check_assert(ptree.get<double>(dt) == 0.5);
+  ptree.sub("time") = Dune::ParameterTree();
+  ptree.sub("time")["dt"] = "0.25";
+  check_assert(ptree.get<double>(dt) == 0.25);
+  check_assert(ptree.sub("time").get<double>("dt") == 0.25);
+  check_assert(!ptree.hasKey("time.end"));
+
+  // copies are independent
+  Dune::ParameterTree copy = ptree;
+  copy["time.dt"] = "1";
+  check_assert(copy.get<double>(dt) == 1.0 && ptree.get<double>(dt) == 0.25);
+
+  // modifying a subtree of the copy updates the values found in the copy
+  Dune::ParameterTree& time = copy.sub("time");
+  time["end"] = "20";
+  check_assert(copy.get<double>("time.end") == 20.0 && !ptree.hasKey("time.end"));
+  time = Dune::ParameterTree();
+  check_assert(!copy.hasKey(dt) && ptree.get<double>(dt) == 0.25);
+
+  // the time of repeated lookups
+  const int reps = 100000;
+  double sum = 0.0;
+  Dune::Timer timer;
+  for (int i = 0; i < reps; ++i)
+    sum += ptree.get<double>("time.dt");
+  const double byName = timer.elapsed();
+  timer.reset();
+  for (int i = 0; i < reps; ++i)
+    sum += ptree.get<double>(dt);
+  const double byKey = timer.elapsed();
+  check_assert(sum == 2*reps*0.25);
+  std::cout << "lookup of a double by name: " << byName/reps << " s, by key: "
+            << byKey/reps << " s" << std::endl;
+}
+
+// test the conversion of numbers and ranges of them
+void testParse()
+{
+  Dune::ParameterTree ptree;
+  check_assert((ptree["x"] = " \t-2.5e1 ", ptree.get<double>("x") == -25.0));
+  check_assert((ptree["x"] = "+.5", ptree.get<float>("x") == 0.5f));
+  check_assert((ptree["x"] = "007", ptree.get<long>("x") == 7));
+  check_assert((ptree["x"] = "18446744073709551615",
+                ptree.get<unsigned long long>("x") == std::numeric_limits<unsigned long long>::max()));
+  check_throw((ptree["x"] = "+-1", ptree.get<int>("x")), Dune::RangeError);
+  check_throw((ptree["x"] = "1.5", ptree.get<int>("x")), Dune::RangeError);
+  check_throw((ptree["x"] = "1e3", ptree.get<short>("x")), Dune::RangeError);
+  check_throw((ptree["x"] = "99999999999", ptree.get<int>("x")), Dune::RangeError);
+  check_throw((ptree["x"] = "1 2", ptree.get<double>("x")), Dune::RangeError);
+  check_throw((ptree["x"] = "inf", ptree.get<double>("x")), Dune::RangeError);
+  check_throw((ptree["x"] = "", ptree.get<double>("x")), Dune::RangeError);
+
+  ptree["x"] = "1 -2\t3.5\n";
+  const std::vector<double> vec = ptree.get<std::vector<double> >("x");
+  check_assert(vec.size() == 3 && vec[0] == 1.0 && vec[1] == -2.0 && vec[2] == 3.5);
+  check_assert((ptree.get<Dune::FieldVector<double, 3> >("x")
+                == Dune::FieldVector<double, 3>{1.0, -2.0, 3.5}));
+  check_throw(ptree.get<std::vector<int> >("x"), Dune::RangeError);
+  check_throw((ptree.get<std::array<double, 2> >("x")), Dune::RangeError);
+  check_throw((ptree.get<std::array<double, 4> >("x")), Dune::RangeError);
+  check_assert((ptree["x"] = "  ", ptree.get<std::vector<double> >("x").empty()));
+
+  // the throughput for a large table, changing the string so that the
+  // values are parsed every time
+  const int n = 100000, reps = 10;
+  std::ostringstream table;
+  for (int i = 0; i < n; ++i)
+    table << 0.001*i << " ";
+  std::string& value = ptree["table"];
+  value = table.str();
+  Dune::Timer timer;
+  std::size_t size = 0;
+  for (int i = 0; i < reps; ++i)
+  {
+    value.back() = (i%2) ? ' ' : '\t';
+    size += ptree.get<std::vector<double> >("table").size();
+  }
+  const double elapsed = timer.elapsed();
+  check_assert(size == std::size_t(n)*reps);
+  std::cout << "parsing a table of " << n << " doubles: " << elapsed/reps << " s, "
+            << value.size()*reps/elapsed/1e6 << " MB/s" << std::endl;
+}
+
 int main()
 {
   try {
@@ -314,6 +428,12 @@ int main()
     // check report
     testReport();
 
+    // check the cache
+    testCache();
+
+    // check the conversion of values
+    testParse();
+
     // check for specific bugs
     testFS1527();
     testFS1523();
@@ -0,0 +1,148 @@
+// -*- tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+// vi: set et ts=4 sw=2 sts=2:
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include <dune/common/exactsum.hh>
+#include <dune/common/parallel/mpihelper.hh>
+#include <dune/common/test/testsuite.hh>
+#include <dune/common/timer.hh>
+
+// summands of very different magnitude and sign, so that plain sums depend on the order
+double summand(int i)
+{
+  std::mt19937_64 generator(i);
+  std::uniform_real_distribution<double> mantissa(-1.0, 1.0);
+  std::uniform_int_distribution<int> exponent(-40, 40);
+  return std::ldexp(mantissa(generator), exponent(generator));
+}
+
+double exactSum(const std::vector<double>& values)
+{
+  Dune::ExactSum sum;
+  for(double x : values)
+    sum += x;
+  return sum.value();
+}
+
+void testExactSum(Dune::TestSuite& t)
+{
+  std::vector<double> values(10000);
+  for(std::size_t i=0; i<values.size(); ++i)
+    values[i] = summand(i);
+  const double sum = exactSum(values);
+
+  std::reverse(values.begin(), values.end());
+  t.check(exactSum(values) == sum) << "exact sum depends on the order";
+  std::shuffle(values.begin(), values.end(), std::mt19937(42));
+  t.check(exactSum(values) == sum) << "exact sum depends on the order";
+
+  // split into partial sums
+  Dune::ExactSum first, second;
+  for(std::size_t i=0; i<values.size(); ++i)
+    (i%3 ? first : second) += values[i];
+  t.check((first+second).value() == sum) << "sum of partial sums differs";
+
+  t.check(exactSum({1e100, 1.0, -1e100}) == 1.0) << "cancellation is not exact";
+  // just above the midpoint between 1 and the next double
+  const double next = std::nextafter(1.0, 2.0);
+  t.check(exactSum({1.0, std::ldexp(1.0, -53), std::ldexp(1.0, -110)}) == next)
+    << "sum is not rounded once";
+  t.check(exactSum({1.0, std::ldexp(1.0, -53)}) == 1.0) << "tie is not rounded to even";
+  t.check(exactSum({-1.0, -std::ldexp(1.0, -53), -std::ldexp(1.0, -110)}) == -next)
+    << "negative sum is not rounded once";
+  t.check(exactSum({-1.0, 0.25, -1e-300}) == -0.75) << "wrong negative sum";
+  const double denormal = std::numeric_limits<double>::denorm_min();
+  t.check(exactSum({denormal, denormal, -denormal}) == denormal) << "wrong sum of denormals";
+  const double max = std::numeric_limits<double>::max();
+  t.check(exactSum({max, max, -max}) == max) << "wrong sum exceeding the range of double";
+  t.check(exactSum({max, max}) == std::numeric_limits<double>::infinity()) << "sum does not overflow";
+  t.check(exactSum({1.0, std::numeric_limits<double>::infinity()}) == std::numeric_limits<double>::infinity())
+    << "wrong sum with infinity";
+  t.check(std::isnan(exactSum({std::numeric_limits<double>::quiet_NaN(), 1.0}))) << "wrong sum with NaN";
+}
+
+template<class Comm>
+void testReproducibleSum(Comm comm, int n, Dune::TestSuite& t)
+{
+  // every process owns a contiguous part of the summands
+  const int begin = (long(n)*comm.rank())/comm.size();
+  const int end = (long(n)*(comm.rank()+1))/comm.size();
+  Dune::ExactSum local;
+  std::vector<double> all(n);
+  for(int i=0; i<n; ++i) {
+    all[i] = summand(i);
+    if(i >= begin && i < end)
+      local += all[i];
+  }
+
+  comm.setReproducibleSums(true);
+  t.check(comm.reproducibleSums());
+  const double sum = comm.sum(local.value());
+  // only the local parts are rounded, summing them is exact
+  Dune::ExactSum partial;
+  for(int p=0; p<comm.size(); ++p) {
+    Dune::ExactSum part;
+    for(int i=(long(n)*p)/comm.size(); i<(long(n)*(p+1))/comm.size(); ++i)
+      part += all[i];
+    partial += part.value();
+  }
+  t.check(sum == partial.value()) << "reproducible sum differs from the exact sum";
+
+  std::vector<double> values(3, local.value());
+  values[1] = -values[1];
+  values[2] = comm.rank();
+  comm.sum(values.data(), values.size());
+  t.check(values[0] == sum && values[1] == -sum) << "wrong reproducible sum of an array";
+  t.check(values[2] == comm.size()*(comm.size()-1)/2) << "wrong reproducible sum of an array";
+
+  float f = 0.5f;
+  t.check(comm.sum(f) == 0.5f*comm.size()) << "wrong reproducible sum of floats";
+  t.check(comm.sum(comm.rank()) == comm.size()*(comm.size()-1)/2) << "wrong sum of integers";
+}
+
+template<class Comm>
+void benchmark(Comm comm, int reps, int len)
+{
+  std::vector<double> values(len);
+  double elapsed[2];
+  for(int reproducible=0; reproducible<2; ++reproducible) {
+    comm.setReproducibleSums(reproducible);
+    comm.barrier();
+    Dune::Timer timer;
+    for(int i=0; i<reps; ++i) {
+      std::fill(values.begin(), values.end(), summand(i));
+      comm.sum(values.data(), len);
+    }
+    elapsed[reproducible] = comm.max(timer.elapsed());
+  }
+  if(comm.rank()==0)
+    std::cout<<"sum of "<<len<<" doubles: "<<elapsed[0]/reps<<" s with MPI_SUM, "
+             <<elapsed[1]/reps<<" s reproducible"<<std::endl;
+}
+
+int main(int argc, char** argv)
+{
+  Dune::MPIHelper& mpi = Dune::MPIHelper::instance(argc, argv);
+  Dune::CollectiveCommunication<Dune::MPIHelper::MPICommunicator> comm(mpi.getCommunicator());
+  int reps = argc>1 ? std::atoi(argv[1]) : 100;
+
+  Dune::TestSuite t;
+  testExactSum(t);
+  testReproducibleSum(comm, 100000, t);
+  testReproducibleSum(Dune::CollectiveCommunication<Dune::No_Comm>(), 1000, t);
+
+  for(int len : {1, 16, 1024})
+    benchmark(comm, reps, len);
+
+  return t.exit();
+}